@@ -44,6 +44,33 @@ void loop() {
 #ifdef BOOTLOADER
    if (Serial.available()) Serial4.write(Serial.read());
 #else
+   //ESP32 holds its IRQ line high while there are parameters changed over BLE or wanted by BLE for us. Clock whole
+   //128 byte frames until it drops; the writes start at byte 8 as A5 52 <version> <left> <len> <records>
+   if (digitalRead(BLE_DFU) == HIGH)
+   {
+      uint8_t miso[128];
+      digitalWrite(BLE_CS, LOW);
+      delayMicroseconds(10);
+      for (int i = 0; i < 128; i++) miso[i] = SPI.transfer(0);
+      digitalWrite(BLE_CS, HIGH);
+      if (miso[8] == 0xA5 && miso[9] == 0x52)
+      {
+         for (int pos = 0; pos < miso[12]; pos += 2 + miso[14 + pos])
+         {
+            Serial.print("BLE changed param ");
+            Serial.println(miso[13 + pos]);
+         }
+      }
+      //values a central wants fresh are asked for at byte 112 as A5 C0 <count> <param ids>
+      if (miso[112] == 0xA5 && miso[113] == 0xC0)
+      {
+         for (int i = 0; i < miso[114]; i++)
+         {
+            Serial.print("BLE wants param ");
+            Serial.println(miso[115 + i]);
+         }
+      }
+   }
    if ((lastCount + 100000) < millis())
    {
       lastCount = millis();
@@ -107,9 +134,26 @@ void loop() {
           SPI.transfer(0);
           SPI.transfer(0);
       }      
+      if (which == 5)
+      {
+          //batch of two parameters: version 1, sequence number, 7 bytes of records
+          //(param 1 = 2 bytes, param 10 = 1 byte), padded to 12 bytes
+          SPI.transfer(0xA5);
+          SPI.transfer(0x50);
+          SPI.transfer(1);
+          SPI.transfer(lastCount & 0xFF);
+          SPI.transfer(7);
+          SPI.transfer(1);
+          SPI.transfer(2);
+          SPI.transfer(40);
+          SPI.transfer(0);
+          SPI.transfer(10);
+          SPI.transfer(1);
+          SPI.transfer(23);
+      }
       
       digitalWrite(BLE_CS, HIGH);      
-      which = (which + 1) % 5;
+      which = (which + 1) % 6;
    }   
 #endif
    
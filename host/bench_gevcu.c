@@ -0,0 +1,1849 @@
+// Host benchmark for the GEVCU GATT server. Boots app_main() against the stand-in
+// ESP-IDF/Bluedroid layer in host/stub, then replays synthetic BLE client traffic
+// and SPI master frames and reports the cost of each firmware path:
+//
+//   ns/op      wall time per operation on this host
+//   allocs/op  heap allocations per operation (malloc/calloc/realloc)
+//   uart B/op  bytes the firmware printed or logged, i.e. what the 115200 baud
+//              console has to shift out; uart us/op is that at 10 bits per byte
+//
+// Usage: bench_gevcu [scale]   (scale multiplies every iteration count)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_stub.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "GattServer_GEVCU.h"
+#include "gevcu_adv.h"
+#include "gevcu_bond.h"
+#include "gevcu_boot.h"
+#include "gevcu_conn.h"
+#include "gevcu_events.h"
+#include "gevcu_history.h"
+#include "gevcu_link.h"
+#include "gevcu_notify.h"
+#include "gevcu_params.h"
+#include "gevcu_persist.h"
+#include "gevcu_profile.h"
+#include "gevcu_reads.h"
+#include "gevcu_spi.h"
+#include "gevcu_stream.h"
+#include "gevcu_telemetry.h"
+#include "gevcu_trace.h"
+#include "gevcu_writeback.h"
+#include "rom/crc.h"
+
+#define BENCH_CONN_ID       0
+#define BENCH_TIMEOUT_MS    1000
+#define UART_BAUD           CONFIG_CONSOLE_UART_BAUDRATE
+
+void app_main();
+
+static uint64_t allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+uint64_t host_alloc_count(void)
+{
+    return __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+}
+
+static FILE *report;
+static long scale = 1;
+
+typedef struct {
+    uint64_t ns;
+    uint64_t allocs;
+    uint64_t uart;
+} bench_mark_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bench_mark_t mark(void)
+{
+    bench_mark_t m = { now_ns(), host_alloc_count(), host_console_bytes() };
+    return m;
+}
+
+static void result(const char *name, long iters, bench_mark_t start)
+{
+    bench_mark_t end = mark();
+    double uart = (double)(end.uart - start.uart) / iters;
+
+    fprintf(report, "%-28s %9ld %12.1f %10.2f %10.1f %12.1f\n", name, iters,
+            (double)(end.ns - start.ns) / iters, (double)(end.allocs - start.allocs) / iters,
+            uart, uart * 10.0 * 1e6 / UART_BAUD);
+}
+
+#define BENCH(name, n, body) do {                                   \
+        long _iters = (n) * scale;                                  \
+        for (long _i = 0; _i < _iters / 10 + 1; _i++) { body; }     \
+        bench_mark_t _start = mark();                               \
+        for (long _i = 0; _i < _iters; _i++) { body; }              \
+        result(name, _iters, _start);                               \
+    } while (0)
+
+static void main_task(void *arg)
+{
+    app_main();
+    vTaskDelete(NULL);
+}
+
+//Play the BTC task until the stack has nothing left to say and the event worker is done with all of it.
+static void pump_bt(void)
+{
+    do {
+        while (eventsPending()) vTaskDelay(0);
+    } while (host_bt_run() > 0);
+}
+
+static uint16_t value_handle(uint16_t uuid)
+{
+    uint16_t handle = host_bt_find_handle(uuid);
+    if (!handle) {
+        fprintf(report, "characteristic 0x%04x not found in the attribute database\n", uuid);
+        exit(1);
+    }
+    return handle;
+}
+
+//Value of field in the config blob NVS holds, -1 if it has no record for it
+static long nvs_config_value(uint8_t field)
+{
+    uint8_t blob[1024];
+    size_t len = sizeof(blob);
+    nvs_handle handle;
+    long value = -1;
+
+    if (nvs_open(GEVCU_PERSIST_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return -1;
+    if (nvs_get_blob(handle, GEVCU_PERSIST_KEY, blob, &len) != ESP_OK) len = 0;
+    for (size_t pos = 0; pos + 2 <= len; pos += 2 + blob[pos + 1]) {
+        if (blob[pos] != field) continue;
+        value = 0;
+        memcpy(&value, &blob[pos + 2], blob[pos + 1]);
+    }
+    nvs_close(handle);
+    return value;
+}
+
+static void bench_boot(void)
+{
+    //What the last run left in NVS: a config field, and a live control that must not come back
+    uint8_t seed[] = { GEVCU_PARAM_maxTorque, 2, 0x41, 0x01, GEVCU_PARAM_gear, 1, 2 };
+    uint16_t value = 0, len = 0;
+    bench_mark_t start;
+    nvs_handle handle;
+
+    nvs_flash_init();
+    nvs_open(GEVCU_PERSIST_NAMESPACE, NVS_READWRITE, &handle);
+    nvs_set_blob(handle, GEVCU_PERSIST_KEY, seed, sizeof(seed));
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    start = mark();
+    xTaskCreate(main_task, "main", CONFIG_MAIN_TASK_STACK_SIZE, NULL, 1, NULL);
+    if (!host_bt_wait_registered(BENCH_TIMEOUT_MS) || !host_spi_wait_ready(BENCH_TIMEOUT_MS)) {
+        fprintf(report, "app_main did not finish initialisation\n");
+        exit(1);
+    }
+    pump_bt();
+    result("boot to advertising", 1, start);
+    if (!host_bt_stats()->advertising) {
+        fprintf(report, "firmware is not advertising after boot\n");
+        exit(1);
+    }
+
+    //Phases as the boot timing characteristic reports them
+#define BOOT_PHASE_NAME(name) #name,
+    static const char *const phase_name[] = { GEVCU_BOOT_PHASES(BOOT_PHASE_NAME) };
+    uint8_t timing[GEVCU_BOOT_MAX];
+    uint16_t timing_len = 0;
+    uint32_t at[GEVCU_BOOT_COUNT];
+    host_bt_client_read(BENCH_CONN_ID, value_handle(0x331A), timing, &timing_len, BENCH_TIMEOUT_MS);
+    if (timing_len != GEVCU_BOOT_MAX || timing[0] != GEVCU_BOOT_COUNT) {
+        fprintf(report, "boot timing characteristic is %u bytes, %u phases\n", timing_len, timing[0]);
+        exit(1);
+    }
+    fprintf(report, "  ->");
+    for (int phase = 0; phase < GEVCU_BOOT_COUNT; phase++) {
+        memcpy(&at[phase], &timing[1 + phase * 4], 4);
+        fprintf(report, " %s %u", phase_name[phase], at[phase]);
+    }
+    fprintf(report, " us\n");
+    if (!at[GEVCU_BOOT_ADVERTISING] || at[GEVCU_BOOT_ADVERTISING] < at[GEVCU_BOOT_SERVICES] ||
+        at[GEVCU_BOOT_ADVERTISING] < at[GEVCU_BOOT_ADV_DATA] || at[GEVCU_BOOT_SERVICES] < at[GEVCU_BOOT_TABLES]) {
+        fprintf(report, "advertising started before the services were up\n");
+        exit(1);
+    }
+
+    //Every characteristic made it into a table, whichever shard of its service it landed in
+#define BOOT_CHAR_ID(id, ...) id,
+#define BOOT_SERVICE_IDS(id, CHARS) CHARS(BOOT_CHAR_ID)
+    static const uint16_t char_id[] = { GEVCU_SERVICES(BOOT_SERVICE_IDS) };
+    for (unsigned i = 0; i < sizeof(char_id) / sizeof(char_id[0]); i++) {
+        const GATT_CHARACTERISTIC_t *chr = findCharacteristic(value_handle(char_id[i]), NULL);
+        if (!chr || chr->id != char_id[i]) {
+            fprintf(report, "characteristic 0x%04x does not resolve through the handle index\n", char_id[i]);
+            exit(1);
+        }
+    }
+    fprintf(report, "  -> %u characteristics in %u tables\n", (unsigned)(sizeof(char_id) / sizeof(char_id[0])),
+            (unsigned)host_bt_stats()->services_started);
+
+    //Served from the restored cache without GEVCU having said anything
+    host_bt_client_read(BENCH_CONN_ID, value_handle(0x310E), (uint8_t *)&value, &len, BENCH_TIMEOUT_MS);
+    if (value != 0x0141 || params.gear != 0) {
+        fprintf(report, "config was not restored from NVS (maxTorque %u, gear %u)\n", value, params.gear);
+        exit(1);
+    }
+}
+
+static void bench_gatt(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 };
+    uint16_t torque = value_handle(0x3101);
+    uint16_t max_torque = value_handle(0x310E);
+    uint8_t value[ESP_GATT_MAX_ATTR_LEN];
+    uint16_t len;
+    uint16_t write = 0;
+
+    uint16_t first = host_bt_first_handle();
+    uint16_t count = host_bt_handle_count();
+    uint16_t h = 0;
+    uint8_t role = 0;
+    const GATT_CHARACTERISTIC_t *chr = findCharacteristic(torque, &role);
+
+    if (!chr || chr->id != 0x3101 || role != GEVCU_ATTR_VALUE || findCharacteristic(first + count, NULL)) {
+        fprintf(report, "handle index does not match the attribute database\n");
+        exit(1);
+    }
+    BENCH("handle lookup (hit)", 2000000, findCharacteristic(torque, NULL));
+    BENCH("handle lookup (sweep)", 2000000, findCharacteristic(first + (h++ % (count + 64)), NULL));
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    BENCH("gatt read (cached)", 200000,
+          host_bt_client_read(BENCH_CONN_ID, torque, value, &len, BENCH_TIMEOUT_MS));
+    BENCH("gatt write (app rsp)", 200000,
+          write++; host_bt_client_write(BENCH_CONN_ID, max_torque, (uint8_t *)&write, 2, BENCH_TIMEOUT_MS));
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+}
+
+//The dashboard values that can be pushed instead of polled
+static const uint16_t notify_ids[] = {
+    0x3101, 0x3102, 0x3103, 0x3104, 0x3107, 0x3108, 0x3109, 0x310A, 0x310B, 0x310F,
+    0x3201, 0x3202, 0x3204, 0x3301, 0x3302, 0x3303,
+};
+#define NOTIFY_IDS  (int)(sizeof(notify_ids) / sizeof(notify_ids[0]))
+
+static void bench_notify(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x66 };
+    static const uint8_t enable[2] = { 0x01, 0x00 };
+    uint16_t handles[NOTIFY_IDS];
+    uint8_t value[ESP_GATT_MAX_ATTR_LEN];
+    uint16_t len;
+    uint64_t sent, t0;
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    for (int i = 0; i < NOTIFY_IDS; i++) handles[i] = value_handle(notify_ids[i]);
+
+    //What the app did before: one read, i.e. one connection event, per value per refresh
+    BENCH("poll 16 values (reads)", 20000,
+          for (int j = 0; j < NOTIFY_IDS; j++) host_bt_client_read(BENCH_CONN_ID, handles[j], value, &len, BENCH_TIMEOUT_MS));
+
+    //Client config descriptor follows the value
+    for (int i = 0; i < NOTIFY_IDS; i++) {
+        if (host_bt_client_write(BENCH_CONN_ID, handles[i] + 1, enable, 2, BENCH_TIMEOUT_MS) != ESP_GATT_OK) {
+            fprintf(report, "could not subscribe to 0x%04x\n", notify_ids[i]);
+            exit(1);
+        }
+    }
+    BENCH("notify pass (nothing due)", 200000, notifyPoll());
+
+    //Values moving all the time; the notifier task sends whatever its limits let through
+    sent = host_bt_stats()->indications;
+    t0 = now_ns();
+    while (now_ns() - t0 < 500000000ull) {
+        int16_t speed = params.speedActual + 1, torque = params.torqueActual + 3, current = params.motorCurrent + 1;
+        uint16_t volts = params.busVoltage + 1;
+        uint8_t fault = !params.isFaulted;
+
+        paramsWrite(GEVCU_PARAM_speedActual, &speed, sizeof(speed));
+        paramsWrite(GEVCU_PARAM_torqueActual, &torque, sizeof(torque));
+        paramsWrite(GEVCU_PARAM_motorCurrent, &current, sizeof(current));
+        paramsWrite(GEVCU_PARAM_busVoltage, &volts, sizeof(volts));
+        paramsWrite(GEVCU_PARAM_isFaulted, &fault, sizeof(fault));
+        vTaskDelay(1);
+    }
+    fprintf(report, "  -> %.0f notifications/s for %d subscribed values\n",
+            (host_bt_stats()->indications - sent) * 1e9 / (double)(now_ns() - t0), NOTIFY_IDS);
+    if (host_bt_stats()->indications == sent) {
+        fprintf(report, "notifier sent nothing\n");
+        exit(1);
+    }
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+}
+
+//Check a telemetry frame against params: header, and every field it carries
+static int check_frame(const uint8_t *frame, uint16_t len, int fields)
+{
+    static const uint8_t ids[] = {
+#define BENCH_TELEMETRY_ID(name) GEVCU_PARAM_##name,
+        GEVCU_TELEMETRY_FIELDS(BENCH_TELEMETRY_ID)
+    };
+    GEVCU_PARAM_CACHE_t copy;
+    int pos = GEVCU_TELEMETRY_HEADER;
+
+    paramsSnapshot(&copy);
+    if (frame[0] != GEVCU_TELEMETRY_VERSION || frame[1] != fields) return 0;
+    for (int i = 0; i < fields; i++) {
+        if (memcmp(frame + pos, (uint8_t *)&copy + paramOffset[ids[i]], paramSize[ids[i]])) return 0;
+        pos += paramSize[ids[i]];
+    }
+    return pos == len;
+}
+
+//The dashboard refresh: twelve streamed values one read each, or one telemetry frame
+static void bench_telemetry(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x88 };
+    static const uint8_t enable[2] = { 0x01, 0x00 };
+    static const uint16_t dashboard_ids[] = {
+        0x3101, 0x3102, 0x3103, 0x3104, 0x3107, 0x3108, 0x3109, 0x310A, 0x310B, 0x3201, 0x3202, 0x3204,
+    };
+    uint16_t handles[12];
+    uint16_t frame = value_handle(0x3120);
+    uint8_t value[ESP_GATT_MAX_ATTR_LEN];
+    uint16_t len;
+    uint64_t sent, bytes, t0;
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    for (int i = 0; i < 12; i++) handles[i] = value_handle(dashboard_ids[i]);
+
+    BENCH("dashboard (12 reads)", 20000,
+          for (int j = 0; j < 12; j++) host_bt_client_read(BENCH_CONN_ID, handles[j], value, &len, BENCH_TIMEOUT_MS));
+    BENCH("dashboard (frame, mtu 23)", 200000, host_bt_client_read(BENCH_CONN_ID, frame, value, &len, BENCH_TIMEOUT_MS));
+    if (!check_frame(value, len, 7) || len > GEVCU_CONN_DEFAULT_MTU - GEVCU_TELEMETRY_ATT_HEADER) {
+        fprintf(report, "telemetry frame does not fit the default MTU or does not match params\n");
+        exit(1);
+    }
+    host_bt_client_mtu(BENCH_CONN_ID, 185);
+    BENCH("dashboard (frame, mtu 185)", 200000, host_bt_client_read(BENCH_CONN_ID, frame, value, &len, BENCH_TIMEOUT_MS));
+    if (!check_frame(value, len, value[1]) || len != GEVCU_TELEMETRY_MAX) {
+        fprintf(report, "telemetry frame is not complete at MTU 185\n");
+        exit(1);
+    }
+    fprintf(report, "  -> %d B frame instead of 12 reads\n", len);
+
+    //Subscribed to the frame alone while everything moves: one notification per frame interval
+    if (host_bt_client_write(BENCH_CONN_ID, frame + 1, enable, 2, BENCH_TIMEOUT_MS) != ESP_GATT_OK) {
+        fprintf(report, "could not subscribe to the telemetry frame\n");
+        exit(1);
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+    sent = host_bt_stats()->indications;
+    bytes = host_bt_stats()->indication_bytes;
+    t0 = now_ns();
+    while (now_ns() - t0 < 500000000ull) {
+        int16_t speed = params.speedActual + 1, torque = params.torqueActual + 3;
+        uint16_t volts = params.busVoltage + 1;
+
+        paramsWrite(GEVCU_PARAM_speedActual, &speed, sizeof(speed));
+        paramsWrite(GEVCU_PARAM_torqueActual, &torque, sizeof(torque));
+        paramsWrite(GEVCU_PARAM_busVoltage, &volts, sizeof(volts));
+        vTaskDelay(1);
+    }
+    sent = host_bt_stats()->indications - sent;
+    fprintf(report, "  -> %.0f frames/s of %.0f B while values move\n",
+            sent * 1e9 / (double)(now_ns() - t0), sent ? (host_bt_stats()->indication_bytes - bytes) / (double)sent : 0.0);
+    if (sent == 0) {
+        fprintf(report, "telemetry frame was not notified\n");
+        exit(1);
+    }
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+}
+
+//Notifications each central got, and frames that didn't fit its MTU or didn't add up
+#define MULTI_CENTRALS  3
+static const uint16_t multi_mtu[MULTI_CENTRALS] = { 23, 100, 185 };
+static uint16_t multi_frame_handle;
+static uint64_t multi_frames[MULTI_CENTRALS], multi_values[MULTI_CENTRALS], multi_bad;
+
+static void multi_hook(uint16_t conn_id, uint16_t handle, const uint8_t *value, uint16_t len, int need_confirm)
+{
+    int c = conn_id - 1;
+    if (c < 0 || c >= MULTI_CENTRALS) return;
+    if (handle != multi_frame_handle) {
+        __atomic_add_fetch(&multi_values[c], 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint8_t frame[GEVCU_TELEMETRY_MAX];
+    memcpy(frame, value, len);
+    if (len > multi_mtu[c] - GEVCU_TELEMETRY_ATT_HEADER || telemetryCut(frame, len) != len || frame[1] != value[1]) {
+        __atomic_add_fetch(&multi_bad, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&multi_frames[c], 1, __ATOMIC_RELAXED);
+}
+
+//A dashboard and two laptops connected at once, each with its own MTU and subscriptions
+static void bench_multi(void)
+{
+    static const uint8_t enable[2] = { 0x01, 0x00 };
+    uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0xA0 };
+    uint16_t speed_handle = value_handle(0x3104);
+    uint64_t t0, sent;
+
+    multi_frame_handle = value_handle(0x3120);
+    for (int c = 0; c < MULTI_CENTRALS; c++) {
+        central[5] = 0xA0 + c;
+        host_bt_client_connect(c + 1, central);
+        pump_bt();
+        if (!host_bt_stats()->advertising) {
+            fprintf(report, "advertising stopped with %d of %d connections\n", c + 1, GEVCU_CONN_MAX);
+            exit(1);
+        }
+        host_bt_client_mtu(c + 1, multi_mtu[c]);
+        if (host_bt_client_write(c + 1, multi_frame_handle + 1, enable, 2, BENCH_TIMEOUT_MS) != ESP_GATT_OK) {
+            fprintf(report, "central %d could not subscribe to the telemetry frame\n", c + 1);
+            exit(1);
+        }
+    }
+    //only the first one watches the speed on its own, and only it reads that back from the descriptor
+    host_bt_client_write(1, speed_handle + 1, enable, 2, BENCH_TIMEOUT_MS);
+    for (int c = 0; c < MULTI_CENTRALS; c++) {
+        uint8_t cccd[ESP_GATT_MAX_ATTR_LEN];
+        uint16_t len;
+
+        if (host_bt_client_read(c + 1, speed_handle + 1, cccd, &len, BENCH_TIMEOUT_MS) != ESP_GATT_OK || len != 2 ||
+            cccd[0] != (c == 0) || cccd[1]) {
+            fprintf(report, "central %d reads a client config that is not its own\n", c + 1);
+            exit(1);
+        }
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(100));
+    host_bt_set_notify_hook(multi_hook);
+    sent = host_bt_stats()->indications;
+    t0 = now_ns();
+    while (now_ns() - t0 < 500000000ull) {
+        int16_t speed = params.speedActual + 1, torque = params.torqueActual + 3;
+
+        paramsWrite(GEVCU_PARAM_speedActual, &speed, sizeof(speed));
+        paramsWrite(GEVCU_PARAM_torqueActual, &torque, sizeof(torque));
+        vTaskDelay(1);
+    }
+    host_bt_set_notify_hook(NULL);
+    fprintf(report, "  -> %.0f notifications/s to %d centrals:", (host_bt_stats()->indications - sent) * 1e9 / (double)(now_ns() - t0),
+            MULTI_CENTRALS);
+    for (int c = 0; c < MULTI_CENTRALS; c++) {
+        fprintf(report, " mtu %u %lu frames %lu values%s", multi_mtu[c], (unsigned long)multi_frames[c],
+                (unsigned long)multi_values[c], c + 1 < MULTI_CENTRALS ? "," : "\n");
+    }
+    for (int c = 0; c < MULTI_CENTRALS; c++) {
+        if (!multi_frames[c] || (c > 0 && multi_values[c]) || (c == 0 && !multi_values[c]) || multi_bad) {
+            fprintf(report, "notifications did not follow the subscriptions and MTU of each central\n");
+            exit(1);
+        }
+    }
+
+    //The last free slot taken stops advertising, giving one back starts it again
+    for (int c = MULTI_CENTRALS; c < GEVCU_CONN_MAX; c++) {
+        central[5] = 0xA0 + c;
+        host_bt_client_connect(c + 1, central);
+        pump_bt();
+    }
+    if (host_bt_stats()->advertising || connCount() != GEVCU_CONN_MAX) {
+        fprintf(report, "still advertising with every connection slot taken\n");
+        exit(1);
+    }
+    host_bt_client_disconnect(2);
+    pump_bt();
+    if (!host_bt_stats()->advertising) {
+        fprintf(report, "advertising did not resume when a slot was freed\n");
+        exit(1);
+    }
+    for (int c = 0; c < GEVCU_CONN_MAX; c++) host_bt_client_disconnect(c + 1);
+    pump_bt();
+}
+
+//Link profile follows the subscriptions and isRunning
+static void bench_link(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0xB0 };
+    static const uint8_t enable[2] = { 0x01, 0x00 };
+    uint16_t speed_handle = value_handle(0x3104);
+    uint8_t running = 1, stopped = 0;
+    uint64_t updates, t0;
+    uint8_t slot;
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    slot = connSlot(BENCH_CONN_ID);
+    updates = host_bt_stats()->conn_param_updates;
+    paramsWrite(GEVCU_PARAM_isRunning, &running, sizeof(running));
+    host_bt_client_write(BENCH_CONN_ID, speed_handle + 1, enable, 2, BENCH_TIMEOUT_MS);
+    t0 = now_ns();
+    while (linkProfile(slot) != GEVCU_LINK_LIVE && now_ns() - t0 < 1000000000ull) vTaskDelay(1);
+    pump_bt();
+    if (linkProfile(slot) != GEVCU_LINK_LIVE || host_bt_stats()->last_conn_params.max_int != 0x000C ||
+        host_bt_stats()->last_conn_params.latency != 0) {
+        fprintf(report, "subscribed link of a running vehicle did not go live\n");
+        exit(1);
+    }
+    fprintf(report, "  -> live after %.1f ms\n", (now_ns() - t0) / 1e6);
+
+    paramsWrite(GEVCU_PARAM_isRunning, &stopped, sizeof(stopped));
+    t0 = now_ns();
+    while (linkProfile(slot) != GEVCU_LINK_IDLE && now_ns() - t0 < 2u * GEVCU_LINK_IDLE_MS * 1000000ull) vTaskDelay(1);
+    pump_bt();
+    if (linkProfile(slot) != GEVCU_LINK_IDLE || host_bt_stats()->last_conn_params.max_int != 0x00A0) {
+        fprintf(report, "link was not relaxed once the vehicle stopped\n");
+        exit(1);
+    }
+    fprintf(report, "  -> idle %.0f ms after the vehicle stopped, %lu parameter updates\n", (now_ns() - t0) / 1e6,
+            (unsigned long)(host_bt_stats()->conn_param_updates - updates));
+
+    //The central refuses to go live once: the link is asked again after the backoff
+    host_bt_refuse_conn_params(1);
+    paramsWrite(GEVCU_PARAM_isRunning, &running, sizeof(running));
+    t0 = now_ns();
+    while (host_bt_stats()->last_conn_params.max_int != 0x000C && now_ns() - t0 < 4u * GEVCU_LINK_RETRY_MS * 1000000ull) {
+        pump_bt();
+        vTaskDelay(1);
+    }
+    if (host_bt_stats()->last_conn_params.max_int != 0x000C || linkProfile(slot) != GEVCU_LINK_LIVE) {
+        fprintf(report, "link was not asked again after the central refused to go live\n");
+        exit(1);
+    }
+    fprintf(report, "  -> live %.0f ms after a refused update\n", (now_ns() - t0) / 1e6);
+    paramsWrite(GEVCU_PARAM_isRunning, &stopped, sizeof(stopped));
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+}
+
+//State in the advertising data: follows params, but not faster than the refresh limit
+static void bench_adv(void)
+{
+    uint8_t soc = params.SOC + 7, faulted = 1, clear = 0;
+    uint16_t volts = params.busVoltage;
+    uint64_t sets, t0;
+    const uint8_t *block = host_bt_stats()->last_manufacturer;
+
+    if (host_bt_stats()->last_adv_data.manufacturer_len != GEVCU_ADV_MANUFACTURER_LEN ||
+        block[0] != (GEVCU_ADV_COMPANY_ID & 0xFF) || block[2] != GEVCU_ADV_VERSION) {
+        fprintf(report, "advertising data carries no status block\n");
+        exit(1);
+    }
+    if (host_bt_stats()->last_adv_len > 31 || host_bt_stats()->last_scan_rsp_len > 31) {
+        fprintf(report, "advert of %d B or scan response of %d B does not fit 31 bytes\n", host_bt_stats()->last_adv_len,
+                host_bt_stats()->last_scan_rsp_len);
+        exit(1);
+    }
+
+    //Let the limit of the last refresh run out, then a fault shows up on the next poll
+    vTaskDelay(pdMS_TO_TICKS(GEVCU_ADV_REFRESH_MS));
+    sets = host_bt_stats()->adv_data_sets;
+    paramsWrite(GEVCU_PARAM_SOC, &soc, sizeof(soc));
+    paramsWrite(GEVCU_PARAM_isFaulted, &faulted, sizeof(faulted));
+    t0 = now_ns();
+    while (host_bt_stats()->adv_data_sets == sets && now_ns() - t0 < 1000000000ull) vTaskDelay(1);
+    pump_bt();
+    if (block[3] != soc || !(block[4] & GEVCU_ADV_FAULTED)) {
+        fprintf(report, "advertising data did not pick up SOC and the fault\n");
+        exit(1);
+    }
+    fprintf(report, "  -> advert refreshed %.1f ms after the change\n", (now_ns() - t0) / 1e6);
+
+    //Bus voltage wandering for two seconds: refreshes are held to the limit
+    sets = host_bt_stats()->adv_data_sets;
+    t0 = now_ns();
+    while (now_ns() - t0 < 2000000000ull) {
+        volts++;
+        paramsWrite(GEVCU_PARAM_busVoltage, &volts, sizeof(volts));
+        vTaskDelay(1);
+    }
+    pump_bt();
+    sets = host_bt_stats()->adv_data_sets - sets;
+    fprintf(report, "  -> %lu refreshes in 2 s of %ld voltage changes\n", (unsigned long)sets, 2000L / portTICK_PERIOD_MS);
+    if (sets > 2000 / GEVCU_ADV_REFRESH_MS + 1) {
+        fprintf(report, "advertising data refreshed faster than the limit\n");
+        exit(1);
+    }
+
+    //Nothing that the advert carries changes, nothing is rebuilt
+    vTaskDelay(pdMS_TO_TICKS(GEVCU_ADV_REFRESH_MS));
+    pump_bt();
+    sets = host_bt_stats()->adv_data_sets;
+    t0 = now_ns();
+    while (now_ns() - t0 < 200000000ull) {
+        int16_t speed = params.speedActual + 1;
+        paramsWrite(GEVCU_PARAM_speedActual, &speed, sizeof(speed));
+        vTaskDelay(1);
+    }
+    if (host_bt_stats()->adv_data_sets != sets) {
+        fprintf(report, "advertising data refreshed for a field it doesn't carry\n");
+        exit(1);
+    }
+    paramsWrite(GEVCU_PARAM_isFaulted, &clear, sizeof(clear));
+}
+
+//The driver's phone bonds, drops out and is called back with directed advertising
+static void bench_bond(void)
+{
+    static const uint8_t phone[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0xC0 };
+    static const uint8_t rotating[6] = { 0x4A, 0x11, 0x22, 0x33, 0x44, 0xC1 };
+    uint8_t record[7];
+    size_t record_len = sizeof(record);
+    esp_ble_gap_cb_param_t auth;
+    nvs_handle handle;
+    bench_mark_t start;
+    uint64_t t0;
+
+    host_bt_client_connect(BENCH_CONN_ID, phone);
+    pump_bt();
+    memset(&auth, 0, sizeof(auth));
+    memcpy(auth.ble_security.auth_cmpl.bd_addr, phone, sizeof(phone));
+    auth.ble_security.auth_cmpl.success = true;
+    auth.ble_security.auth_cmpl.addr_type = BLE_ADDR_TYPE_PUBLIC;
+    host_bt_gap_dispatch(ESP_GAP_BLE_AUTH_CMPL_EVT, &auth);
+    pump_bt();
+    nvs_open(GEVCU_PERSIST_NAMESPACE, NVS_READONLY, &handle);
+    if (nvs_get_blob(handle, GEVCU_BOND_KEY, record, &record_len) != ESP_OK || memcmp(&record[1], phone, 6)) {
+        fprintf(report, "bonded central was not stored\n");
+        exit(1);
+    }
+    nvs_close(handle);
+
+    start = mark();
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+    result("drop to directed advert", 1, start);
+    if (!host_bt_stats()->advertising || host_bt_stats()->last_adv_params.adv_type != ADV_TYPE_DIRECT_IND_HIGH ||
+        memcmp(host_bt_stats()->last_adv_params.peer_addr, phone, 6)) {
+        fprintf(report, "no directed advertising at the bonded central after it dropped out\n");
+        exit(1);
+    }
+
+    //It doesn't come back: undirected at the fast interval once the directed burst is over
+    t0 = now_ns();
+    while (advPhase() == GEVCU_ADV_DIRECTED && now_ns() - t0 < 2u * GEVCU_ADV_DIRECTED_MS * 1000000ull) vTaskDelay(1);
+    pump_bt();
+    if (host_bt_stats()->last_adv_params.adv_type != ADV_TYPE_IND ||
+        host_bt_stats()->last_adv_params.adv_int_max != GEVCU_ADV_FAST_MAX) {
+        fprintf(report, "advertising did not fall back to fast undirected\n");
+        exit(1);
+    }
+    fprintf(report, "  -> directed for %.0f ms, then fast undirected\n", (now_ns() - t0) / 1e6);
+
+    //A phone on a resolvable private address bonds next: it is not called back, and neither is the one before
+    host_bt_client_connect(BENCH_CONN_ID, rotating);
+    pump_bt();
+    memcpy(auth.ble_security.auth_cmpl.bd_addr, rotating, sizeof(rotating));
+    auth.ble_security.auth_cmpl.addr_type = BLE_ADDR_TYPE_RANDOM;
+    host_bt_gap_dispatch(ESP_GAP_BLE_AUTH_CMPL_EVT, &auth);
+    pump_bt();
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+    record_len = sizeof(record);
+    nvs_open(GEVCU_PERSIST_NAMESPACE, NVS_READONLY, &handle);
+    if (nvs_get_blob(handle, GEVCU_BOND_KEY, record, &record_len) != ESP_ERR_NVS_NOT_FOUND ||
+        host_bt_stats()->last_adv_params.adv_type != ADV_TYPE_IND) {
+        fprintf(report, "advertising was directed at a resolvable private address\n");
+        exit(1);
+    }
+    nvs_close(handle);
+}
+
+//What the Bluedroid callbacks cost now that they only queue, and a burst of requests the worker can't
+//keep up with, played straight into the callback without waiting for the answers. MTU events mixed into
+//the burst must all be queued.
+static void bench_events(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0xE0 };
+    esp_ble_gatts_cb_param_t p, mtu;
+    GEVCU_EVENT_STATS_t before, after;
+    bench_mark_t start;
+    int burst = 4 * GEVCU_EVENT_QUEUE, states = 0;
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    eventsStats(&before);
+    memset(&p, 0, sizeof(p));
+    p.read.conn_id = BENCH_CONN_ID;
+    p.read.handle = value_handle(0x3101);
+    p.read.need_rsp = true;
+    memset(&mtu, 0, sizeof(mtu));
+    mtu.mtu.conn_id = BENCH_CONN_ID;
+    mtu.mtu.mtu = 23;
+    start = mark();
+    for (int i = 0; i < burst; i++) {
+        p.read.trans_id = 0x80000000u + i;
+        host_bt_gatts_dispatch(ESP_GATTS_READ_EVT, &p);
+        if (i % 4 == 3) {
+            host_bt_gatts_dispatch(ESP_GATTS_MTU_EVT, &mtu);
+            states++;
+        }
+    }
+    result("gatts callback (read burst)", burst, start);
+    pump_bt();
+    eventsStats(&after);
+    //state events are never answered busy, so every one of them is among the queued
+    if (after.queued - before.queued + after.busy - before.busy != (uint32_t)(burst + states) ||
+        after.busy - before.busy > (uint32_t)burst || after.dropped != before.dropped) {
+        fprintf(report, "burst of %d reads and %d mtu events: %u queued, %u busy, %u dropped\n", burst, states,
+                after.queued - before.queued, after.busy - before.busy, after.dropped - before.dropped);
+        exit(1);
+    }
+    fprintf(report, "  -> burst of %d reads: %u answered busy, %d mtu events queued\n", burst,
+            after.busy - before.busy, states);
+
+    //The worker held up 200 ms in a response: the callbacks don't wait for it, the state events that
+    //find no room go to the overflow ring and all of them are handled once it is back
+    int flood = GEVCU_EVENT_QUEUE + GEVCU_EVENT_OVERFLOW;
+    host_bt_delay_response(200);
+    p.read.trans_id = 0x90000000u;
+    host_bt_gatts_dispatch(ESP_GATTS_READ_EVT, &p);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    eventsStats(&before);
+    uint64_t flooded = now_ns();
+    for (int i = 0; i < flood; i++) host_bt_gatts_dispatch(ESP_GATTS_MTU_EVT, &mtu);
+    flooded = now_ns() - flooded;
+    pump_bt();
+    eventsStats(&after);
+    if (flooded > 100000000 || after.overflowed == before.overflowed || after.dropped != before.dropped ||
+        after.dispatched - before.dispatched != (uint32_t)flood + 1) {
+        fprintf(report, "%d mtu events behind a stalled worker: %.1f ms in the callbacks, %u overflowed, %u dropped, "
+                "%u handled\n", flood, flooded / 1e6, after.overflowed - before.overflowed,
+                after.dropped - before.dropped, after.dispatched - before.dispatched);
+        exit(1);
+    }
+    fprintf(report, "  -> %d mtu events behind a stalled worker: %.1f ms in the callbacks, %u through the overflow ring\n",
+            flood, flooded / 1e6, after.overflowed - before.overflowed);
+    fprintf(report, "  -> callbacks %.2f us on average, %.2f us worst; queued %.2f us worst, handler %.2f us worst\n",
+            (double)after.callbackTotal / (after.queued + after.busy + after.dropped) / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+            (double)after.callbackMax / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+            (double)after.waitMax / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+            (double)after.handlerMax / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+}
+
+//Client side of the history stream: every chunk has to follow on from the one before, and every record
+//sampled by the drive below has to come back as it was sampled
+#define HISTORY_DRIVE       4000
+static uint16_t history_handle;
+static uint32_t history_base;
+static uint32_t history_expected[HISTORY_DRIVE][GEVCU_HISTORY_COUNT];
+static volatile uint32_t history_got;
+static uint64_t history_chunks, history_bytes, history_checked, history_bad;
+
+static int history_varint(const uint8_t *in, int len, int *pos, uint32_t *v)
+{
+    *v = 0;
+    for (int shift = 0; *pos < len && shift < 35; shift += 7) {
+        uint8_t byte = in[(*pos)++];
+        *v |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return 1;
+    }
+    return 0;
+}
+
+//Decode a chunk. Returns the number of records in it, -1 if it doesn't add up.
+static int history_decode(const uint8_t *chunk, uint16_t len, uint32_t *first)
+{
+    uint32_t fields[GEVCU_HISTORY_COUNT];
+    int pos = GEVCU_HISTORY_HEADER;
+
+    if (len < GEVCU_HISTORY_HEADER || chunk[0] != GEVCU_HISTORY_VERSION) return -1;
+    memcpy(first, chunk + 1, sizeof(*first));
+    for (int r = 0; r < chunk[5]; r++) {
+        for (int f = 0; f < GEVCU_HISTORY_COUNT; f++) {
+            uint32_t v;
+            if (!history_varint(chunk, len, &pos, &v)) return -1;
+            v = (v >> 1) ^ (0 - (v & 1));
+            fields[f] = r ? fields[f] + v : v;
+        }
+        uint32_t n = *first + r;
+        if (n >= history_base && n - history_base < HISTORY_DRIVE) {
+            if (memcmp(fields, history_expected[n - history_base], sizeof(fields))) return -1;
+            history_checked++;
+        }
+    }
+    return pos == len ? chunk[5] : -1;
+}
+
+static void history_hook(uint16_t conn_id, uint16_t handle, const uint8_t *value, uint16_t len, int need_confirm)
+{
+    uint32_t first;
+    int count;
+
+    if (handle != history_handle) return;
+    count = history_decode(value, len, &first);
+    if (count <= 0 || first != history_got) history_bad++;
+    else history_got = first + count;
+    history_chunks++;
+    history_bytes += len;
+}
+
+//Stream the history to the central on BENCH_CONN_ID from record from until it has everything. Returns
+//the ms it took.
+static double history_stream(uint32_t from)
+{
+    static const uint8_t enable[2] = { 0x01, 0x00 }, disable[2] = { 0x00, 0x00 };
+    uint8_t resume[GEVCU_HISTORY_RESUME];
+    uint64_t t0;
+
+    memcpy(resume, &from, sizeof(resume));
+    history_got = from;
+    history_chunks = history_bytes = history_checked = history_bad = 0;
+    host_bt_client_write(BENCH_CONN_ID, history_handle, resume, sizeof(resume), BENCH_TIMEOUT_MS);
+    host_bt_set_notify_hook(history_hook);
+    t0 = now_ns();
+    host_bt_client_write(BENCH_CONN_ID, history_handle + 1, enable, 2, BENCH_TIMEOUT_MS);
+    while (history_got != historyNext() && !history_bad && now_ns() - t0 < 5000000000ull) vTaskDelay(1);
+    double ms = (now_ns() - t0) / 1e6;
+    host_bt_client_write(BENCH_CONN_ID, history_handle + 1, disable, 2, BENCH_TIMEOUT_MS);
+    host_bt_set_notify_hook(NULL);
+    if (history_got != historyNext() || history_bad) {
+        fprintf(report, "history stream from %u stopped at %u of %u, %lu bad chunks\n", from, history_got,
+                historyNext(), (unsigned long)history_bad);
+        exit(1);
+    }
+    return ms;
+}
+
+//A drive sampled into the history ring, then downloaded by a central that connects afterwards
+static void bench_history(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0xF0 };
+    uint8_t value[ESP_GATT_MAX_ATTR_LEN], resume[GEVCU_HISTORY_RESUME];
+    int16_t temperature = 600, current = 0, torque = 0;
+    uint16_t volts = 3600;
+    uint8_t soc = 90;
+    uint32_t seed = 1, first, records;
+    uint16_t len;
+    double ms;
+
+    BENCH("history sample", 200000, historySample());
+
+    for (int i = 0; i < HISTORY_DRIVE; i++) {
+        GEVCU_PARAM_CACHE_t copy;
+        int f = 0;
+
+        seed = seed * 1103515245u + 12345u;
+        current += (int)((seed >> 16) % 81) - 40;
+        torque += (int)((seed >> 8) % 61) - 30;
+        temperature = 600 + i / 8;
+        volts = 3600 - current / 20 - i / 10;
+        soc = 90 - i / 60;
+        paramsWrite(GEVCU_PARAM_motorTemperature, &temperature, sizeof(temperature));
+        paramsWrite(GEVCU_PARAM_busCurrent, &current, sizeof(current));
+        paramsWrite(GEVCU_PARAM_torqueActual, &torque, sizeof(torque));
+        paramsWrite(GEVCU_PARAM_busVoltage, &volts, sizeof(volts));
+        paramsWrite(GEVCU_PARAM_SOC, &soc, sizeof(soc));
+        paramsSnapshot(&copy);
+#define BENCH_HISTORY_TAKE(name) history_expected[i][f++] = copy.name;
+        GEVCU_HISTORY_FIELDS(BENCH_HISTORY_TAKE)
+        uint32_t n = historySample();
+        if (i == 0) history_base = n;
+        else if (n != history_base + i) {
+            fprintf(report, "history record %u sampled out of turn\n", n);
+            exit(1);
+        }
+    }
+    records = historyNext() - historyOldest();
+    fprintf(report, "  -> ring holds %u records of the drive, %.1f B each, %.0f min at one per %d ms\n", records,
+            (double)GEVCU_HISTORY_BLOCK * GEVCU_HISTORY_BLOCKS / records,
+            records * (double)GEVCU_HISTORY_PERIOD_MS / 60000.0, GEVCU_HISTORY_PERIOD_MS);
+
+    history_handle = value_handle(0x331B);
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    host_bt_client_mtu(BENCH_CONN_ID, 185);
+    ms = history_stream(historyOldest());
+    if (history_checked != records) {
+        fprintf(report, "history download checked %lu of %u records\n", (unsigned long)history_checked, records);
+        exit(1);
+    }
+    fprintf(report, "  -> %u records in %lu notifications of %.0f B at mtu 185, %.0f ms\n", records,
+            (unsigned long)history_chunks, (double)history_bytes / history_chunks, ms);
+
+    //Back with the default MTU, going on from the last 100 records: a read shows where it is, the
+    //notifications bring the rest
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    first = historyNext() - 100;
+    memcpy(resume, &first, sizeof(resume));
+    host_bt_client_write(BENCH_CONN_ID, history_handle, resume, sizeof(resume), BENCH_TIMEOUT_MS);
+    if (host_bt_client_read(BENCH_CONN_ID, history_handle, value, &len, BENCH_TIMEOUT_MS) != ESP_GATT_OK ||
+        len > GEVCU_CONN_DEFAULT_MTU - GEVCU_TELEMETRY_ATT_HEADER || history_decode(value, len, &records) < 1 ||
+        records != first) {
+        fprintf(report, "history read at the default MTU does not start at record %u\n", first);
+        exit(1);
+    }
+    ms = history_stream(first);
+    fprintf(report, "  -> last 100 records in %lu notifications of %.0f B at mtu 23, %.0f ms\n",
+            (unsigned long)history_chunks, (double)history_bytes / history_chunks, ms);
+
+    //A record number from before a reboot starts the central over at the oldest record
+    first = historyNext() + 1000;
+    memcpy(resume, &first, sizeof(resume));
+    host_bt_client_write(BENCH_CONN_ID, history_handle, resume, sizeof(resume), BENCH_TIMEOUT_MS);
+    host_bt_client_read(BENCH_CONN_ID, history_handle, value, &len, BENCH_TIMEOUT_MS);
+    if (history_decode(value, len, &records) < 1 || records != historyOldest()) {
+        fprintf(report, "history read from a record after the newest one does not start over\n");
+        exit(1);
+    }
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+}
+
+//Client side of the telemetry stream: the fields of every frame it got, by frame number, so the next delta
+//has its base. The bench acknowledges the newest one as a central would.
+static uint16_t stream_handle;
+static uint32_t stream_state[256][GEVCU_STREAM_COUNT];
+static uint8_t stream_have[256];
+static volatile int stream_last = -1;
+static uint64_t stream_frames, stream_keys, stream_fields, stream_bytes, stream_bad;
+
+//Decode a frame into fields, starting from base for a delta. Returns the number of fields in it, -1 if it
+//doesn't add up.
+static int stream_decode(const uint8_t *frame, uint16_t len, const uint32_t *base, uint32_t *fields)
+{
+    int pos = GEVCU_STREAM_HEADER, count = 0;
+
+    if (len < GEVCU_STREAM_HEADER || frame[0] >> 2 != GEVCU_STREAM_VERSION) return -1;
+    for (int f = 0; f < GEVCU_STREAM_COUNT; f++) {
+        uint32_t v = 0;
+        if (frame[3 + f / 8] & (1 << (f % 8))) {
+            if (!history_varint(frame, len, &pos, &v)) return -1;
+            v = (v >> 1) ^ (0 - (v & 1));
+            count++;
+        }
+        fields[f] = (base ? base[f] : 0) + v;
+    }
+    return pos == len ? count : -1;
+}
+
+static void stream_hook(uint16_t conn_id, uint16_t handle, const uint8_t *value, uint16_t len, int need_confirm)
+{
+    uint8_t kind = value[0] & 3, number = value[1], base = value[2];
+    int count;
+
+    if (handle != stream_handle) return;
+    if (len > GEVCU_CONN_DEFAULT_MTU - GEVCU_TELEMETRY_ATT_HEADER || (kind == GEVCU_STREAM_DELTA && !stream_have[base])) {
+        stream_bad++;
+        return;
+    }
+    count = stream_decode(value, len, kind == GEVCU_STREAM_DELTA ? stream_state[base] : NULL, stream_state[number]);
+    if (count < 0 || kind == GEVCU_STREAM_READ) {
+        stream_bad++;
+        return;
+    }
+    stream_have[number] = 1;
+    stream_last = number;
+    stream_frames++;
+    stream_keys += kind == GEVCU_STREAM_KEY;
+    stream_fields += count;
+    stream_bytes += len;
+}
+
+//Subscribed to the stream at the default MTU while about a third of the fields move by a little every tick
+static void bench_stream(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0xF1 };
+    static const uint8_t enable[2] = { 0x01, 0x00 };
+    static const uint8_t moving[] = {
+        GEVCU_PARAM_torqueActual, GEVCU_PARAM_speedActual, GEVCU_PARAM_motorCurrent, GEVCU_PARAM_busVoltage,
+        GEVCU_PARAM_busCurrent, GEVCU_PARAM_mechPower, GEVCU_PARAM_throttlePercentage, GEVCU_PARAM_timeRunning,
+    };
+    uint8_t value[ESP_GATT_MAX_ATTR_LEN];
+    uint32_t fields[GEVCU_STREAM_COUNT], seed = 7;
+    uint16_t len;
+    uint64_t t0;
+
+    stream_handle = value_handle(0x3121);
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    if (host_bt_client_read(BENCH_CONN_ID, stream_handle, value, &len, BENCH_TIMEOUT_MS) != ESP_GATT_OK ||
+        len > GEVCU_CONN_DEFAULT_MTU - GEVCU_TELEMETRY_ATT_HEADER || (value[0] & 3) != GEVCU_STREAM_READ ||
+        stream_decode(value, len, NULL, fields) < 0) {
+        fprintf(report, "telemetry stream read does not fit the default MTU or does not add up\n");
+        exit(1);
+    }
+
+    host_bt_set_notify_hook(stream_hook);
+    host_bt_client_write(BENCH_CONN_ID, stream_handle + 1, enable, 2, BENCH_TIMEOUT_MS);
+    t0 = now_ns();
+    while (now_ns() - t0 < 500000000ull) {
+        uint8_t ack = stream_last;
+
+        for (int i = 0; i < (int)sizeof(moving); i++) {
+            uint32_t v = 0;
+            seed = seed * 1103515245u + 12345u;
+            paramsRead(moving[i], &v);
+            v += (int)((seed >> 16) % 41) - 20;
+            paramsWrite(moving[i], &v, paramSize[moving[i]]);
+        }
+        if (stream_last >= 0) host_bt_client_write(BENCH_CONN_ID, stream_handle, &ack, 1, BENCH_TIMEOUT_MS);
+        vTaskDelay(1);
+    }
+    //quiet again: the central ends up with what params hold
+    vTaskDelay(pdMS_TO_TICKS(300));
+    host_bt_set_notify_hook(NULL);
+    streamTake(fields);
+    if (stream_bad || stream_last < 0 || memcmp(stream_state[stream_last], fields, sizeof(fields))) {
+        fprintf(report, "telemetry stream: %lu bad frames, central does not end up with params\n",
+                (unsigned long)stream_bad);
+        exit(1);
+    }
+    fprintf(report, "  -> %.1f fields in %.1f B per notification at mtu 23 instead of 7 in a frame, %lu keyframes in %lu\n",
+            (double)stream_fields / stream_frames, (double)stream_bytes / stream_frames, (unsigned long)stream_keys,
+            (unsigned long)stream_frames);
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+}
+
+static void bench_params(void)
+{
+    uint32_t changed[GEVCU_PARAM_BITMAP_WORDS];
+    uint32_t since;
+    uint16_t v = 0;
+    int16_t t = 0;
+    int n;
+
+    BENCH("params write (changed)", 2000000, v++; paramsWrite(GEVCU_PARAM_maxRPM, &v, sizeof(v)));
+    BENCH("params write (same)", 2000000, paramsWrite(GEVCU_PARAM_maxRPM, &v, sizeof(v)));
+
+    //Two fields moving out of 63: the answer costs two steps, not a diff of the struct
+    since = paramsVersion();
+    t++; paramsWrite(GEVCU_PARAM_torqueActual, &t, sizeof(t));
+    v++; paramsWrite(GEVCU_PARAM_maxRPM, &v, sizeof(v));
+    BENCH("changed since (2 fields)", 2000000, paramsChangedSince(since, changed));
+    n = 0;
+    for (int w = 0; w < GEVCU_PARAM_BITMAP_WORDS; w++) n += __builtin_popcount(changed[w]);
+    if (n != 2 || !PARAM_BIT_TEST(changed, GEVCU_PARAM_torqueActual) || !PARAM_BIT_TEST(changed, GEVCU_PARAM_maxRPM)) {
+        fprintf(report, "change tracking reported %d fields instead of 2\n", n);
+        exit(1);
+    }
+}
+
+//Keeps writing busVoltage and timeRunning as a group with timeRunning derived from busVoltage. They
+//sit at opposite ends of params, as far apart as two fields of a group can be.
+static volatile int group_writer_run;
+
+static void group_writer(void *arg)
+{
+    static const uint8_t fields[] = { GEVCU_PARAM_busVoltage, GEVCU_PARAM_timeRunning };
+    uint16_t voltage = 0;
+    uint32_t time;
+    const uint8_t *values[] = { (const uint8_t *)&voltage, (const uint8_t *)&time };
+
+    while (group_writer_run) {
+        voltage++;
+        time = voltage ^ 0x5A5A5A5A;
+        paramsWriteGroup(2, fields, values);
+    }
+    group_writer_run = -1;
+    vTaskDelete(NULL);
+}
+
+static void bench_params_concurrent(void)
+{
+    GEVCU_PARAM_CACHE_t copy;
+    uint32_t timeRunning;
+    long reads = 2000000 * scale;
+    long torn = 0, plain_torn = 0;
+
+    BENCH("params read (1 field)", 2000000, paramsRead(GEVCU_PARAM_timeRunning, &timeRunning));
+    BENCH("params snapshot", 2000000, paramsSnapshot(&copy));
+
+    //Readers racing a writer on another thread: a plain copy of params against a snapshot
+    uint16_t voltage = 0;
+    uint32_t time = 0x5A5A5A5A;
+    paramsWrite(GEVCU_PARAM_busVoltage, &voltage, sizeof(voltage));
+    paramsWrite(GEVCU_PARAM_timeRunning, &time, sizeof(time));
+    group_writer_run = 1;
+    uint32_t before = paramsVersion();
+    xTaskCreate(group_writer, "group_writer", 2048, NULL, 5, NULL);
+    while (paramsVersion() == before) { }
+    for (long i = 0; i < reads; i++) {
+        __asm__ volatile("" ::: "memory");
+        memcpy(&copy, &params, sizeof(copy));
+        if (copy.timeRunning != (copy.busVoltage ^ 0x5A5A5A5Au)) plain_torn++;
+    }
+    bench_mark_t start = mark();
+    for (long i = 0; i < reads; i++) {
+        paramsSnapshot(&copy);
+        if (copy.timeRunning != (copy.busVoltage ^ 0x5A5A5A5Au)) torn++;
+    }
+    result("params snapshot (racing)", reads, start);
+    group_writer_run = 0;
+    while (group_writer_run != -1) vTaskDelay(1);
+
+    fprintf(report, "  -> torn groups: %ld of %ld plain copies, %ld of %ld snapshots\n", plain_torn, reads, torn, reads);
+    if (torn) {
+        fprintf(report, "snapshot returned a half written group\n");
+        exit(1);
+    }
+}
+
+static void bench_trace(void)
+{
+    uint8_t level = params.logLevel;
+
+    BENCH("trace event", 2000000, TRACE(SPI_UPDATE, GEVCU_TRACE_NO_ROW, 1, 0));
+    params.logLevel = GEVCU_LOG_WARN;
+    BENCH("trace event (filtered)", 2000000, TRACE(SPI_UPDATE, GEVCU_TRACE_NO_ROW, 1, 0));
+    params.logLevel = level;
+}
+
+//The motoring telemetry GEVCU sends every cycle
+static const uint8_t telemetry_ids[] = {
+    GEVCU_PARAM_torqueRequested, GEVCU_PARAM_torqueActual, GEVCU_PARAM_speedRequested, GEVCU_PARAM_speedActual,
+    GEVCU_PARAM_motorCurrent, GEVCU_PARAM_mechPower, GEVCU_PARAM_motorTemperature, GEVCU_PARAM_inverterTemperature,
+    GEVCU_PARAM_systemTemperature, GEVCU_PARAM_timeRunning, GEVCU_PARAM_busVoltage, GEVCU_PARAM_busCurrent,
+    GEVCU_PARAM_SOC, GEVCU_PARAM_kwHours, GEVCU_PARAM_throttlePercentage, GEVCU_PARAM_brakePercentage,
+    GEVCU_PARAM_throttleRawLevel1, GEVCU_PARAM_throttleRawLevel2, GEVCU_PARAM_brakeRawLevel,
+    GEVCU_PARAM_powerMode, GEVCU_PARAM_gear,
+};
+#define TELEMETRY_IDS   (int)(sizeof(telemetry_ids) / sizeof(telemetry_ids[0]))
+
+//One single-parameter update frame per telemetry value
+static void build_updates(uint8_t frames[][8], uint32_t n)
+{
+    for (int i = 0; i < TELEMETRY_IDS; i++) {
+        memset(frames[i], 0, 8);
+        frames[i][0] = GEVCU_SPI_START;
+        frames[i][1] = GEVCU_SPI_CMD_UPDATE;
+        frames[i][2] = telemetry_ids[i];
+        memcpy(&frames[i][3], &n, paramSize[telemetry_ids[i]]);
+    }
+}
+
+//All of the telemetry in one batch frame, padded to a multiple of 4. Returns the frame length.
+static int build_batch(uint8_t *frame, uint8_t seq, uint32_t n)
+{
+    int len = GEVCU_SPI_BATCH_HEADER;
+
+    memset(frame, 0, GEVCU_SPI_FRAME_MAX);
+    frame[0] = GEVCU_SPI_START;
+    frame[1] = GEVCU_SPI_CMD_BATCH;
+    frame[2] = GEVCU_SPI_BATCH_VERSION;
+    frame[3] = seq;
+    for (int i = 0; i < TELEMETRY_IDS; i++) {
+        frame[len++] = telemetry_ids[i];
+        frame[len++] = paramSize[telemetry_ids[i]];
+        memcpy(&frame[len], &n, paramSize[telemetry_ids[i]]);
+        len += paramSize[telemetry_ids[i]];
+    }
+    frame[4] = len - GEVCU_SPI_BATCH_HEADER;
+    return (len + 3) & ~3;
+}
+
+static void spi_transfer(const uint8_t *mosi, uint8_t *miso, int len)
+{
+    if (host_spi_transfer(mosi, miso, len, BENCH_TIMEOUT_MS) < 0) {
+        fprintf(report, "spi slave stopped accepting frames\n");
+        exit(1);
+    }
+}
+
+//Clock empty frames until every frame sent so far has been parsed and its reply has come back. The
+//last reply with command cmd ends up in miso. A reply trails its frame by up to GEVCU_SPI_SLOTS
+//transactions.
+static void spi_reply(uint8_t cmd, uint8_t *miso)
+{
+    uint8_t idle[8] = { 0 };
+    uint8_t in[GEVCU_SPI_FRAME_MAX];
+    int found = 0;
+
+    for (int i = 0; i < 2 * GEVCU_SPI_SLOTS; i++) {
+        spi_transfer(idle, in, 8);
+        if (in[0] == GEVCU_SPI_START && in[1] == cmd) {
+            memcpy(miso, in, 8);
+            found = 1;
+        }
+    }
+    if (!found) memset(miso, 0, 8);
+}
+
+static void bench_spi(void)
+{
+    uint8_t update[32] = { 0xA5, 0x40, 10, 40, 23 };
+    uint8_t get[32] = { 0xA5, 0xC0, 5 };
+    uint8_t updates[TELEMETRY_IDS][8];
+    uint8_t batch[GEVCU_SPI_FRAME_MAX];
+    uint8_t reply[GEVCU_SPI_FRAME_MAX];
+    uint8_t miso[GEVCU_SPI_FRAME_MAX];
+    uint32_t n = 0;
+    uint64_t t0;
+    long frames = 20000 * scale;
+    long cycles = 2000 * scale;
+    long bursts = 50 * scale;
+    int batch_len;
+
+    BENCH("spi frame: update", 200000, processSpiFrame(update, 8, reply));
+    BENCH("spi frame: get", 200000, processSpiFrame(get, 8, reply));
+    batch_len = build_batch(batch, 0, 0);
+    BENCH("spi frame: batch (21 params)", 200000, batch[5 + 2]++; processSpiFrame(batch, batch_len, reply));
+
+    //Back-to-back 8 byte frames through the slave driver, the way the Teensy sends them.
+    t0 = now_ns();
+    bench_mark_t start = mark();
+    for (long i = 0; i < frames; i++) spi_transfer(update, miso, 8);
+    result("spi transfer (8 B frame)", frames, start);
+    fprintf(report, "  -> %.0f frames/s through the slave driver\n",
+            frames * 1e9 / (double)(now_ns() - t0));
+
+    //Bursts from an idle slave: the master only waits if it outruns the primed transactions
+    uint64_t burst_ns = 0;
+    for (long i = 0; i < bursts; i++) {
+        vTaskDelay(1);
+        t0 = now_ns();
+        for (int j = 0; j < GEVCU_SPI_QUEUED; j++) spi_transfer(update, miso, 8);
+        burst_ns += now_ns() - t0;
+    }
+    fprintf(report, "  -> burst of %d frames: %.0f ns per frame waiting on the slave\n",
+            GEVCU_SPI_QUEUED, burst_ns / (double)(bursts * GEVCU_SPI_QUEUED));
+
+    //A telemetry cycle as 21 single updates and as one batch
+    t0 = now_ns();
+    start = mark();
+    for (long i = 0; i < cycles; i++) {
+        build_updates(updates, ++n);
+        for (int j = 0; j < TELEMETRY_IDS; j++) spi_transfer(updates[j], miso, 8);
+    }
+    result("telemetry cycle (21 frames)", cycles, start);
+    fprintf(report, "  -> %.0f cycles/s\n", cycles * 1e9 / (double)(now_ns() - t0));
+
+    t0 = now_ns();
+    start = mark();
+    for (long i = 0; i < cycles; i++) {
+        batch_len = build_batch(batch, (uint8_t)i, ++n);
+        spi_transfer(batch, miso, batch_len);
+    }
+    result("telemetry cycle (1 batch)", cycles, start);
+    fprintf(report, "  -> %.0f cycles/s, %d B per transaction\n", cycles * 1e9 / (double)(now_ns() - t0), batch_len);
+
+    //The acknowledgement of the last batch comes back a few transactions later
+    spi_reply(GEVCU_SPI_CMD_BATCH_ACK, miso);
+    if (miso[0] != GEVCU_SPI_START || miso[1] != GEVCU_SPI_CMD_BATCH_ACK || miso[3] != (uint8_t)(cycles - 1) ||
+        miso[4] != GEVCU_SPI_OK || miso[5] != TELEMETRY_IDS || params.speedActual != (int16_t)n) {
+        fprintf(report, "batch was not acknowledged and applied\n");
+        exit(1);
+    }
+}
+
+//Whole cache as a snapshot frame with every field set to a pattern based on n. Returns the frame length.
+static int build_snapshot(uint8_t *frame, uint32_t n)
+{
+    uint8_t *image = frame + GEVCU_SPI_SNAPSHOT_HEADER;
+    uint32_t crc;
+
+    memset(frame, 0, GEVCU_SPI_FRAME_MAX);
+    for (int f = 0; f < GEVCU_PARAM_COUNT; f++) {
+        uint32_t v = n * 7 + f;
+        memcpy(image, &v, paramSize[f]);
+        image += paramSize[f];
+    }
+    crc = crc32_le(0, frame + GEVCU_SPI_SNAPSHOT_HEADER, GEVCU_PARAM_IMAGE_SIZE);
+    frame[0] = GEVCU_SPI_START;
+    frame[1] = GEVCU_SPI_CMD_SNAPSHOT;
+    frame[2] = GEVCU_PARAM_LAYOUT_VERSION;
+    frame[3] = GEVCU_PARAM_IMAGE_SIZE & 0xFF;
+    frame[4] = GEVCU_PARAM_IMAGE_SIZE >> 8;
+    memcpy(&frame[5], &crc, 4);
+    return (GEVCU_SPI_SNAPSHOT_HEADER + GEVCU_PARAM_IMAGE_SIZE + 3) & ~3;
+}
+
+static void bench_snapshot(void)
+{
+    uint8_t frame[GEVCU_SPI_FRAME_MAX];
+    uint8_t update[8];
+    uint8_t reply[GEVCU_SPI_FRAME_MAX];
+    uint8_t miso[GEVCU_SPI_FRAME_MAX];
+    long cycles = 2000 * scale;
+    uint32_t n = 1000;
+    bench_mark_t start;
+    int len;
+
+    len = build_snapshot(frame, n);
+    BENCH("spi frame: snapshot", 200000, processSpiFrame(frame, len, reply));
+
+    //Cold start: every parameter one update at a time, then the same as one snapshot
+    start = mark();
+    for (long i = 0; i < cycles; i++) {
+        n++;
+        for (int f = 0; f < GEVCU_PARAM_COUNT; f++) {
+            uint32_t v = n * 7 + f;
+            memset(update, 0, sizeof(update));
+            update[0] = GEVCU_SPI_START;
+            update[1] = GEVCU_SPI_CMD_UPDATE;
+            update[2] = f;
+            memcpy(&update[3], &v, paramSize[f]);
+            spi_transfer(update, miso, 8);
+        }
+    }
+    result("cold start (63 updates)", cycles, start);
+
+    start = mark();
+    for (long i = 0; i < cycles; i++) {
+        len = build_snapshot(frame, ++n);
+        spi_transfer(frame, miso, len);
+    }
+    result("cold start (1 snapshot)", cycles, start);
+
+    spi_reply(GEVCU_SPI_CMD_SNAPSHOT_ACK, miso);
+    if (miso[1] != GEVCU_SPI_CMD_SNAPSHOT_ACK || miso[3] != GEVCU_SPI_OK ||
+        params.timeRunning != n * 7 + GEVCU_PARAM_timeRunning || params.gear != (uint8_t)(n * 7 + GEVCU_PARAM_gear)) {
+        fprintf(report, "snapshot was not acknowledged and applied\n");
+        exit(1);
+    }
+
+    //A damaged image is refused as a whole
+    len = build_snapshot(frame, n + 1);
+    frame[GEVCU_SPI_SNAPSHOT_HEADER + 3] ^= 0x40;
+    spi_transfer(frame, miso, len);
+    spi_reply(GEVCU_SPI_CMD_SNAPSHOT_ACK, miso);
+    if (miso[1] != GEVCU_SPI_CMD_SNAPSHOT_ACK || miso[3] != GEVCU_SPI_BAD_CRC || params.timeRunning != n * 7 + GEVCU_PARAM_timeRunning) {
+        fprintf(report, "snapshot with a bad CRC was applied\n");
+        exit(1);
+    }
+}
+
+//Play GEVCU answering the doorbell: clock whole transactions until SPI_INT drops. Counts write-back
+//frames and records, the frames with a field of the config profile in them and keeps the last maxTorque seen.
+static long wb_frames, wb_records, wb_transactions, wb_profile_frames;
+static uint16_t wb_max_torque;
+
+static int is_profile_field(uint8_t field)
+{
+#define PROFILE_FIELD_IS(name) if (field == GEVCU_PARAM_##name) return 1;
+    GEVCU_PROFILE_FIELDS(PROFILE_FIELD_IS)
+    return 0;
+}
+
+static void service_doorbell(void)
+{
+    uint8_t idle[GEVCU_SPI_FRAME_MAX] = { 0 };
+    uint8_t miso[GEVCU_SPI_FRAME_MAX];
+    const uint8_t *wb = miso + GEVCU_SPI_WRITEBACK_AT;
+
+    for (int i = 0; i < 4 * GEVCU_SPI_SLOTS && host_gpio_get_out(GEVCU_SPI_INT_PIN); i++) {
+        spi_transfer(idle, miso, GEVCU_SPI_FRAME_MAX);
+        wb_transactions++;
+        if (wb[0] != GEVCU_SPI_START || wb[1] != GEVCU_SPI_CMD_WRITEBACK) continue;
+        wb_frames++;
+        int profile = 0;
+        for (int pos = 0; pos < wb[4]; pos += 2 + wb[GEVCU_SPI_WRITEBACK_HEADER + pos + 1]) {
+            const uint8_t *record = wb + GEVCU_SPI_WRITEBACK_HEADER + pos;
+            wb_records++;
+            if (record[0] == GEVCU_PARAM_maxTorque) memcpy(&wb_max_torque, &record[2], 2);
+            if (is_profile_field(record[0])) profile = 1;
+        }
+        wb_profile_frames += profile;
+    }
+}
+
+static void bench_writeback(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 };
+    uint16_t max_torque = value_handle(0x310E);
+    long drags = 50 * scale;
+    uint16_t torque = 0;
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    service_doorbell();
+    wb_frames = wb_records = wb_transactions = 0;
+
+    //A slider dragged through 200 values while GEVCU answers the doorbell every 20 writes
+    bench_mark_t start = mark();
+    for (long i = 0; i < drags; i++) {
+        for (int j = 0; j < 200; j++) {
+            torque++;
+            host_bt_client_write(BENCH_CONN_ID, max_torque, (uint8_t *)&torque, 2, BENCH_TIMEOUT_MS);
+            if (j % 20 == 19) service_doorbell();
+        }
+    }
+    result("slider drag (200 writes)", drags, start);
+    fprintf(report, "  -> %.1f write-back frames, %.1f records, %.1f transactions per drag\n",
+            wb_frames / (double)drags, wb_records / (double)drags, wb_transactions / (double)drags);
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+
+    if (wb_max_torque != torque || host_gpio_get_out(GEVCU_SPI_INT_PIN)) {
+        fprintf(report, "GEVCU did not get the last maxTorque written (%u, wanted %u)\n", wb_max_torque, torque);
+        exit(1);
+    }
+}
+
+//Play GEVCU answering the doorbell from its own task: every get it is asked for is answered with an
+//update frame carrying gevcu_bitfield1 for bitfield1 and the cached value for anything else.
+static volatile int gevcu_running;
+static volatile uint32_t gevcu_bitfield1;
+static volatile long gevcu_gets;
+
+static void gevcu_task(void *arg)
+{
+    uint8_t idle[GEVCU_SPI_FRAME_MAX] = { 0 };
+    uint8_t miso[GEVCU_SPI_FRAME_MAX];
+    uint8_t update[8];
+    const uint8_t *gets = miso + GEVCU_SPI_GETS_AT;
+
+    while (gevcu_running) {
+        if (!host_gpio_get_out(GEVCU_SPI_INT_PIN)) {
+            vTaskDelay(0);
+            continue;
+        }
+        spi_transfer(idle, miso, GEVCU_SPI_FRAME_MAX);
+        if (gets[0] != GEVCU_SPI_START || gets[1] != GEVCU_SPI_CMD_GET) continue;
+        for (int i = 0; i < gets[2]; i++) {
+            uint8_t field = gets[GEVCU_SPI_GETS_HEADER + i];
+            uint32_t value = field == GEVCU_PARAM_bitfield1 ? gevcu_bitfield1 : 0;
+
+            if (field != GEVCU_PARAM_bitfield1) paramsRead(field, &value);
+            memset(update, 0, sizeof(update));
+            update[0] = GEVCU_SPI_START;
+            update[1] = GEVCU_SPI_CMD_UPDATE;
+            update[2] = field;
+            memcpy(&update[3], &value, paramSize[field]);
+            gevcu_gets++;
+            spi_transfer(update, miso, sizeof(update));
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+static uint32_t read_status(uint16_t handle, bench_mark_t *start, const char *name)
+{
+    uint32_t value = 0;
+    uint16_t len = 0;
+
+    *start = mark();
+    if (host_bt_client_read(BENCH_CONN_ID, handle, (uint8_t *)&value, &len, BENCH_TIMEOUT_MS) != ESP_GATT_OK || len != 4) {
+        fprintf(report, "%s was not answered\n", name);
+        exit(1);
+    }
+    result(name, 1, *start);
+    return value;
+}
+
+static void bench_readthrough(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x77 };
+    uint16_t status = value_handle(0x3307);
+    const GATT_CHARACTERISTIC_t *chr = findCharacteristic(status, NULL);
+    uint8_t value[ESP_GATT_MAX_ATTR_LEN];
+    uint16_t len;
+    uint32_t bits = 0x0000F00D;
+    bench_mark_t start;
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    paramsWrite(GEVCU_PARAM_bitfield1, &bits, sizeof(bits));
+    //few enough that the value is still young at the end, every read goes through the event worker
+    BENCH("gatt read (young, cache)", 20000,
+          host_bt_client_read(BENCH_CONN_ID, status, value, &len, BENCH_TIMEOUT_MS));
+
+    //Older than its max age with nobody answering the get: the deadline answers from the cache. The
+    //deadline is in ticks, so it can come up to one tick early.
+    vTaskDelay(pdMS_TO_TICKS(chr->maxAge + 100));
+    if (read_status(status, &start, "gatt read (stale, deadline)") != bits ||
+        now_ns() - start.ns < (GEVCU_READ_DEADLINE_MS - portTICK_PERIOD_MS) * 1000000ull) {
+        fprintf(report, "stale read did not wait out its deadline\n");
+        exit(1);
+    }
+    service_doorbell();
+
+    //Same with GEVCU answering: the read goes out as soon as the fresh value lands
+    gevcu_bitfield1 = 0x0000BEEF;
+    gevcu_running = 1;
+    xTaskCreate(gevcu_task, "gevcu", 2048, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(chr->maxAge + 100));
+    if (read_status(status, &start, "gatt read (stale, landed)") != gevcu_bitfield1 ||
+        now_ns() - start.ns >= GEVCU_READ_DEADLINE_MS * 1000000ull || gevcu_gets != 1) {
+        fprintf(report, "stale read was not answered with GEVCU's value\n");
+        exit(1);
+    }
+    if (read_status(status, &start, "gatt read (refreshed)") != gevcu_bitfield1 || gevcu_gets != 1) {
+        fprintf(report, "refreshed value was asked of GEVCU again\n");
+        exit(1);
+    }
+    gevcu_running = 0;
+    vTaskDelay(1);
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+}
+
+//A throttle calibration as the tuning app pushes it: every throttle and brake setting, the device enables
+//and the cooling temperatures
+static const uint16_t calibration_ids[] = {
+    0x320A, 0x320B, 0x320C, 0x320D, 0x320E, 0x320F, 0x3210, 0x3211, 0x3212, 0x3213, 0x3214, 0x3215, 0x3216,
+    0x3217, 0x3218, 0x3315, 0x3316, 0x330F, 0x3310,
+};
+#define CALIBRATION_IDS (int)(sizeof(calibration_ids) / sizeof(calibration_ids[0]))
+
+static void bench_prepare(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x99 };
+    uint16_t handles[CALIBRATION_IDS];
+    const GATT_CHARACTERISTIC_t *chrs[CALIBRATION_IDS];
+    uint32_t seed = 0, before;
+    long uploads = 2000 * scale;
+    esp_gatt_status_t status = ESP_GATT_ERROR;
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    for (int i = 0; i < CALIBRATION_IDS; i++) {
+        handles[i] = value_handle(calibration_ids[i]);
+        chrs[i] = findCharacteristic(handles[i], NULL);
+    }
+
+    before = paramsVersion();
+    bench_mark_t start = mark();
+    for (long n = 0; n < uploads; n++) {
+        seed++;
+        for (int i = 0; i < CALIBRATION_IDS; i++) {
+            uint32_t value = seed * 31 + i;
+            host_bt_client_write(BENCH_CONN_ID, handles[i], (uint8_t *)&value, chrs[i]->maxLen, BENCH_TIMEOUT_MS);
+        }
+    }
+    result("calibration (19 writes)", uploads, start);
+    fprintf(report, "  -> %.1f params versions per upload\n", (paramsVersion() - before) / (double)uploads);
+
+    before = paramsVersion();
+    start = mark();
+    for (long n = 0; n < uploads; n++) {
+        seed++;
+        for (int i = 0; i < CALIBRATION_IDS; i++) {
+            uint32_t value = seed * 31 + i;
+            host_bt_client_prep_write(BENCH_CONN_ID, handles[i], 0, (uint8_t *)&value, chrs[i]->maxLen, BENCH_TIMEOUT_MS);
+        }
+        status = host_bt_client_exec_write(BENCH_CONN_ID, ESP_GATT_PREP_WRITE_EXEC, BENCH_TIMEOUT_MS);
+    }
+    result("calibration (prepared)", uploads, start);
+    fprintf(report, "  -> %.1f params versions per upload\n", (paramsVersion() - before) / (double)uploads);
+    for (int i = 0; i < CALIBRATION_IDS; i++) {
+        uint32_t want = seed * 31 + i, got = 0;
+        paramsRead(chrs[i]->param, &got);
+        if (status != ESP_GATT_OK || memcmp(&got, &want, chrs[i]->maxLen)) {
+            fprintf(report, "prepared calibration was not applied (0x%04x)\n", calibration_ids[i]);
+            exit(1);
+        }
+    }
+
+    //A value split over two segments, then a queue with one value left short: nothing of it applies
+    uint16_t min = 0x1234, old;
+    host_bt_client_prep_write(BENCH_CONN_ID, handles[0], 0, (uint8_t *)&min, 1, BENCH_TIMEOUT_MS);
+    host_bt_client_prep_write(BENCH_CONN_ID, handles[0], 1, (uint8_t *)&min + 1, 1, BENCH_TIMEOUT_MS);
+    status = host_bt_client_exec_write(BENCH_CONN_ID, ESP_GATT_PREP_WRITE_EXEC, BENCH_TIMEOUT_MS);
+    if (status != ESP_GATT_OK || params.throttle1Min != 0x1234) {
+        fprintf(report, "value split over two segments was not applied\n");
+        exit(1);
+    }
+    min = 0x4321;
+    host_bt_client_prep_write(BENCH_CONN_ID, handles[0], 0, (uint8_t *)&min, 2, BENCH_TIMEOUT_MS);
+    host_bt_client_prep_write(BENCH_CONN_ID, handles[1], 0, (uint8_t *)&min, 1, BENCH_TIMEOUT_MS);
+    status = host_bt_client_exec_write(BENCH_CONN_ID, ESP_GATT_PREP_WRITE_EXEC, BENCH_TIMEOUT_MS);
+    old = params.throttle1Min;
+    if (status != ESP_GATT_INVALID_ATTR_LEN || old != 0x1234) {
+        fprintf(report, "prepared queue with a short value was applied\n");
+        exit(1);
+    }
+    //A 4 byte value (0x3315) with byte 2 left out is refused, not filled in with a zero
+    uint32_t bits = 0x11223344, bits_before = 0;
+    paramsRead(chrs[15]->param, &bits_before);
+    host_bt_client_prep_write(BENCH_CONN_ID, handles[15], 0, (uint8_t *)&bits, 2, BENCH_TIMEOUT_MS);
+    host_bt_client_prep_write(BENCH_CONN_ID, handles[15], 3, (uint8_t *)&bits + 3, 1, BENCH_TIMEOUT_MS);
+    status = host_bt_client_exec_write(BENCH_CONN_ID, ESP_GATT_PREP_WRITE_EXEC, BENCH_TIMEOUT_MS);
+    paramsRead(chrs[15]->param, &bits);
+    if (status != ESP_GATT_INVALID_ATTR_LEN || bits != bits_before) {
+        fprintf(report, "prepared value with a byte left out was applied\n");
+        exit(1);
+    }
+    if (host_bt_client_prep_write(BENCH_CONN_ID, handles[0], 1, (uint8_t *)&min, 2, BENCH_TIMEOUT_MS) != ESP_GATT_INVALID_ATTR_LEN) {
+        fprintf(report, "segment past maxLen was queued\n");
+        exit(1);
+    }
+    //Longer than any characteristic takes: turned down before the event record, whole or as a segment
+    uint8_t oversize[GEVCU_EVENT_DATA_MAX + 14];
+    memset(oversize, 0x5A, sizeof(oversize));
+    if (host_bt_client_prep_write(BENCH_CONN_ID, handles[0], 0, oversize, sizeof(oversize), BENCH_TIMEOUT_MS) != ESP_GATT_INVALID_ATTR_LEN ||
+        host_bt_client_write(BENCH_CONN_ID, handles[0], oversize, sizeof(oversize), BENCH_TIMEOUT_MS) != ESP_GATT_INVALID_ATTR_LEN ||
+        params.throttle1Min != 0x1234) {
+        fprintf(report, "write longer than the event record was taken\n");
+        exit(1);
+    }
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+    service_doorbell();
+}
+
+//A sane calibration that differs with seed, packed as a profile blob. Returns its length.
+static int make_profile(uint8_t *blob, uint32_t seed)
+{
+    GEVCU_PARAM_CACHE_t p;
+    int len = GEVCU_PROFILE_HEADER;
+
+    memset(&p, 0, sizeof(p));
+    p.throttle1Min = 90 + seed % 50;
+    p.throttle2Min = 80 + seed % 40;
+    p.throttle1Max = 3400 + seed % 30;
+    p.throttle2Max = 1700 + seed % 20;
+    p.throttleRegenMax = 0;
+    p.throttleRegenMin = 270;
+    p.throttleFwd = 280 + seed % 10;
+    p.throttleMap = 750;
+    p.throttleLowestRegen = 10;
+    p.throttleHighestRegen = 70;
+    p.throttleCreep = 0;
+    p.brakeMin = 100;
+    p.brakeMax = 3200 + seed % 60;
+    p.brakeRegenMin = 5;
+    p.brakeRegenMax = 50;
+    p.numThrottlePots = 2;
+    p.throttleType = 1;
+#define PACK_FIELD(name) memcpy(blob + len, &p.name, sizeof(p.name)); len += sizeof(p.name);
+    GEVCU_PROFILE_FIELDS(PACK_FIELD)
+    blob[0] = GEVCU_PROFILE_VERSION;
+    blob[1] = len - GEVCU_PROFILE_HEADER;
+    return len;
+}
+
+static void check_profile(uint16_t handle, uint8_t result, const uint8_t *blob, int len, const char *what)
+{
+    uint8_t value[ESP_GATT_MAX_ATTR_LEN];
+    uint16_t got = 0;
+
+    if (host_bt_client_read(BENCH_CONN_ID, handle, value, &got, BENCH_TIMEOUT_MS) != ESP_GATT_OK ||
+        got != GEVCU_PROFILE_STATUS + len || value[0] != result ||
+        memcmp(value + GEVCU_PROFILE_STATUS, blob, len)) {
+        fprintf(report, "config profile read back wrong after %s (result %u)\n", what, value[0]);
+        exit(1);
+    }
+}
+
+static void bench_profile(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0xAA };
+    uint16_t profile = value_handle(0x3319);
+    uint8_t blob[GEVCU_PROFILE_MAX], bad[GEVCU_PROFILE_MAX];
+    long uploads = 2000 * scale;
+    uint32_t seed = 0, before;
+    esp_gatt_status_t status = ESP_GATT_ERROR;
+    int len = 0;
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+    service_doorbell();
+
+    //The whole calibration in one write, GEVCU picking it up after every upload
+    wb_frames = wb_records = 0;
+    before = paramsVersion();
+    bench_mark_t start = mark();
+    for (long n = 0; n < uploads; n++) {
+        len = make_profile(blob, ++seed);
+        status = host_bt_client_write(BENCH_CONN_ID, profile, blob, len, BENCH_TIMEOUT_MS);
+        service_doorbell();
+    }
+    result("config profile (1 write)", uploads, start);
+    fprintf(report, "  -> %.1f params versions, %.1f write-back frames, %.1f records per upload\n",
+            (paramsVersion() - before) / (double)uploads, wb_frames / (double)uploads, wb_records / (double)uploads);
+    if (status != ESP_GATT_OK) {
+        fprintf(report, "config profile was rejected (status %02x)\n", status);
+        exit(1);
+    }
+    check_profile(profile, GEVCU_PROFILE_APPLIED, blob, len, "an upload");
+
+    //Queued behind every other param still waiting for GEVCU, a calibration that changes every field goes
+    //out in one frame
+    for (uint8_t field = 0; field < GEVCU_PARAM_COUNT; field++) {
+        uint32_t value = 0;
+        if (is_profile_field(field)) {
+            paramsWrite(field, &value, paramSize[field]);
+            continue;
+        }
+        paramsRead(field, &value);
+        writebackQueue(field, &value, paramSize[field]);
+    }
+    len = make_profile(blob, ++seed);
+    status = host_bt_client_write(BENCH_CONN_ID, profile, blob, len, BENCH_TIMEOUT_MS);
+    wb_frames = wb_profile_frames = 0;
+    service_doorbell();
+    service_doorbell();
+    if (status != ESP_GATT_OK || wb_profile_frames != 1 || host_gpio_get_out(GEVCU_SPI_INT_PIN)) {
+        fprintf(report, "config profile queued behind other writes went out in %ld of %ld frames\n",
+                wb_profile_frames, wb_frames);
+        exit(1);
+    }
+    fprintf(report, "  -> behind the other params: calibration in 1 of %ld frames\n", wb_frames);
+
+    //At the default MTU the blob is a long write: two prepared segments of 18 bytes and an execute
+    start = mark();
+    for (long n = 0; n < uploads; n++) {
+        len = make_profile(blob, ++seed);
+        host_bt_client_prep_write(BENCH_CONN_ID, profile, 0, blob, 18, BENCH_TIMEOUT_MS);
+        host_bt_client_prep_write(BENCH_CONN_ID, profile, 18, blob + 18, len - 18, BENCH_TIMEOUT_MS);
+        status = host_bt_client_exec_write(BENCH_CONN_ID, ESP_GATT_PREP_WRITE_EXEC, BENCH_TIMEOUT_MS);
+    }
+    result("config profile (long write)", uploads, start);
+    if (status != ESP_GATT_OK) {
+        fprintf(report, "long config profile write was rejected (status %02x)\n", status);
+        exit(1);
+    }
+    check_profile(profile, GEVCU_PROFILE_APPLIED, blob, len, "a long write");
+    service_doorbell();
+
+    //A long write whose segments leave a gap is turned down, the blob never reaches profileWrite
+    before = paramsVersion();
+    make_profile(bad, ++seed);
+    host_bt_client_prep_write(BENCH_CONN_ID, profile, 0, bad, 10, BENCH_TIMEOUT_MS);
+    host_bt_client_prep_write(BENCH_CONN_ID, profile, 20, bad + 20, len - 20, BENCH_TIMEOUT_MS);
+    if (host_bt_client_exec_write(BENCH_CONN_ID, ESP_GATT_PREP_WRITE_EXEC, BENCH_TIMEOUT_MS) != ESP_GATT_INVALID_ATTR_LEN ||
+        paramsVersion() != before || host_gpio_get_out(GEVCU_SPI_INT_PIN)) {
+        fprintf(report, "long config profile write with a gap was applied\n");
+        exit(1);
+    }
+    check_profile(profile, GEVCU_PROFILE_APPLIED, blob, len, "a long write with a gap");
+
+    //Bad blobs are turned away whole and leave params alone
+    before = paramsVersion();
+    make_profile(bad, ++seed);
+    bad[GEVCU_PROFILE_HEADER] = 0xFF;        //throttle1Min far above throttle1Max
+    bad[GEVCU_PROFILE_HEADER + 1] = 0x7F;
+    if (host_bt_client_write(BENCH_CONN_ID, profile, bad, len, BENCH_TIMEOUT_MS) != ESP_GATT_OUT_OF_RANGE) {
+        fprintf(report, "config profile with throttle1Min above throttle1Max was applied\n");
+        exit(1);
+    }
+    check_profile(profile, GEVCU_PROFILE_BAD_VALUE, blob, len, "a bad value");
+    make_profile(bad, seed);
+    bad[0] = GEVCU_PROFILE_VERSION + 1;
+    if (host_bt_client_write(BENCH_CONN_ID, profile, bad, len, BENCH_TIMEOUT_MS) != ESP_GATT_OUT_OF_RANGE) {
+        fprintf(report, "config profile of an unknown version was applied\n");
+        exit(1);
+    }
+    check_profile(profile, GEVCU_PROFILE_BAD_VERSION, blob, len, "a bad version");
+    if (host_bt_client_write(BENCH_CONN_ID, profile, blob, len - 1, BENCH_TIMEOUT_MS) != ESP_GATT_INVALID_ATTR_LEN) {
+        fprintf(report, "short config profile was applied\n");
+        exit(1);
+    }
+    check_profile(profile, GEVCU_PROFILE_BAD_LENGTH, blob, len, "a short blob");
+    if (paramsVersion() != before || host_gpio_get_out(GEVCU_SPI_INT_PIN)) {
+        fprintf(report, "rejected config profile touched params or GEVCU\n");
+        exit(1);
+    }
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+}
+
+static void bench_persist(void)
+{
+    static const uint8_t central[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0xBB };
+    uint16_t max_torque = value_handle(0x310E), gear = value_handle(0x3106);
+    uint64_t commits, last_write;
+    uint16_t torque = 500;
+    uint8_t drive = 3;
+
+    host_bt_client_connect(BENCH_CONN_ID, central);
+    pump_bt();
+
+    //A slider drag and a gear change: one commit once things are quiet, without the gear
+    commits = host_nvs_commits();
+    bench_mark_t start = mark();
+    for (int i = 0; i < 200; i++) {
+        torque++;
+        host_bt_client_write(BENCH_CONN_ID, max_torque, (uint8_t *)&torque, 2, BENCH_TIMEOUT_MS);
+    }
+    host_bt_client_write(BENCH_CONN_ID, gear, &drive, 1, BENCH_TIMEOUT_MS);
+    result("config burst (200 writes)", 200, start);
+    last_write = now_ns();
+    while (host_nvs_commits() == commits && now_ns() - last_write < 2 * GEVCU_PERSIST_QUIET_MS * 1000000ull) {
+        vTaskDelay(1);
+    }
+    fprintf(report, "  -> committed %.0f ms after the last write\n", (now_ns() - last_write) / 1e6);
+    vTaskDelay(pdMS_TO_TICKS(GEVCU_PERSIST_QUIET_MS + 2 * GEVCU_PERSIST_PERIOD_MS));
+    if (host_nvs_commits() != commits + 1 || nvs_config_value(GEVCU_PARAM_maxTorque) != torque ||
+        nvs_config_value(GEVCU_PARAM_gear) != -1) {
+        fprintf(report, "config burst was not committed once (%llu commits, maxTorque %ld, gear %ld)\n",
+                (unsigned long long)(host_nvs_commits() - commits), nvs_config_value(GEVCU_PARAM_maxTorque),
+                nvs_config_value(GEVCU_PARAM_gear));
+        exit(1);
+    }
+    host_bt_client_disconnect(BENCH_CONN_ID);
+    pump_bt();
+    service_doorbell();
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) scale = atol(argv[1]) > 0 ? atol(argv[1]) : 1;
+    report = host_console_install(getenv("GEVCU_HOST_ECHO") != NULL);
+
+    fprintf(report, "%-28s %9s %12s %10s %10s %12s\n", "path", "iters", "ns/op", "allocs/op",
+            "uart B/op", "uart us/op");
+    bench_boot();
+    bench_gatt();
+    bench_notify();
+    bench_telemetry();
+    bench_multi();
+    bench_link();
+    bench_adv();
+    bench_bond();
+    bench_events();
+    bench_history();
+    bench_stream();
+    bench_params();
+    bench_params_concurrent();
+    bench_trace();
+    bench_spi();
+    bench_snapshot();
+    bench_writeback();
+    bench_readthrough();
+    bench_prepare();
+    bench_profile();
+    bench_persist();
+    fflush(report);
+    return 0;
+}
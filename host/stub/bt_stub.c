@@ -0,0 +1,673 @@
+// Bluedroid model. Keeps an attribute database the way the real stack does (values
+// of auto-response attributes are copied in at table creation and only change via
+// esp_ble_gatts_set_attr_value or client writes), raises the stack's own events on
+// a queue drained by host_bt_run(), and lets the harness act as a GATT client.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "esp_gatts_api.h"
+#include "esp_gap_ble_api.h"
+#include "host_stub.h"
+
+#define HOST_BT_FIRST_HANDLE    40
+#define HOST_BT_MAX_HANDLES     2048
+#define HOST_BT_MAX_PENDING     512
+#define HOST_BT_GATTS_IF        3
+
+typedef struct {
+    uint16_t uuid;
+    uint16_t perm;
+    uint8_t auto_rsp;
+    uint16_t max_len;
+    uint16_t len;
+    uint8_t *value;
+} host_attr_t;
+
+typedef struct host_evt {
+    struct host_evt *next;
+    int is_gap;
+    int event;
+    esp_ble_gatts_cb_param_t gatts;
+    esp_ble_gap_cb_param_t gap;
+    uint16_t *handles;
+} host_evt_t;
+
+static pthread_mutex_t bt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bt_changed = PTHREAD_COND_INITIALIZER;
+static esp_gatts_cb_t gatts_cb;
+static esp_gap_ble_cb_t gap_cb;
+static int registered;
+static host_attr_t attrs[HOST_BT_MAX_HANDLES];
+static uint16_t next_handle = HOST_BT_FIRST_HANDLE;
+static host_evt_t *pending_head, *pending_tail;
+static int pending_count;
+static uint32_t next_trans_id = 1;
+static host_bt_stats_t stats;
+static host_bt_notify_hook_t notify_hook;
+
+static struct {
+    int valid;
+    uint32_t trans_id;
+    esp_gatt_status_t status;
+    esp_gatt_rsp_t rsp;
+} mailbox;
+
+static struct timespec *deadline_ms(struct timespec *ts, int ms)
+{
+    if (ms < 0) return NULL;
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+static host_evt_t *post(int is_gap, int event)
+{
+    host_evt_t *evt;
+
+    pthread_mutex_lock(&bt_lock);
+    if (pending_count >= HOST_BT_MAX_PENDING) {
+        pthread_mutex_unlock(&bt_lock);
+        return NULL;
+    }
+    pthread_mutex_unlock(&bt_lock);
+    evt = calloc(1, sizeof(*evt));
+    if (!evt) return NULL;
+    evt->is_gap = is_gap;
+    evt->event = event;
+    return evt;
+}
+
+static void commit(host_evt_t *evt)
+{
+    if (!evt) return;
+    pthread_mutex_lock(&bt_lock);
+    if (pending_tail) pending_tail->next = evt;
+    else pending_head = evt;
+    pending_tail = evt;
+    pending_count++;
+    pthread_cond_broadcast(&bt_changed);
+    pthread_mutex_unlock(&bt_lock);
+}
+
+int host_bt_run(void)
+{
+    int n = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&bt_lock);
+        host_evt_t *evt = pending_head;
+        if (evt) {
+            pending_head = evt->next;
+            if (!pending_head) pending_tail = NULL;
+            pending_count--;
+        }
+        pthread_mutex_unlock(&bt_lock);
+        if (!evt) return n;
+        if (evt->is_gap) host_bt_gap_dispatch(evt->event, &evt->gap);
+        else host_bt_gatts_dispatch(evt->event, &evt->gatts);
+        free(evt->handles);
+        free(evt);
+        n++;
+    }
+}
+
+int host_bt_wait_registered(int timeout_ms)
+{
+    struct timespec ts, *deadline = deadline_ms(&ts, timeout_ms);
+    int ok;
+
+    pthread_mutex_lock(&bt_lock);
+    while (!(ok = registered && gatts_cb && gap_cb)) {
+        int rc = deadline ? pthread_cond_timedwait(&bt_changed, &bt_lock, deadline)
+                          : pthread_cond_wait(&bt_changed, &bt_lock);
+        if (rc == ETIMEDOUT) break;
+    }
+    pthread_mutex_unlock(&bt_lock);
+    return ok;
+}
+
+void host_bt_gatts_dispatch(esp_gatts_cb_event_t event, esp_ble_gatts_cb_param_t *param)
+{
+    if (gatts_cb) gatts_cb(event, HOST_BT_GATTS_IF, param);
+}
+
+void host_bt_gap_dispatch(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+    if (gap_cb) gap_cb(event, param);
+}
+
+static host_attr_t *attr_at(uint16_t handle)
+{
+    if (handle < HOST_BT_FIRST_HANDLE || handle >= next_handle) return NULL;
+    return &attrs[handle];
+}
+
+uint16_t host_bt_first_handle(void)
+{
+    return HOST_BT_FIRST_HANDLE;
+}
+
+uint16_t host_bt_handle_count(void)
+{
+    return next_handle - HOST_BT_FIRST_HANDLE;
+}
+
+uint16_t host_bt_attr_uuid(uint16_t handle)
+{
+    host_attr_t *a = attr_at(handle);
+    return a ? a->uuid : 0;
+}
+
+int host_bt_attr_auto_rsp(uint16_t handle)
+{
+    host_attr_t *a = attr_at(handle);
+    return a ? a->auto_rsp : -1;
+}
+
+//First value handle carrying uuid16 (declarations and descriptors are skipped).
+uint16_t host_bt_find_handle(uint16_t uuid16)
+{
+    for (uint16_t h = HOST_BT_FIRST_HANDLE; h < next_handle; h++) {
+        if (attrs[h].uuid == uuid16 && h > HOST_BT_FIRST_HANDLE &&
+            attrs[h - 1].uuid == ESP_GATT_UUID_CHAR_DECLARE) return h;
+    }
+    return 0;
+}
+
+void host_bt_set_notify_hook(host_bt_notify_hook_t hook)
+{
+    notify_hook = hook;
+}
+
+const host_bt_stats_t *host_bt_stats(void)
+{
+    return &stats;
+}
+
+esp_err_t esp_ble_gatts_register_callback(esp_gatts_cb_t callback)
+{
+    pthread_mutex_lock(&bt_lock);
+    gatts_cb = callback;
+    pthread_cond_broadcast(&bt_changed);
+    pthread_mutex_unlock(&bt_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback)
+{
+    pthread_mutex_lock(&bt_lock);
+    gap_cb = callback;
+    pthread_cond_broadcast(&bt_changed);
+    pthread_mutex_unlock(&bt_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_app_register(uint16_t app_id)
+{
+    host_evt_t *evt = post(0, ESP_GATTS_REG_EVT);
+    if (!evt) return ESP_FAIL;
+    evt->gatts.reg.status = ESP_GATT_OK;
+    evt->gatts.reg.app_id = app_id;
+    commit(evt);
+    pthread_mutex_lock(&bt_lock);
+    registered = 1;
+    pthread_cond_broadcast(&bt_changed);
+    pthread_mutex_unlock(&bt_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_create_attr_tab(const esp_gatts_attr_db_t *gatts_attr_db,
+                                        esp_gatt_if_t gatts_if, uint8_t max_nb_attr,
+                                        uint8_t srvc_inst_id)
+{
+    host_evt_t *evt;
+    esp_gatt_status_t status = ESP_GATT_OK;
+
+    if (!gatts_attr_db || max_nb_attr == 0) return ESP_ERR_INVALID_ARG;
+    evt = post(0, ESP_GATTS_CREAT_ATTR_TAB_EVT);
+    if (!evt) return ESP_FAIL;
+
+    evt->gatts.add_attr_tab.svc_uuid.len = ESP_UUID_LEN_16;
+    if (gatts_attr_db[0].att_desc.value)
+        memcpy(&evt->gatts.add_attr_tab.svc_uuid.uuid.uuid16, gatts_attr_db[0].att_desc.value, 2);
+
+    pthread_mutex_lock(&bt_lock);
+    if (max_nb_attr > ESP_GATT_ATTR_HANDLE_MAX ||
+        next_handle + max_nb_attr > HOST_BT_MAX_HANDLES) status = ESP_GATT_NO_RESOURCES;
+    for (int i = 0; i < max_nb_attr && status == ESP_GATT_OK; i++) {
+        const esp_attr_desc_t *d = &gatts_attr_db[i].att_desc;
+        if (d->length > d->max_length && gatts_attr_db[i].attr_control.auto_rsp) status = ESP_GATT_INVALID_ATTR_LEN;
+    }
+    if (status == ESP_GATT_OK) {
+        evt->handles = calloc(max_nb_attr, sizeof(uint16_t));
+        for (int i = 0; i < max_nb_attr; i++) {
+            const esp_gatts_attr_db_t *db = &gatts_attr_db[i];
+            host_attr_t *a = &attrs[next_handle];
+            a->uuid = db->att_desc.uuid_p[0] | (db->att_desc.uuid_p[1] << 8);
+            a->perm = db->att_desc.perm;
+            a->auto_rsp = db->attr_control.auto_rsp;
+            a->max_len = db->att_desc.max_length;
+            a->len = db->att_desc.length;
+            if (a->auto_rsp == ESP_GATT_AUTO_RSP) {
+                a->value = calloc(1, a->max_len ? a->max_len : 1);
+                if (db->att_desc.value) memcpy(a->value, db->att_desc.value, a->len);
+            }
+            evt->handles[i] = next_handle++;
+        }
+        evt->gatts.add_attr_tab.num_handle = max_nb_attr;
+    }
+    pthread_mutex_unlock(&bt_lock);
+    evt->gatts.add_attr_tab.status = status;
+    evt->gatts.add_attr_tab.handles = evt->handles;
+    commit(evt);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_start_service(uint16_t service_handle)
+{
+    host_evt_t *evt = post(0, ESP_GATTS_START_EVT);
+    if (!evt) return ESP_FAIL;
+    evt->gatts.start.status = attr_at(service_handle) ? ESP_GATT_OK : ESP_GATT_INVALID_HANDLE;
+    evt->gatts.start.service_handle = service_handle;
+    if (evt->gatts.start.status == ESP_GATT_OK) __atomic_add_fetch(&stats.services_started, 1, __ATOMIC_RELAXED);
+    commit(evt);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t attr_handle,
+                                      uint16_t value_len, uint8_t *value, bool need_confirm)
+{
+    if (!attr_at(attr_handle)) return ESP_ERR_INVALID_ARG;
+    __atomic_add_fetch(&stats.indications, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.indication_bytes, value_len, __ATOMIC_RELAXED);
+    if (notify_hook) notify_hook(conn_id, attr_handle, value, value_len, need_confirm);
+    if (need_confirm) {
+        host_evt_t *evt = post(0, ESP_GATTS_CONF_EVT);
+        if (evt) {
+            evt->gatts.conf.status = ESP_GATT_OK;
+            evt->gatts.conf.conn_id = conn_id;
+            commit(evt);
+        }
+    }
+    return ESP_OK;
+}
+
+static int delay_response_ms;
+
+void host_bt_delay_response(int ms)
+{
+    pthread_mutex_lock(&bt_lock);
+    delay_response_ms = ms;
+    pthread_mutex_unlock(&bt_lock);
+}
+
+esp_err_t esp_ble_gatts_send_response(esp_gatt_if_t gatts_if, uint16_t conn_id, uint32_t trans_id,
+                                      esp_gatt_status_t status, esp_gatt_rsp_t *rsp)
+{
+    int delay = 0;
+
+    pthread_mutex_lock(&bt_lock);
+    if (status != ESP_GATT_BUSY) {
+        delay = delay_response_ms;
+        delay_response_ms = 0;
+    }
+    pthread_mutex_unlock(&bt_lock);
+    if (delay) usleep(delay * 1000);
+
+    pthread_mutex_lock(&bt_lock);
+    mailbox.valid = 1;
+    mailbox.trans_id = trans_id;
+    mailbox.status = status;
+    if (rsp) mailbox.rsp = *rsp;
+    else memset(&mailbox.rsp, 0, sizeof(mailbox.rsp));
+    stats.responses++;
+    pthread_cond_broadcast(&bt_changed);
+    pthread_mutex_unlock(&bt_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_set_attr_value(uint16_t attr_handle, uint16_t length, const uint8_t *value)
+{
+    host_evt_t *evt;
+    host_attr_t *a;
+    esp_gatt_status_t status = ESP_GATT_OK;
+
+    pthread_mutex_lock(&bt_lock);
+    a = attr_at(attr_handle);
+    if (!a || !a->value) status = ESP_GATT_INVALID_HANDLE;
+    else if (length > a->max_len) status = ESP_GATT_INVALID_ATTR_LEN;
+    else {
+        memcpy(a->value, value, length);
+        a->len = length;
+        stats.attr_value_sets++;
+    }
+    pthread_mutex_unlock(&bt_lock);
+    evt = post(0, ESP_GATTS_SET_ATTR_VAL_EVT);
+    if (evt) {
+        evt->gatts.set_attr_val.attr_handle = attr_handle;
+        evt->gatts.set_attr_val.status = status;
+        commit(evt);
+    }
+    return status == ESP_GATT_OK ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ble_gatts_get_attr_value(uint16_t attr_handle, uint16_t *length, const uint8_t **value)
+{
+    host_attr_t *a = attr_at(attr_handle);
+    if (!a || !a->value) return ESP_FAIL;
+    *length = a->len;
+    *value = a->value;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_close(esp_gatt_if_t gatts_if, uint16_t conn_id)
+{
+    host_bt_client_disconnect(conn_id);
+    return ESP_OK;
+}
+
+static size_t device_name_len;
+
+//Bytes of the AD structures Bluedroid builds from adv_data, each one 2 bytes of length and type plus its data
+static int adv_data_len(const esp_ble_adv_data_t *adv_data)
+{
+    int len = 0;
+    if (adv_data->flag) len += 3;
+    if (adv_data->include_name) len += 2 + device_name_len;
+    if (adv_data->include_txpower) len += 3;
+    if (adv_data->min_interval > 0 && adv_data->max_interval > 0) len += 6;
+    if (adv_data->appearance) len += 4;
+    if (adv_data->manufacturer_len && adv_data->p_manufacturer_data) len += 2 + adv_data->manufacturer_len;
+    if (adv_data->service_data_len && adv_data->p_service_data) len += 2 + adv_data->service_data_len;
+    if (adv_data->service_uuid_len && adv_data->p_service_uuid) len += 2 + adv_data->service_uuid_len;
+    return len;
+}
+
+esp_err_t esp_ble_gap_config_adv_data(esp_ble_adv_data_t *adv_data)
+{
+    host_evt_t *evt = post(1, ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT);
+    if (!evt) return ESP_FAIL;
+    pthread_mutex_lock(&bt_lock);
+    stats.adv_data_sets++;
+    if (adv_data->set_scan_rsp) stats.last_scan_rsp_len = adv_data_len(adv_data);
+    else {
+        stats.last_adv_len = adv_data_len(adv_data);
+        stats.last_adv_data = *adv_data;
+        if (adv_data->p_manufacturer_data && adv_data->manufacturer_len <= sizeof(stats.last_manufacturer))
+            memcpy(stats.last_manufacturer, adv_data->p_manufacturer_data, adv_data->manufacturer_len);
+    }
+    pthread_mutex_unlock(&bt_lock);
+    if (adv_data->set_scan_rsp) evt->event = ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT;
+    evt->gap.adv_data_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    commit(evt);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *adv_params)
+{
+    host_evt_t *evt = post(1, ESP_GAP_BLE_ADV_START_COMPLETE_EVT);
+    if (!evt) return ESP_FAIL;
+    pthread_mutex_lock(&bt_lock);
+    stats.adv_starts++;
+    stats.advertising = 1;
+    stats.last_adv_params = *adv_params;
+    pthread_mutex_unlock(&bt_lock);
+    evt->gap.adv_start_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    commit(evt);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_stop_advertising(void)
+{
+    host_evt_t *evt = post(1, ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT);
+    if (!evt) return ESP_FAIL;
+    pthread_mutex_lock(&bt_lock);
+    stats.adv_stops++;
+    stats.advertising = 0;
+    pthread_mutex_unlock(&bt_lock);
+    evt->gap.adv_stop_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    commit(evt);
+    return ESP_OK;
+}
+
+static int refuse_conn_params;
+
+void host_bt_refuse_conn_params(int n)
+{
+    pthread_mutex_lock(&bt_lock);
+    refuse_conn_params = n;
+    pthread_mutex_unlock(&bt_lock);
+}
+
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params)
+{
+    host_evt_t *evt = post(1, ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT);
+    int refused;
+    if (!evt) return ESP_FAIL;
+    pthread_mutex_lock(&bt_lock);
+    stats.conn_param_updates++;
+    refused = refuse_conn_params > 0;
+    if (refused) refuse_conn_params--;
+    else stats.last_conn_params = *params;
+    pthread_mutex_unlock(&bt_lock);
+    evt->gap.update_conn_params.status = refused ? ESP_BT_STATUS_FAIL : ESP_BT_STATUS_SUCCESS;
+    memcpy(evt->gap.update_conn_params.bda, params->bda, sizeof(esp_bd_addr_t));
+    evt->gap.update_conn_params.min_int = params->min_int;
+    evt->gap.update_conn_params.max_int = params->max_int;
+    evt->gap.update_conn_params.latency = params->latency;
+    evt->gap.update_conn_params.conn_int = params->max_int;
+    evt->gap.update_conn_params.timeout = params->timeout;
+    commit(evt);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_device_name(const char *name)
+{
+    if (!name) return ESP_ERR_INVALID_ARG;
+    device_name_len = strlen(name);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_security_param(esp_ble_sm_param_t param_type, void *value, uint8_t len)
+{
+    return value ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_ble_gap_security_rsp(esp_bd_addr_t bd_addr, bool accept)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_set_encryption(esp_bd_addr_t bd_addr, esp_ble_sec_act_t sec_act)
+{
+    return ESP_OK;
+}
+
+void host_bt_client_connect(uint16_t conn_id, const uint8_t bda[6])
+{
+    esp_ble_gatts_cb_param_t p;
+
+    memset(&p, 0, sizeof(p));
+    pthread_mutex_lock(&bt_lock);
+    stats.advertising = 0; //the controller stops advertising when it accepts a connection
+    pthread_mutex_unlock(&bt_lock);
+    p.connect.conn_id = conn_id;
+    memcpy(p.connect.remote_bda, bda, sizeof(esp_bd_addr_t));
+    p.connect.is_connected = true;
+    host_bt_gatts_dispatch(ESP_GATTS_CONNECT_EVT, &p);
+}
+
+void host_bt_client_disconnect(uint16_t conn_id)
+{
+    esp_ble_gatts_cb_param_t p;
+
+    memset(&p, 0, sizeof(p));
+    p.disconnect.conn_id = conn_id;
+    p.disconnect.is_connected = false;
+    host_bt_gatts_dispatch(ESP_GATTS_DISCONNECT_EVT, &p);
+}
+
+void host_bt_client_mtu(uint16_t conn_id, uint16_t mtu)
+{
+    esp_ble_gatts_cb_param_t p;
+
+    memset(&p, 0, sizeof(p));
+    p.mtu.conn_id = conn_id;
+    p.mtu.mtu = mtu;
+    host_bt_gatts_dispatch(ESP_GATTS_MTU_EVT, &p);
+}
+
+static uint32_t new_trans_id(void)
+{
+    return __atomic_fetch_add(&next_trans_id, 1, __ATOMIC_RELAXED);
+}
+
+//Wait for the firmware to answer trans_id via esp_ble_gatts_send_response.
+static esp_gatt_status_t await_response(uint32_t trans_id, int timeout_ms, esp_gatt_rsp_t *rsp)
+{
+    struct timespec ts, *deadline = deadline_ms(&ts, timeout_ms);
+    esp_gatt_status_t status = ESP_GATT_ERROR;
+
+    pthread_mutex_lock(&bt_lock);
+    while (!(mailbox.valid && mailbox.trans_id == trans_id)) {
+        int rc = deadline ? pthread_cond_timedwait(&bt_changed, &bt_lock, deadline)
+                          : pthread_cond_wait(&bt_changed, &bt_lock);
+        if (rc == ETIMEDOUT) break;
+    }
+    if (mailbox.valid && mailbox.trans_id == trans_id) {
+        status = mailbox.status;
+        if (rsp) *rsp = mailbox.rsp;
+        mailbox.valid = 0;
+    }
+    pthread_mutex_unlock(&bt_lock);
+    return status;
+}
+
+esp_gatt_status_t host_bt_client_read(uint16_t conn_id, uint16_t handle, uint8_t *value,
+                                      uint16_t *len, int timeout_ms)
+{
+    static __thread esp_gatt_rsp_t rsp;
+    esp_ble_gatts_cb_param_t p;
+    esp_gatt_status_t status;
+    host_attr_t *a;
+    int auto_rsp;
+
+    pthread_mutex_lock(&bt_lock);
+    a = attr_at(handle);
+    if (!a) {
+        pthread_mutex_unlock(&bt_lock);
+        return ESP_GATT_INVALID_HANDLE;
+    }
+    if (!(a->perm & ESP_GATT_PERM_READ)) {
+        pthread_mutex_unlock(&bt_lock);
+        return ESP_GATT_READ_NOT_PERMIT;
+    }
+    auto_rsp = a->auto_rsp == ESP_GATT_AUTO_RSP;
+    if (auto_rsp) {
+        if (value) memcpy(value, a->value, a->len);
+        if (len) *len = a->len;
+    }
+    pthread_mutex_unlock(&bt_lock);
+
+    memset(&p, 0, sizeof(p));
+    p.read.conn_id = conn_id;
+    p.read.trans_id = new_trans_id();
+    p.read.handle = handle;
+    p.read.need_rsp = !auto_rsp;
+    host_bt_gatts_dispatch(ESP_GATTS_READ_EVT, &p);
+    if (auto_rsp) return ESP_GATT_OK;
+
+    status = await_response(p.read.trans_id, timeout_ms, &rsp);
+    if (status == ESP_GATT_OK) {
+        if (value) memcpy(value, rsp.attr_value.value, rsp.attr_value.len);
+        if (len) *len = rsp.attr_value.len;
+    }
+    return status;
+}
+
+esp_gatt_status_t host_bt_client_write(uint16_t conn_id, uint16_t handle, const uint8_t *value,
+                                       uint16_t len, int timeout_ms)
+{
+    esp_ble_gatts_cb_param_t p;
+    host_attr_t *a;
+    int auto_rsp;
+    uint8_t copy[ESP_GATT_MAX_ATTR_LEN];
+
+    if (len > sizeof(copy)) return ESP_GATT_INVALID_ATTR_LEN;
+    pthread_mutex_lock(&bt_lock);
+    a = attr_at(handle);
+    if (!a) {
+        pthread_mutex_unlock(&bt_lock);
+        return ESP_GATT_INVALID_HANDLE;
+    }
+    if (!(a->perm & ESP_GATT_PERM_WRITE)) {
+        pthread_mutex_unlock(&bt_lock);
+        return ESP_GATT_WRITE_NOT_PERMIT;
+    }
+    auto_rsp = a->auto_rsp == ESP_GATT_AUTO_RSP;
+    if (auto_rsp) {
+        if (len > a->max_len) {
+            pthread_mutex_unlock(&bt_lock);
+            return ESP_GATT_INVALID_ATTR_LEN;
+        }
+        memcpy(a->value, value, len);
+        a->len = len;
+    }
+    pthread_mutex_unlock(&bt_lock);
+
+    memcpy(copy, value, len);
+    memset(&p, 0, sizeof(p));
+    p.write.conn_id = conn_id;
+    p.write.trans_id = new_trans_id();
+    p.write.handle = handle;
+    p.write.need_rsp = !auto_rsp;
+    p.write.len = len;
+    p.write.value = copy;
+    host_bt_gatts_dispatch(ESP_GATTS_WRITE_EVT, &p);
+    if (auto_rsp) return ESP_GATT_OK;
+    return await_response(p.write.trans_id, timeout_ms, NULL);
+}
+
+esp_gatt_status_t host_bt_client_prep_write(uint16_t conn_id, uint16_t handle, uint16_t offset,
+                                            const uint8_t *value, uint16_t len, int timeout_ms)
+{
+    esp_ble_gatts_cb_param_t p;
+    uint8_t copy[ESP_GATT_MAX_ATTR_LEN];
+
+    if (len > sizeof(copy)) return ESP_GATT_INVALID_ATTR_LEN;
+    if (!attr_at(handle)) return ESP_GATT_INVALID_HANDLE;
+    memcpy(copy, value, len);
+    memset(&p, 0, sizeof(p));
+    p.write.conn_id = conn_id;
+    p.write.trans_id = new_trans_id();
+    p.write.handle = handle;
+    p.write.offset = offset;
+    p.write.need_rsp = true;
+    p.write.is_prep = true;
+    p.write.len = len;
+    p.write.value = copy;
+    host_bt_gatts_dispatch(ESP_GATTS_WRITE_EVT, &p);
+    return await_response(p.write.trans_id, timeout_ms, NULL);
+}
+
+esp_gatt_status_t host_bt_client_exec_write(uint16_t conn_id, uint8_t flag, int timeout_ms)
+{
+    esp_ble_gatts_cb_param_t p;
+
+    memset(&p, 0, sizeof(p));
+    p.exec_write.conn_id = conn_id;
+    p.exec_write.trans_id = new_trans_id();
+    p.exec_write.exec_write_flag = flag;
+    host_bt_gatts_dispatch(ESP_GATTS_EXEC_WRITE_EVT, &p);
+    return await_response(p.exec_write.trans_id, timeout_ms, NULL);
+}
@@ -0,0 +1,311 @@
+// FreeRTOS on pthreads. Just enough of the kernel for the GEVCU firmware to run its
+// tasks, queues and critical sections unmodified on a development host.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    char name[16];
+    BaseType_t core;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *storage;
+};
+
+static __thread struct host_task *current_task;
+
+static struct timespec epoch;
+static pthread_once_t epoch_once = PTHREAD_ONCE_INIT;
+
+static void epoch_init(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &epoch);
+}
+
+static struct timespec host_epoch(void)
+{
+    pthread_once(&epoch_once, epoch_init);
+    return epoch;
+}
+
+uint64_t host_time_us(void)
+{
+    struct timespec epoch = host_epoch(), now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - epoch.tv_sec) * 1000000ull +
+           (now.tv_nsec - epoch.tv_nsec) / 1000;
+}
+
+static void deadline_after(struct timespec *ts, TickType_t ticks)
+{
+    uint64_t ms = (uint64_t)ticks * portTICK_PERIOD_MS;
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+//Wait on cond until pred holds or the tick budget runs out. Called with lock held.
+#define WAIT_UNTIL(pred, cond, lock, ticks, timed_out) do {                         \
+        struct timespec _ts;                                                        \
+        if ((ticks) != portMAX_DELAY) deadline_after(&_ts, (ticks));                \
+        (timed_out) = 0;                                                            \
+        while (!(pred)) {                                                           \
+            if ((ticks) == 0) { (timed_out) = 1; break; }                           \
+            if ((ticks) == portMAX_DELAY) pthread_cond_wait((cond), (lock));        \
+            else if (pthread_cond_timedwait((cond), (lock), &_ts) == ETIMEDOUT) {   \
+                (timed_out) = !(pred);                                              \
+                break;                                                              \
+            }                                                                       \
+        }                                                                           \
+    } while (0)
+
+static void *task_trampoline(void *arg)
+{
+    struct host_task *task = arg;
+    current_task = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *const pcName,
+                                   const uint32_t usStackDepth, void *const pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *const pvCreatedTask,
+                                   const BaseType_t xCoreID)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (!task) return pdFAIL;
+    task->fn = pvTaskCode;
+    task->arg = pvParameters;
+    task->core = xCoreID;
+    strncpy(task->name, pcName ? pcName : "", sizeof(task->name) - 1);
+    if (pthread_create(&task->thread, NULL, task_trampoline, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (pvCreatedTask) *pvCreatedTask = task;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    if (xTaskToDelete == NULL || xTaskToDelete == current_task) pthread_exit(NULL);
+    pthread_cancel(xTaskToDelete->thread);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    if (xTicksToDelay == 0) {
+        sched_yield();
+        return;
+    }
+    uint64_t ms = (uint64_t)xTicksToDelay * portTICK_PERIOD_MS;
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) { }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_time_us() / 1000 / portTICK_PERIOD_MS);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current_task;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return (current_task && current_task->core != tskNO_AFFINITY) ? current_task->core : 0;
+}
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mux->mux, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_lock(&mux->mux);
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_unlock(&mux->mux);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    struct host_queue *q = calloc(1, sizeof(*q));
+    if (!q) return NULL;
+    q->storage = calloc(uxQueueLength, uxItemSize ? uxItemSize : 1);
+    if (!q->storage) {
+        free(q);
+        return NULL;
+    }
+    q->length = uxQueueLength;
+    q->item_size = uxItemSize;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    if (!q) return;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->storage);
+    free(q);
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t q, const void *item, TickType_t ticks, BaseType_t front)
+{
+    int timed_out;
+    pthread_mutex_lock(&q->lock);
+    WAIT_UNTIL(q->count < q->length, &q->not_full, &q->lock, ticks, timed_out);
+    if (timed_out) {
+        pthread_mutex_unlock(&q->lock);
+        return errQUEUE_FULL;
+    }
+    UBaseType_t slot;
+    if (front) {
+        q->head = (q->head + q->length - 1) % q->length;
+        slot = q->head;
+    } else {
+        slot = (q->head + q->count) % q->length;
+    }
+    if (q->item_size) memcpy(q->storage + slot * q->item_size, item, q->item_size);
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void *item)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->length) {
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return xQueueGenericSend(q, item, 0, pdFALSE);
+}
+
+static BaseType_t queue_take(QueueHandle_t q, void *buf, TickType_t ticks, int remove)
+{
+    int timed_out;
+    pthread_mutex_lock(&q->lock);
+    WAIT_UNTIL(q->count > 0, &q->not_empty, &q->lock, ticks, timed_out);
+    if (timed_out) {
+        pthread_mutex_unlock(&q->lock);
+        return errQUEUE_EMPTY;
+    }
+    if (q->item_size && buf) memcpy(buf, q->storage + q->head * q->item_size, q->item_size);
+    if (remove) {
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *buf, TickType_t ticks)
+{
+    return queue_take(q, buf, ticks, 1);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *buf, TickType_t ticks)
+{
+    return queue_take(q, buf, ticks, 0);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t n = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t n = q->length - q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->head = 0;
+    q->count = 0;
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    QueueHandle_t q = xQueueCreate(uxMaxCount, 0);
+    if (q) q->count = uxInitialCount;
+    return q;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    return xQueueReceive(s, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    return xQueueGenericSend(s, NULL, 0, pdFALSE);
+}
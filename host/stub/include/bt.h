@@ -0,0 +1,29 @@
+// Host stand-in for the ESP-IDF bt.h (BT controller).
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct {
+    uint16_t controller_task_stack_size;
+    uint8_t controller_task_prio;
+    uint8_t hci_uart_no;
+    uint32_t hci_uart_baudrate;
+} esp_bt_controller_config_t;
+
+#define BT_CONTROLLER_INIT_CONFIG_DEFAULT() {   \
+    .controller_task_stack_size = 4096,         \
+    .controller_task_prio = 22,                 \
+    .hci_uart_no = 1,                           \
+    .hci_uart_baudrate = 921600,                \
+}
+
+typedef enum {
+    ESP_BT_MODE_IDLE       = 0x00,
+    ESP_BT_MODE_BLE        = 0x01,
+    ESP_BT_MODE_CLASSIC_BT = 0x02,
+    ESP_BT_MODE_BTDM       = 0x03,
+} esp_bt_mode_t;
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg);
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode);
@@ -0,0 +1,2 @@
+// Host stand-in for the Bluedroid bta_api.h (nothing from it is used directly).
+#pragma once
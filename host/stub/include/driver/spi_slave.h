@@ -0,0 +1,57 @@
+// Host stand-in for the ESP-IDF driver/spi_slave.h. Transactions queued by the
+// firmware are completed by the harness acting as SPI master (see host_stub.h).
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+
+typedef enum {
+    SPI_HOST = 0,
+    HSPI_HOST = 1,
+    VSPI_HOST = 2,
+} spi_host_device_t;
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+} spi_bus_config_t;
+
+typedef struct spi_slave_transaction_t spi_slave_transaction_t;
+typedef void(*slave_transaction_cb_t)(spi_slave_transaction_t *trans);
+
+#define SPI_SLAVE_TXBIT_LSBFIRST  (1<<0)
+#define SPI_SLAVE_RXBIT_LSBFIRST  (1<<1)
+#define SPI_SLAVE_BIT_LSBFIRST    (SPI_SLAVE_TXBIT_LSBFIRST|SPI_SLAVE_RXBIT_LSBFIRST)
+
+typedef struct {
+    int spics_io_num;
+    uint32_t flags;
+    int queue_size;
+    uint8_t mode;
+    slave_transaction_cb_t post_setup_cb;
+    slave_transaction_cb_t post_trans_cb;
+} spi_slave_interface_config_t;
+
+struct spi_slave_transaction_t {
+    size_t length;          ///< Total data length, in bits
+    const void *tx_buffer;
+    void *rx_buffer;
+    void *user;
+};
+
+esp_err_t spi_slave_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config,
+                               const spi_slave_interface_config_t *slave_config, int dma_chan);
+esp_err_t spi_slave_free(spi_host_device_t host);
+esp_err_t spi_slave_queue_trans(spi_host_device_t host, const spi_slave_transaction_t *trans_desc,
+                                TickType_t ticks_to_wait);
+esp_err_t spi_slave_get_trans_result(spi_host_device_t host, spi_slave_transaction_t **trans_desc,
+                                     TickType_t ticks_to_wait);
+esp_err_t spi_slave_transmit(spi_host_device_t host, spi_slave_transaction_t *trans_desc,
+                             TickType_t ticks_to_wait);
@@ -0,0 +1,4 @@
+// Host stand-in for the ESP-IDF esp_event.h (unused by the GATT server).
+#pragma once
+
+#include "esp_err.h"
@@ -0,0 +1,4 @@
+// Host stand-in for the ESP-IDF esp_event_loop.h (unused by the GATT server).
+#pragma once
+
+#include "esp_event.h"
@@ -0,0 +1,191 @@
+// Host stand-in for the ESP-IDF esp_gap_ble_api.h.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+
+#define ESP_BLE_ADV_FLAG_LIMIT_DISC         (0x01 << 0)
+#define ESP_BLE_ADV_FLAG_GEN_DISC           (0x01 << 1)
+#define ESP_BLE_ADV_FLAG_BREDR_NOT_SPT      (0x01 << 2)
+#define ESP_BLE_ADV_FLAG_DMT_CONTROLLER_SPT (0x01 << 3)
+#define ESP_BLE_ADV_FLAG_DMT_HOST_SPT       (0x01 << 4)
+#define ESP_BLE_ADV_FLAG_NON_LIMIT_DISC     (0x00)
+
+#define ESP_BLE_ADV_DATA_LEN_MAX            31
+#define ESP_BLE_SCAN_RSP_DATA_LEN_MAX       31
+
+typedef enum {
+    ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT = 0,
+    ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_RESULT_EVT,
+    ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_RSP_DATA_RAW_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_ADV_START_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_START_COMPLETE_EVT,
+    ESP_GAP_BLE_AUTH_CMPL_EVT,
+    ESP_GAP_BLE_KEY_EVT,
+    ESP_GAP_BLE_SEC_REQ_EVT,
+    ESP_GAP_BLE_PASSKEY_NOTIF_EVT,
+    ESP_GAP_BLE_PASSKEY_REQ_EVT,
+    ESP_GAP_BLE_OOB_REQ_EVT,
+    ESP_GAP_BLE_LOCAL_IR_EVT,
+    ESP_GAP_BLE_LOCAL_ER_EVT,
+    ESP_GAP_BLE_NC_REQ_EVT,
+    ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT,
+    ESP_GAP_BLE_SET_STATIC_RAND_ADDR_EVT,
+    ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT,
+    ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT,
+    ESP_GAP_BLE_EVT_MAX,
+} esp_gap_ble_cb_event_t;
+
+typedef enum {
+    ADV_TYPE_IND                = 0x00,
+    ADV_TYPE_DIRECT_IND_HIGH    = 0x01,
+    ADV_TYPE_SCAN_IND           = 0x02,
+    ADV_TYPE_NONCONN_IND        = 0x03,
+    ADV_TYPE_DIRECT_IND_LOW     = 0x04,
+} esp_ble_adv_type_t;
+
+typedef enum {
+    ADV_CHNL_37     = 0x01,
+    ADV_CHNL_38     = 0x02,
+    ADV_CHNL_39     = 0x04,
+    ADV_CHNL_ALL    = 0x07,
+} esp_ble_adv_channel_t;
+
+typedef enum {
+    ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY  = 0x00,
+    ADV_FILTER_ALLOW_SCAN_WLST_CON_ANY,
+    ADV_FILTER_ALLOW_SCAN_ANY_CON_WLST,
+    ADV_FILTER_ALLOW_SCAN_WLST_CON_WLST,
+} esp_ble_adv_filter_t;
+
+typedef struct {
+    uint16_t                adv_int_min;
+    uint16_t                adv_int_max;
+    esp_ble_adv_type_t      adv_type;
+    esp_ble_addr_type_t     own_addr_type;
+    esp_bd_addr_t           peer_addr;
+    esp_ble_addr_type_t     peer_addr_type;
+    esp_ble_adv_channel_t   channel_map;
+    esp_ble_adv_filter_t    adv_filter_policy;
+} esp_ble_adv_params_t;
+
+typedef struct {
+    bool     set_scan_rsp;
+    bool     include_name;
+    bool     include_txpower;
+    int      min_interval;
+    int      max_interval;
+    int      appearance;
+    uint16_t manufacturer_len;
+    uint8_t  *p_manufacturer_data;
+    uint16_t service_data_len;
+    uint8_t  *p_service_data;
+    uint16_t service_uuid_len;
+    uint8_t  *p_service_uuid;
+    uint8_t  flag;
+} esp_ble_adv_data_t;
+
+typedef struct {
+    esp_bd_addr_t bda;
+    uint16_t min_int;
+    uint16_t max_int;
+    uint16_t latency;
+    uint16_t timeout;
+} esp_ble_conn_update_params_t;
+
+typedef uint8_t esp_ble_auth_req_t;
+#define ESP_LE_AUTH_NO_BOND         0x00
+#define ESP_LE_AUTH_BOND            0x01
+#define ESP_LE_AUTH_REQ_MITM        (1 << 2)
+#define ESP_LE_AUTH_REQ_SC_ONLY     (1 << 3)
+#define ESP_LE_AUTH_REQ_SC_BOND     (ESP_LE_AUTH_BOND | ESP_LE_AUTH_REQ_SC_ONLY)
+
+typedef uint8_t esp_ble_io_cap_t;
+#define ESP_IO_CAP_OUT      0
+#define ESP_IO_CAP_IO       1
+#define ESP_IO_CAP_IN       2
+#define ESP_IO_CAP_NONE     3
+#define ESP_IO_CAP_KBDISP   4
+
+#define ESP_BLE_ENC_KEY_MASK    (1 << 0)
+#define ESP_BLE_ID_KEY_MASK     (1 << 1)
+#define ESP_BLE_CSR_KEY_MASK    (1 << 2)
+#define ESP_BLE_LINK_KEY_MASK   (1 << 3)
+
+typedef enum {
+    ESP_BLE_SM_PASSKEY = 0,
+    ESP_BLE_SM_AUTHEN_REQ_MODE,
+    ESP_BLE_SM_IOCAP_MODE,
+    ESP_BLE_SM_SET_INIT_KEY,
+    ESP_BLE_SM_SET_RSP_KEY,
+    ESP_BLE_SM_MAX_KEY_SIZE,
+} esp_ble_sm_param_t;
+
+typedef enum {
+    ESP_BLE_SEC_NONE = 0,
+    ESP_BLE_SEC_ENCRYPT,
+    ESP_BLE_SEC_ENCRYPT_NO_MITM,
+    ESP_BLE_SEC_ENCRYPT_MITM,
+} esp_ble_sec_act_t;
+
+typedef struct {
+    esp_bd_addr_t bd_addr;
+    bool key_present;
+    uint8_t key_type;
+    bool success;
+    uint8_t fail_reason;
+    esp_ble_addr_type_t addr_type;
+    uint8_t dev_type;
+} esp_ble_auth_cmpl_t;
+
+typedef struct {
+    esp_bd_addr_t bd_addr;
+} esp_ble_sec_req_t;
+
+typedef union {
+    esp_ble_sec_req_t ble_req;
+    esp_ble_auth_cmpl_t auth_cmpl;
+} esp_ble_sec_t;
+
+typedef union {
+    struct ble_adv_data_cmpl_evt_param {
+        esp_bt_status_t status;
+    } adv_data_cmpl;
+    struct ble_scan_rsp_data_cmpl_evt_param {
+        esp_bt_status_t status;
+    } scan_rsp_data_cmpl;
+    struct ble_adv_start_cmpl_evt_param {
+        esp_bt_status_t status;
+    } adv_start_cmpl;
+    struct ble_adv_stop_cmpl_evt_param {
+        esp_bt_status_t status;
+    } adv_stop_cmpl;
+    esp_ble_sec_t ble_security;
+    struct ble_update_conn_params_evt_param {
+        esp_bt_status_t status;
+        esp_bd_addr_t bda;
+        uint16_t min_int;
+        uint16_t max_int;
+        uint16_t latency;
+        uint16_t conn_int;
+        uint16_t timeout;
+    } update_conn_params;
+} esp_ble_gap_cb_param_t;
+
+typedef void (* esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback);
+esp_err_t esp_ble_gap_config_adv_data(esp_ble_adv_data_t *adv_data);
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *adv_params);
+esp_err_t esp_ble_gap_stop_advertising(void);
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params);
+esp_err_t esp_ble_gap_set_device_name(const char *name);
+esp_err_t esp_ble_gap_set_security_param(esp_ble_sm_param_t param_type, void *value, uint8_t len);
+esp_err_t esp_ble_gap_security_rsp(esp_bd_addr_t bd_addr, bool accept);
+esp_err_t esp_ble_set_encryption(esp_bd_addr_t bd_addr, esp_ble_sec_act_t sec_act);
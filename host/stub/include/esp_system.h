@@ -0,0 +1,11 @@
+// Host stand-in for the ESP-IDF esp_system.h used by the GEVCU GATT server.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+void esp_restart(void);
+uint32_t esp_get_free_heap_size(void);
@@ -0,0 +1,44 @@
+// Host stand-in for the ESP-IDF FreeRTOS.h. Tasks are pthreads and ticks follow
+// CONFIG_FREERTOS_HZ from the project sdkconfig, so timing behaves like the target.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "sdkconfig.h"
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE             ((BaseType_t)0)
+#define pdTRUE              ((BaseType_t)1)
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+#define errQUEUE_EMPTY      ((BaseType_t)0)
+#define errQUEUE_FULL       ((BaseType_t)0)
+
+#define configTICK_RATE_HZ  CONFIG_FREERTOS_HZ
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS  ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS    portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((TickType_t)(xTimeInMs) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000))
+
+#define portNUM_PROCESSORS  2
+#define tskNO_AFFINITY      0x7FFFFFFF
+
+typedef struct {
+    pthread_mutex_t mux;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP }
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux);
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux)         vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)          vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)     vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)      vPortExitCritical(mux)
+#define portYIELD_FROM_ISR()            do { } while (0)
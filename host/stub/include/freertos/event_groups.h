@@ -0,0 +1,4 @@
+// Host stand-in for the ESP-IDF freertos/event_groups.h (unused by the GATT server).
+#pragma once
+
+#include "freertos/FreeRTOS.h"
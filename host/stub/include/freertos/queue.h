@@ -0,0 +1,23 @@
+// Host stand-in for the ESP-IDF freertos/queue.h.
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+void vQueueDelete(QueueHandle_t xQueue);
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void *pvItemToQueue,
+                             TickType_t xTicksToWait, BaseType_t xFront);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait);
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait);
+BaseType_t xQueueOverwrite(QueueHandle_t xQueue, const void *pvItemToQueue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue);
+BaseType_t xQueueReset(QueueHandle_t xQueue);
+
+#define xQueueSend(q, item, wait)           xQueueGenericSend((q), (item), (wait), pdFALSE)
+#define xQueueSendToBack(q, item, wait)     xQueueGenericSend((q), (item), (wait), pdFALSE)
+#define xQueueSendToFront(q, item, wait)    xQueueGenericSend((q), (item), (wait), pdTRUE)
+#define xQueueSendFromISR(q, item, woken)   xQueueGenericSend((q), (item), 0, pdFALSE)
+#define xQueueReceiveFromISR(q, buf, woken) xQueueReceive((q), (buf), 0)
@@ -0,0 +1,16 @@
+// Host stand-in for the ESP-IDF freertos/semphr.h. Semaphores are length-1 queues,
+// the same way FreeRTOS builds them.
+#pragma once
+
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore);
+
+#define vSemaphoreDelete(s)             vQueueDelete(s)
+#define xSemaphoreGiveFromISR(s, woken) xSemaphoreGive(s)
@@ -0,0 +1,29 @@
+// Host stand-in for the ESP-IDF freertos/task.h.
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+typedef struct host_task *TaskHandle_t;
+
+#define tskIDLE_PRIORITY    ((UBaseType_t)0U)
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *const pcName,
+                                   const uint32_t usStackDepth, void *const pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *const pvCreatedTask,
+                                   const BaseType_t xCoreID);
+
+static inline BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char *const pcName,
+                                     const uint32_t usStackDepth, void *const pvParameters,
+                                     UBaseType_t uxPriority, TaskHandle_t *const pvCreatedTask)
+{
+    return xTaskCreatePinnedToCore(pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority,
+                                   pvCreatedTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete);
+void vTaskDelay(const TickType_t xTicksToDelay);
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xPortGetCoreID(void);
@@ -0,0 +1,87 @@
+// Control surface of the host stand-in for ESP-IDF/Bluedroid. The firmware never
+// includes this; the benchmark uses it to play the part of the BLE central, the
+// Bluedroid BTC task and the SPI master (GEVCU) around an unmodified app_main().
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "esp_gatts_api.h"
+#include "esp_gap_ble_api.h"
+
+//Console model. Everything the firmware prints or logs goes through here so we can
+//count the bytes that would have gone out of the 115200 baud UART.
+FILE *host_console_install(int echo);
+uint64_t host_console_bytes(void);
+void host_console_write(const char *buf, size_t len);
+
+//Bluedroid model. Events the stack raises on its own (REG, CREAT_ATTR_TAB, START,
+//ADV_DATA_SET_COMPLETE, ...) are queued and delivered by host_bt_run() on the
+//calling thread, which plays the BTC task. Client operations below are delivered
+//synchronously, again on the calling thread.
+int host_bt_run(void);
+int host_bt_wait_registered(int timeout_ms);
+void host_bt_gatts_dispatch(esp_gatts_cb_event_t event, esp_ble_gatts_cb_param_t *param);
+void host_bt_gap_dispatch(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
+uint16_t host_bt_handle_count(void);
+uint16_t host_bt_first_handle(void);
+uint16_t host_bt_attr_uuid(uint16_t handle);
+int host_bt_attr_auto_rsp(uint16_t handle);
+uint16_t host_bt_find_handle(uint16_t uuid16);
+
+void host_bt_client_connect(uint16_t conn_id, const uint8_t bda[6]);
+void host_bt_client_disconnect(uint16_t conn_id);
+void host_bt_client_mtu(uint16_t conn_id, uint16_t mtu);
+esp_gatt_status_t host_bt_client_read(uint16_t conn_id, uint16_t handle, uint8_t *value,
+                                      uint16_t *len, int timeout_ms);
+esp_gatt_status_t host_bt_client_write(uint16_t conn_id, uint16_t handle, const uint8_t *value,
+                                       uint16_t len, int timeout_ms);
+esp_gatt_status_t host_bt_client_prep_write(uint16_t conn_id, uint16_t handle, uint16_t offset,
+                                            const uint8_t *value, uint16_t len, int timeout_ms);
+esp_gatt_status_t host_bt_client_exec_write(uint16_t conn_id, uint8_t flag, int timeout_ms);
+
+typedef void (*host_bt_notify_hook_t)(uint16_t conn_id, uint16_t handle, const uint8_t *value,
+                                      uint16_t len, int need_confirm);
+
+typedef struct {
+    uint64_t indications;
+    uint64_t indication_bytes;
+    uint64_t responses;
+    uint64_t adv_data_sets;
+    uint64_t adv_starts;
+    uint64_t adv_stops;
+    uint64_t conn_param_updates;
+    uint64_t attr_value_sets;
+    uint64_t services_started;
+    int advertising;
+    esp_ble_adv_params_t last_adv_params;
+    esp_ble_adv_data_t last_adv_data;
+    uint8_t last_manufacturer[31];
+    int last_adv_len;                   //bytes of AD structures Bluedroid would build, at most 31 fit
+    int last_scan_rsp_len;
+    esp_ble_conn_update_params_t last_conn_params;
+} host_bt_stats_t;
+
+void host_bt_set_notify_hook(host_bt_notify_hook_t hook);
+//The central refuses the next n connection parameter updates
+void host_bt_refuse_conn_params(int n);
+//The next response other than ESP_GATT_BUSY takes ms to send, holding up the task that sends it
+void host_bt_delay_response(int ms);
+const host_bt_stats_t *host_bt_stats(void);
+
+//SPI master model. The calling thread plays the GEVCU: it waits for the slave to
+//have a transaction loaded, clocks len bytes each way and completes it.
+int host_spi_wait_ready(int timeout_ms);
+int host_spi_transfer(const void *mosi, void *miso, size_t len, int timeout_ms);
+int host_gpio_get_out(int pin);
+
+//NVS model. The firmware uses the nvs.h API; the benchmark can too (e.g. to seed
+//values before boot) and counts the commits that would have written flash.
+uint64_t host_nvs_commits(void);
+
+//Microseconds since the host "boot"; the base of every stubbed clock.
+uint64_t host_time_us(void);
+
+//Heap accounting shared with the benchmark's malloc wrappers.
+uint64_t host_alloc_count(void);
@@ -0,0 +1,2 @@
+// Host stand-in for the ESP-IDF rom/cache.h (unused by the GATT server).
+#pragma once
@@ -0,0 +1,7 @@
+// Host stand-in for the ESP-IDF rom/crc.h. Same semantics as the ROM routine: pass 0 (or the
+// previous result) as crc; crc32_le(0, buf, len) is the standard CRC-32 used by zlib.
+#pragma once
+
+#include <stdint.h>
+
+uint32_t crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
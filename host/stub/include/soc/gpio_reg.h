@@ -0,0 +1,8 @@
+// Host stand-in for the ESP-IDF soc/gpio_reg.h.
+#pragma once
+
+#include "soc/soc.h"
+
+#define GPIO_OUT_REG        0x3ff44004
+#define GPIO_OUT_W1TS_REG   0x3ff44008
+#define GPIO_OUT_W1TC_REG   0x3ff4400c
@@ -0,0 +1,4 @@
+// Host stand-in for the ESP-IDF soc/rtc_cntl_reg.h.
+#pragma once
+
+#include "soc/soc.h"
@@ -0,0 +1,11 @@
+// Host stand-in for the ESP-IDF soc/soc.h. Peripheral register writes land in the
+// host GPIO model so the SPI_INT handshake line can be observed by the harness.
+#pragma once
+
+#include <stdint.h>
+
+void host_write_peri_reg(uint32_t addr, uint32_t val);
+uint32_t host_read_peri_reg(uint32_t addr);
+
+#define WRITE_PERI_REG(addr, val) host_write_peri_reg((uint32_t)(addr), (uint32_t)(val))
+#define READ_PERI_REG(addr)       host_read_peri_reg((uint32_t)(addr))
@@ -0,0 +1,5 @@
+// Host stand-in for the Xtensa HAL. Only the cycle counter, which ticks at
+// CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ off the host clock.
+#pragma once
+
+unsigned xthal_get_ccount(void);
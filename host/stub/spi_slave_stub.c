@@ -0,0 +1,196 @@
+// SPI slave driver model. The firmware queues transactions exactly as it would on
+// the ESP32; host_spi_transfer() plays the master and completes the one that is
+// currently loaded, firing the same post_setup/post_trans callbacks in the same
+// order as the real driver's ISR.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "driver/spi_slave.h"
+#include "host_stub.h"
+
+#define HOST_SPI_MAX_QUEUE  16
+
+typedef struct {
+    int initialized;
+    spi_slave_interface_config_t cfg;
+    spi_slave_transaction_t *pending[HOST_SPI_MAX_QUEUE];
+    int pending_head, pending_count;
+    spi_slave_transaction_t *done[HOST_SPI_MAX_QUEUE];
+    int done_head, done_count;
+    int loaded;
+} host_spi_t;
+
+static host_spi_t spi;
+static pthread_mutex_t spi_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t spi_changed = PTHREAD_COND_INITIALIZER;
+
+static int wait_changed(const struct timespec *deadline)
+{
+    if (!deadline) return pthread_cond_wait(&spi_changed, &spi_lock);
+    return pthread_cond_timedwait(&spi_changed, &spi_lock, deadline);
+}
+
+static struct timespec *deadline_ms(struct timespec *ts, int64_t ms)
+{
+    if (ms < 0) return NULL;
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+static int64_t ticks_to_ms(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? -1 : (int64_t)ticks * portTICK_PERIOD_MS;
+}
+
+//Load the head of the queue into the "hardware" and tell the firmware, like the
+//driver ISR does. Called with spi_lock held.
+static void load_next(void)
+{
+    if (spi.loaded || spi.pending_count == 0) return;
+    spi.loaded = 1;
+    if (spi.cfg.post_setup_cb) spi.cfg.post_setup_cb(spi.pending[spi.pending_head]);
+}
+
+esp_err_t spi_slave_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config,
+                               const spi_slave_interface_config_t *slave_config, int dma_chan)
+{
+    if (dma_chan < 0 || dma_chan > 2) return ESP_ERR_INVALID_ARG;
+    if (slave_config->queue_size <= 0 || slave_config->queue_size > HOST_SPI_MAX_QUEUE)
+        return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&spi_lock);
+    memset(&spi, 0, sizeof(spi));
+    spi.cfg = *slave_config;
+    spi.initialized = 1;
+    pthread_cond_broadcast(&spi_changed);
+    pthread_mutex_unlock(&spi_lock);
+    return ESP_OK;
+}
+
+esp_err_t spi_slave_free(spi_host_device_t host)
+{
+    pthread_mutex_lock(&spi_lock);
+    spi.initialized = 0;
+    pthread_cond_broadcast(&spi_changed);
+    pthread_mutex_unlock(&spi_lock);
+    return ESP_OK;
+}
+
+esp_err_t spi_slave_queue_trans(spi_host_device_t host, const spi_slave_transaction_t *trans_desc,
+                                TickType_t ticks_to_wait)
+{
+    struct timespec ts, *deadline = deadline_ms(&ts, ticks_to_ms(ticks_to_wait));
+
+    pthread_mutex_lock(&spi_lock);
+    if (!spi.initialized) {
+        pthread_mutex_unlock(&spi_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    while (spi.pending_count >= spi.cfg.queue_size) {
+        if (ticks_to_wait == 0 || wait_changed(deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&spi_lock);
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    spi.pending[(spi.pending_head + spi.pending_count) % HOST_SPI_MAX_QUEUE] =
+        (spi_slave_transaction_t *)trans_desc;
+    spi.pending_count++;
+    load_next();
+    pthread_cond_broadcast(&spi_changed);
+    pthread_mutex_unlock(&spi_lock);
+    return ESP_OK;
+}
+
+esp_err_t spi_slave_get_trans_result(spi_host_device_t host, spi_slave_transaction_t **trans_desc,
+                                     TickType_t ticks_to_wait)
+{
+    struct timespec ts, *deadline = deadline_ms(&ts, ticks_to_ms(ticks_to_wait));
+
+    pthread_mutex_lock(&spi_lock);
+    while (spi.done_count == 0) {
+        if (ticks_to_wait == 0 || wait_changed(deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&spi_lock);
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    *trans_desc = spi.done[spi.done_head];
+    spi.done_head = (spi.done_head + 1) % HOST_SPI_MAX_QUEUE;
+    spi.done_count--;
+    pthread_cond_broadcast(&spi_changed);
+    pthread_mutex_unlock(&spi_lock);
+    return ESP_OK;
+}
+
+esp_err_t spi_slave_transmit(spi_host_device_t host, spi_slave_transaction_t *trans_desc,
+                             TickType_t ticks_to_wait)
+{
+    spi_slave_transaction_t *ret;
+    esp_err_t err = spi_slave_queue_trans(host, trans_desc, ticks_to_wait);
+    if (err != ESP_OK) return err;
+    return spi_slave_get_trans_result(host, &ret, ticks_to_wait);
+}
+
+int host_spi_wait_ready(int timeout_ms)
+{
+    struct timespec ts, *deadline = deadline_ms(&ts, timeout_ms);
+    int ready;
+
+    pthread_mutex_lock(&spi_lock);
+    while (!(ready = spi.initialized && spi.loaded)) {
+        if (wait_changed(deadline) == ETIMEDOUT) break;
+    }
+    pthread_mutex_unlock(&spi_lock);
+    return ready;
+}
+
+int host_spi_transfer(const void *mosi, void *miso, size_t len, int timeout_ms)
+{
+    struct timespec ts, *deadline = deadline_ms(&ts, timeout_ms);
+    spi_slave_transaction_t *t;
+    size_t n;
+
+    pthread_mutex_lock(&spi_lock);
+    while (!spi.loaded) {
+        if (wait_changed(deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&spi_lock);
+            return -1;
+        }
+    }
+    //Results the firmware has not collected yet still hold a slot in the driver.
+    while (spi.done_count >= HOST_SPI_MAX_QUEUE) {
+        if (wait_changed(deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&spi_lock);
+            return -1;
+        }
+    }
+    t = spi.pending[spi.pending_head];
+    spi.pending_head = (spi.pending_head + 1) % HOST_SPI_MAX_QUEUE;
+    spi.pending_count--;
+    spi.loaded = 0;
+
+    n = t->length / 8;
+    if (n > len) n = len;
+    if (miso) {
+        if (t->tx_buffer) memcpy(miso, t->tx_buffer, n);
+        else memset(miso, 0, n);
+        if (len > n) memset((uint8_t *)miso + n, 0, len - n);
+    }
+    if (mosi && t->rx_buffer) memcpy(t->rx_buffer, mosi, n);
+
+    if (spi.cfg.post_trans_cb) spi.cfg.post_trans_cb(t);
+    spi.done[(spi.done_head + spi.done_count) % HOST_SPI_MAX_QUEUE] = t;
+    spi.done_count++;
+    load_next();
+    pthread_cond_broadcast(&spi_changed);
+    pthread_mutex_unlock(&spi_lock);
+    return (int)n;
+}
@@ -0,0 +1,300 @@
+// Console, logging, GPIO and controller bring-up for the host build.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "driver/gpio.h"
+#include "bt.h"
+#include "esp_bt_main.h"
+#include "rom/crc.h"
+#include "xtensa/hal.h"
+#include "host_stub.h"
+
+static uint64_t console_bytes;
+static int console_echo;
+static esp_log_level_t log_level = CONFIG_LOG_DEFAULT_LEVEL;
+static uint32_t gpio_out;
+static pthread_mutex_t console_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void host_console_write(const char *buf, size_t len)
+{
+    __atomic_add_fetch(&console_bytes, len, __ATOMIC_RELAXED);
+    if (console_echo) {
+        pthread_mutex_lock(&console_lock);
+        fwrite(buf, 1, len, stderr);
+        pthread_mutex_unlock(&console_lock);
+    }
+}
+
+uint64_t host_console_bytes(void)
+{
+    return __atomic_load_n(&console_bytes, __ATOMIC_RELAXED);
+}
+
+static ssize_t console_cookie_write(void *cookie, const char *buf, size_t len)
+{
+    host_console_write(buf, len);
+    return len;
+}
+
+FILE *host_console_install(int echo)
+{
+    static cookie_io_functions_t fns = { .write = console_cookie_write };
+    FILE *report = fdopen(dup(fileno(stdout)), "w");
+    FILE *uart = fopencookie(NULL, "w", fns);
+
+    console_echo = echo;
+    fflush(stdout);
+    setvbuf(uart, NULL, _IONBF, 0);
+    stdout = uart;
+    return report;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    log_level = level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(host_time_us() / 1000);
+}
+
+unsigned xthal_get_ccount(void)
+{
+    return (unsigned)(host_time_us() * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    int len;
+
+    if (level > log_level) return;
+    va_start(args, format);
+    len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > (int)sizeof(line) - 1) len = sizeof(line) - 1;
+    if (len > 0) host_console_write(line, len);
+}
+
+void host_write_peri_reg(uint32_t addr, uint32_t val)
+{
+    switch (addr) {
+    case GPIO_OUT_REG:      __atomic_store_n(&gpio_out, val, __ATOMIC_RELEASE); break;
+    case GPIO_OUT_W1TS_REG: __atomic_or_fetch(&gpio_out, val, __ATOMIC_RELEASE); break;
+    case GPIO_OUT_W1TC_REG: __atomic_and_fetch(&gpio_out, ~val, __ATOMIC_RELEASE); break;
+    default: break;
+    }
+}
+
+uint32_t host_read_peri_reg(uint32_t addr)
+{
+    return addr == GPIO_OUT_REG ? __atomic_load_n(&gpio_out, __ATOMIC_ACQUIRE) : 0;
+}
+
+int host_gpio_get_out(int pin)
+{
+    return (host_read_peri_reg(GPIO_OUT_REG) >> pin) & 1;
+}
+
+esp_err_t gpio_config(const gpio_config_t *pGPIOConfig)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    host_write_peri_reg(level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, 1u << gpio_num);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    return host_gpio_get_out(gpio_num);
+}
+
+void esp_restart(void)
+{
+    exit(0);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 200 * 1024;
+}
+
+// NVS model: a handful of namespace/key blobs in memory. Writes become visible at once, as on the
+// target; commits are only counted, they stand for the flash writes the firmware pays for.
+#define HOST_NVS_ENTRIES    8
+#define HOST_NVS_NAMESPACES 4
+#define HOST_NVS_BLOB_MAX   1024
+
+typedef struct {
+    int used;
+    nvs_handle ns;
+    char key[16];
+    uint8_t value[HOST_NVS_BLOB_MAX];
+    size_t len;
+} host_nvs_entry_t;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static int nvs_initialized;
+static char nvs_namespaces[HOST_NVS_NAMESPACES][16];
+static host_nvs_entry_t nvs_entries[HOST_NVS_ENTRIES];
+static uint64_t nvs_commits;
+
+esp_err_t nvs_flash_init(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    nvs_initialized = 1;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle)
+{
+    esp_err_t err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    pthread_mutex_lock(&nvs_lock);
+    if (!nvs_initialized) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    for (int i = 0; i < HOST_NVS_NAMESPACES; i++) {
+        if (!nvs_namespaces[i][0]) strncpy(nvs_namespaces[i], name, sizeof(nvs_namespaces[i]) - 1);
+        if (!strcmp(nvs_namespaces[i], name)) {
+            *out_handle = (i + 1) | (open_mode == NVS_READONLY ? 0x100 : 0);
+            err = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+// Called with nvs_lock held
+static host_nvs_entry_t *nvs_find(nvs_handle handle, const char *key, int create)
+{
+    host_nvs_entry_t *free_entry = NULL;
+
+    for (int i = 0; i < HOST_NVS_ENTRIES; i++) {
+        host_nvs_entry_t *e = &nvs_entries[i];
+        if (e->used && e->ns == (handle & 0xFF) && !strncmp(e->key, key, sizeof(e->key))) return e;
+        if (!e->used && !free_entry) free_entry = e;
+    }
+    if (!create || !free_entry) return NULL;
+    memset(free_entry, 0, sizeof(*free_entry));
+    free_entry->used = 1;
+    free_entry->ns = handle & 0xFF;
+    strncpy(free_entry->key, key, sizeof(free_entry->key) - 1);
+    return free_entry;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length)
+{
+    host_nvs_entry_t *e;
+
+    if (!(handle & 0xFF)) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (handle & 0x100) return ESP_ERR_NVS_READ_ONLY;
+    if (length > HOST_NVS_BLOB_MAX) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    pthread_mutex_lock(&nvs_lock);
+    e = nvs_find(handle, key, 1);
+    if (e) {
+        memcpy(e->value, value, length);
+        e->len = length;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return e ? ESP_OK : ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length)
+{
+    esp_err_t err = ESP_OK;
+    host_nvs_entry_t *e;
+
+    if (!(handle & 0xFF)) return ESP_ERR_NVS_INVALID_HANDLE;
+    pthread_mutex_lock(&nvs_lock);
+    e = nvs_find(handle, key, 0);
+    if (!e) err = ESP_ERR_NVS_NOT_FOUND;
+    else if (out_value && *length < e->len) err = ESP_ERR_NVS_INVALID_LENGTH;
+    else {
+        if (out_value) memcpy(out_value, e->value, e->len);
+        *length = e->len;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char *key)
+{
+    host_nvs_entry_t *e;
+
+    if (!(handle & 0xFF)) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (handle & 0x100) return ESP_ERR_NVS_READ_ONLY;
+    pthread_mutex_lock(&nvs_lock);
+    e = nvs_find(handle, key, 0);
+    if (e) e->used = 0;
+    pthread_mutex_unlock(&nvs_lock);
+    return e ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle handle)
+{
+    if (!(handle & 0xFF)) return ESP_ERR_NVS_INVALID_HANDLE;
+    __atomic_add_fetch(&nvs_commits, 1, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle handle)
+{
+}
+
+uint64_t host_nvs_commits(void)
+{
+    return __atomic_load_n(&nvs_commits, __ATOMIC_RELAXED);
+}
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_enable(void)
+{
+    return ESP_OK;
+}
+
+uint32_t crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+    return ~crc;
+}
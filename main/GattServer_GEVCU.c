@@ -41,296 +41,55 @@
 #include "esp_bt_main.h"
 #include "esp_bt_main.h"
 #include "GattServer_GEVCU.h"
-
-//Hardware defines for which pins we've got the SPI signals routed to.
-#define SPI_INT 4
-#define SPI_MOSI 23
-#define SPI_MISO 19
-#define SPI_SCLK 18
-#define SPI_CS 5
+#include "gevcu_adv.h"
+#include "gevcu_bond.h"
+#include "gevcu_boot.h"
+#include "gevcu_conn.h"
+#include "gevcu_events.h"
+#include "gevcu_history.h"
+#include "gevcu_link.h"
+#include "gevcu_notify.h"
+#include "gevcu_params.h"
+#include "gevcu_persist.h"
+#include "gevcu_prepare.h"
+#include "gevcu_profile.h"
+#include "gevcu_reads.h"
+#include "gevcu_spi.h"
+#include "gevcu_stream.h"
+#include "gevcu_telemetry.h"
+#include "gevcu_trace.h"
+#include "gevcu_writeback.h"
 
 #define GEVCU_PROFILE_NUM 			    1
 #define GEVCU_PROFILE_APP_IDX 			0
 #define ESP_GEVCU_APP_ID			    0x55
 #define GEVCU_DEVICE_NAME               "GEVCU 6.2 ECU"
 #define GEVCU_TABLE_TAG                 "GATT_SERVER"
-#define GEVCU_MANUFACTURER_DATA_LEN     17
 #define GEVCU_SVC_INST_ID	    	    0
 
-#define GATTS_DEMO_CHAR_VAL_LEN_MAX		0x40
-
-
-uint16_t numAttributes[3] = {0,0,0};
-uint16_t currTablePtr = 0;
-int      serviceCount = 0;
-int      servicePtr = 0;
-int      handlePtr = 0;
-
-//use passed handle as an offset to this table and get back a characteristic struct or null
-//so far it is traditional that handles start at 40 and go up by one each time with each characteristic consisting
-//of 4 handles. Handle 1 = Declaration of char, 2 = value and UUID, 3 = Description, 4 = Presentation
-//Service takes up first entry in returned handles so first char is 41, first char's value is 42, etc.
-GATT_CHARACTERISTIC_t* gevcu_handle_table[300];
-
-/// Attribute table - everything is an attribute, services, characteristics, attributes on characteristics.
-//To add attributes like descriptor and presentation to a characteristic you just add them after the characteristic
-//and before the next characteristic.
-static esp_gatts_attr_db_t gevcu_gatt_db[3][100]; //a separate table for each service.
-
-
 GEVCU_PARAM_CACHE_t params;
 
-//Attributes with a length of 0 are special "this is a service definition" lines
-//Attributes end with a 0xFFFF UUID record as a terminator. It isn't actually included in resulting list.
-//divide chracteristics up into three services (Motoring stuff), "BMS type stuff" "System status/config"
-//It appears that there is a hard limit of 24 characteristics per service, at least if you use all the configuration
-//items I'm using. The limit seems to be about 100 handles per service. Maybe look into where that limit originates.
-GATT_CHARACTERISTIC_t GEVCU_Characteristics[] = {
-    {0x3100, ESP_GATT_CHAR_PROP_BIT_READ, 0, 0, "",                         //define 0x3100 Service (Motor config / performance)
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.torqueRequested},
-    {0x3101, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "TorqueRequested", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_MOMENT_OF_FORCE_NEWTON_METRE, 1, 0},
-        (uint8_t *)&params.torqueRequested},
-    {0x3102, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "TorqueActual", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_MOMENT_OF_FORCE_NEWTON_METRE, 1, 0}, 
-        (uint8_t *)&params.torqueActual},
-    {0x3103, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "SpeedRequested", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_ANGULAR_VELOCITY_REVOLUTION_PER_MINUTE, 1, 0}, 
-        (uint8_t *)&params.speedRequested},
-    {0x3104, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "SpeedActual", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_ANGULAR_VELOCITY_REVOLUTION_PER_MINUTE, 1, 0}, 
-        (uint8_t *)&params.speedActual},
-    {0x3105, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "PowerMode", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.powerMode},
-    {0x3106, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Gear", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.gear},
-    {0x3107, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "Motor Current", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_ELECTRIC_CURRENT_AMPERE, 1, 0}, 
-        (uint8_t *)&params.motorCurrent},
-    {0x3108, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "Mechanical Power", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_POWER_WATT, 1, 0}, 
-        (uint8_t *)&params.mechPower},
-    {0x3109, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "Motor Temperature", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, 1, 0}, 
-        (uint8_t *)&params.motorTemperature},
-    {0x310A, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "Inverter Temperature", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, 1, 0}, 
-        (uint8_t *)&params.inverterTemperature},
-    {0x310B, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "System Temperature", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, 1, 0}, 
-        (uint8_t *)&params.systemTemperature},
-    {0x310C, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Nominal Voltage", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_ELECTRIC_POTENTIAL_DIFFERENCE_VOLT, 1, 0}, 
-        (uint8_t *)&params.nomVoltage},
-    {0x310D, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Max RPMs", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_ANGULAR_VELOCITY_REVOLUTION_PER_MINUTE, 1, 0}, 
-        (uint8_t *)&params.maxRPM},
-    {0x310E, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Max Torque", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_MOMENT_OF_FORCE_NEWTON_METRE, 1, 0}, 
-        (uint8_t *)&params.maxTorque},
-    {0x310F, ESP_GATT_CHAR_PROP_BIT_READ, 4, 4, "Time Running", 
-        {GATT_PRESENT_FORMAT_UINT32, 0, GATT_PRESENT_UNIT_TIME_SECOND, 1, 0}, 
-        (uint8_t *)&params.timeRunning},
-        
-
-    {0x3200, ESP_GATT_CHAR_PROP_BIT_READ, 0, 0, "",                         //define 0x3200 Service (BMS and Throttle)
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.torqueRequested},
-    {0x3201, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "HV Bus Voltage", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_ELECTRIC_POTENTIAL_DIFFERENCE_VOLT, 1, 0}, 
-        (uint8_t *)&params.busVoltage},
-    {0x3202, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "HV Bus Current", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_ELECTRIC_CURRENT_AMPERE, 1, 0}, 
-        (uint8_t *)&params.busCurrent},
-    {0x3203, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "Kwh Remaining", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_ENERGY_KILOWATT_HOUR, 1, 0}, 
-        (uint8_t *)&params.kwHours},        
-    {0x3204, ESP_GATT_CHAR_PROP_BIT_READ, 1, 1, "State of Charge", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.SOC},
-    {0x3205, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "ThrottleRaw1", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.throttleRawLevel1},
-    {0x3206, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "ThrottleRaw2", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.throttleRawLevel2},
-    {0x3207, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "BrakeRaw", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.brakeRawLevel},
-    {0x3208, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "ThrottlePercentage", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.throttlePercentage},
-    {0x3209, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "BrakePercentage", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.brakePercentage},
-    {0x320A, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Throttle 1 Min", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.throttle1Min},
-    {0x320B, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Throttle 2 Min", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.throttle2Min}, 
-    {0x320C, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Throttle 1 Max", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.throttle1Max},
-    {0x320D, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Throttle 2 Max", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.throttle2Max},
-    {0x320E, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Throttle Regen Max", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.throttleRegenMax},
-    {0x320F, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Throttle Regen Min", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.throttleRegenMin}, 
-    {0x3210, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Throttle Fwd Start", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.throttleFwd},
-    {0x3211, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Throttle Map Point", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.throttleMap},
-    {0x3212, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Throttle Min Regen", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.throttleLowestRegen},
-    {0x3213, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Throttle Max Regen", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.throttleHighestRegen},
-    {0x3214, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Throttle Creep", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.throttleCreep},
-    {0x3215, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Brake Min", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.brakeMin}, 
-    {0x3216, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Brake Max", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.brakeMax}, 
-    {0x3217, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Brake Min Regen", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.brakeRegenMin}, 
-    {0x3218, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Brake Max Regen", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_PERCENTAGE, 1, 0}, 
-        (uint8_t *)&params.brakeRegenMax},
-
-    {0x3300, ESP_GATT_CHAR_PROP_BIT_READ, 0, 0, "",                         //define 0x3300 Service (System config and status)
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.torqueRequested},
-    {0x3301, ESP_GATT_CHAR_PROP_BIT_READ, 1, 1, "isRunning", 
-        {GATT_PRESENT_FORMAT_BOOLEAN, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.isRunning},
-    {0x3302, ESP_GATT_CHAR_PROP_BIT_READ, 1, 1, "isFaulted", 
-        {GATT_PRESENT_FORMAT_BOOLEAN, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.isFaulted},
-    {0x3303, ESP_GATT_CHAR_PROP_BIT_READ, 1, 1, "isWarning", 
-        {GATT_PRESENT_FORMAT_BOOLEAN, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.isWarning},
-    {0x3304, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "LoggingLevel", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.logLevel},
-    {0x3305, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Can0 Bitrate", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_FREQUENCY_HERTZ, 1, 0}, 
-        (uint8_t *)&params.can0Speed},
-    {0x3306, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Can1 Bitrate", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_FREQUENCY_HERTZ, 1, 0}, 
-        (uint8_t *)&params.can1Speed},
-    {0x3307, ESP_GATT_CHAR_PROP_BIT_READ, 4, 4, "Status Bitfield 1", 
-        {GATT_PRESENT_FORMAT_UINT32, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.bitfield1},
-    {0x3308, ESP_GATT_CHAR_PROP_BIT_READ, 4, 4, "Status Bitfield 2", 
-        {GATT_PRESENT_FORMAT_UINT32, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.bitfield2},
-    {0x3309, ESP_GATT_CHAR_PROP_BIT_READ, 4, 4, "Dig In Bitfield", 
-        {GATT_PRESENT_FORMAT_UINT32, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.digitalInputs},
-    {0x330A, ESP_GATT_CHAR_PROP_BIT_READ, 4, 4, "Dig Out Bitfield", 
-        {GATT_PRESENT_FORMAT_UINT32, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.digitalOutputs},
-    {0x330B, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 2, 2, "Precharge Time", 
-        {GATT_PRESENT_FORMAT_UINT16, 0, GATT_PRESENT_UNIT_TIME_SECOND, 1, 0}, 
-        (uint8_t *)&params.prechargeDuration},
-    {0x320C, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Precharge Output",
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.prechargeRelay},
-    {0x330D, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Main Contactor Output",
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.mainContRelay},
-    {0x330E, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Cooling Relay Output",
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.coolingRelay},
-    {0x330F, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Cool On Temperature",
-        {GATT_PRESENT_FORMAT_SINT8, 0, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, 1, 0}, 
-        (uint8_t *)&params.coolOnTemp},   
-    {0x3310, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Cool Off Temperature",
-        {GATT_PRESENT_FORMAT_SINT8, 0, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, 1, 0}, 
-        (uint8_t *)&params.coolOffTemp},
-    {0x3311, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Brake Light Output",
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.brakeLightOut},
-    {0x3312, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Reverse Light Output",
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.reverseLightOut},
-    {0x3313, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Enable Input",
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.enableIn},
-    {0x3314, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Reverse Input",
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.reverseIn},
-    {0x3315, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 4, 4, "Device Enable Bits1", 
-        {GATT_PRESENT_FORMAT_UINT32, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.deviceEnable1},
-    {0x3316, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 4, 4, "Device Enable Bits2", 
-        {GATT_PRESENT_FORMAT_UINT32, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.deviceEnable2}, 
-    {0x3317, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Num Throttle Pots", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.numThrottlePots}, 
-    {0x3318, ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE, 1, 1, "Throttle Type", 
-        {GATT_PRESENT_FORMAT_UINT8, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.throttleType},
-
-    {0xFFFF, ESP_GATT_CHAR_PROP_BIT_READ, 2, 2, "", 
-        {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, 
-        (uint8_t *)&params.torqueRequested}, 
-};
-
-static uint8_t gevcu_service_uuid[16] = {
-    /* LSB <--------------------------------------------------------------------------------> MSB */
-    //first uuid, 16bit, [12],[13] is the value
-    0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0x31, 0x00, 0x00, 0x00,
-};
-
-static esp_ble_adv_data_t gevcu_adv_config = {
-    .set_scan_rsp = false,
-    .include_name = true,
-    .include_txpower = true,
-    .min_interval = 0x20,
-    .max_interval = 0x40,
-    .appearance = 0x00,
-    .manufacturer_len = 0, //TEST_MANUFACTURER_DATA_LEN,
-    .p_manufacturer_data =  NULL, //&test_manufacturer[0],
-    .service_data_len = 0,
-    .p_service_data = NULL,
-    .service_uuid_len = sizeof(gevcu_service_uuid),
-    .p_service_uuid = gevcu_service_uuid,
-    .flag = (ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT),
-};
-
-static esp_ble_adv_params_t gevcu_adv_params = {
-    .adv_int_min        = 0x20,
-    .adv_int_max        = 0x40,
-    .adv_type           = ADV_TYPE_IND,
-    .own_addr_type      = BLE_ADDR_TYPE_PUBLIC,
-    //.peer_addr            =
-    //.peer_addr_type       =
-    .channel_map        = ADV_CHNL_ALL,
-    .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+//Service rows have a length of 0, characteristic rows carry the real thing. The table ends with
+//a 0xFFFF terminator.
+#define GEVCU_NOTIFY_IDX(id) GEVCU_NOTIFY_IDX_##id
+#define GEVCU_META_CHAR(id, props, minLen, maxLen, maxAge, desc, format, unit, field) \
+    {id, GEVCU_PROPS(props), minLen, maxLen, desc, {format, 0, unit, 1, 0}, GEVCU_VALUE(props, field), GEVCU_VALUE_ID(props, field), \
+        GEVCU_NOTIFY_INTERVAL(props), GEVCU_NOTIFY_THRESHOLD(props), GEVCU_IF_NOTIFY(props, GEVCU_NOTIFY_IDX, id, GEVCU_NOTIFY_NONE), \
+        maxAge, GEVCU_VALUE_READ(props, field), GEVCU_VALUE_WRITE(props, field)},
+#define GEVCU_META_SERVICE(id, CHARS) \
+    {id, ESP_GATT_CHAR_PROP_BIT_READ, 0, 0, "", {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, NULL, \
+        GEVCU_PARAM_COUNT, 0, 0, GEVCU_NOTIFY_NONE, 0, NULL, NULL}, \
+    CHARS(GEVCU_META_CHAR)
+
+const GATT_CHARACTERISTIC_t GEVCU_Characteristics[] = {
+    GEVCU_SERVICES(GEVCU_META_SERVICE)
+    {0xFFFF, ESP_GATT_CHAR_PROP_BIT_READ, 0, 0, "", {GATT_PRESENT_FORMAT_SINT16, 0, GATT_PRESENT_UNIT_NONE, 1, 0}, NULL,
+        GEVCU_PARAM_COUNT, 0, 0, GEVCU_NOTIFY_NONE, 0, NULL, NULL},
 };
 
 struct gatts_profile_inst {
-    esp_gatts_cb_t gatts_cb;
     uint16_t gatts_if;
     uint16_t app_id;
-    uint16_t conn_id;
     uint16_t service_handle;
     esp_gatt_srvc_id_t service_id;
     uint16_t char_handle;
@@ -341,13 +100,9 @@ struct gatts_profile_inst {
     esp_bt_uuid_t descr_uuid;
 };
 
-static void gatts_profile_event_handler(esp_gatts_cb_event_t event, 
-					esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
-
 /* One gatt-based profile one app_id and one gatts_if, this array will store the gatts_if returned by ESP_GATTS_REG_EVT */
 static struct gatts_profile_inst gevcu_profile_tab[GEVCU_PROFILE_NUM] = {
     [GEVCU_PROFILE_APP_IDX] = {
-        .gatts_cb = gatts_profile_event_handler,
         .gatts_if = ESP_GATT_IF_NONE,       /* Not get the gatt_if, so initial is ESP_GATT_IF_NONE */
     },
     
@@ -364,331 +119,529 @@ static const uint16_t character_declaration_uuid = ESP_GATT_UUID_CHAR_DECLARE;
 static const uint16_t character_client_config_uuid = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
 static const uint16_t character_descriptor = ESP_GATT_UUID_CHAR_DESCRIPTION;
 static const uint16_t character_presentation = ESP_GATT_UUID_CHAR_PRESENT_FORMAT;
-static const uint8_t char_prop_notify = ESP_GATT_CHAR_PROP_BIT_NOTIFY;
-static const uint8_t char_prop_read = ESP_GATT_CHAR_PROP_BIT_READ;
-static const uint8_t char_prop_read_write = ESP_GATT_CHAR_PROP_BIT_WRITE|ESP_GATT_CHAR_PROP_BIT_READ;
+static const uint8_t gevcu_cccd_off[2] = {0x00, 0x00};
+
+
+/// Attribute table - everything is an attribute, services, characteristics, attributes on characteristics.
+//Each characteristic expands to its declaration (sets read, write, notify permissions), its value (the UUID
+//of the characteristic and the data in params), a client config descriptor if it can notify, a description
+//and a presentation format. Values are answered by the app so reads come from params, not from the copy
+//the stack took when the table was created. A service table
+//is the service declaration followed by the attributes of all of its characteristics.
+//The client config descriptor is answered by the app too, the stack would keep one value for every central.
+#define GEVCU_DB_CCCD(uuid) \
+    {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, \
+        sizeof(uint16_t), sizeof(uint16_t), (uint8_t *)gevcu_cccd_off}},
+
+#define GEVCU_DB_CHAR(uuid, props, minLen, maxLen, maxAge, desc, format, unit, field) \
+    {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ, \
+        CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE, (uint8_t *)&GEVCU_Characteristics[GEVCU_IDX_##uuid].properties}}, \
+    {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GEVCU_Characteristics[GEVCU_IDX_##uuid].id, \
+        (GEVCU_PROPS(props) & ESP_GATT_CHAR_PROP_BIT_WRITE) ? (ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE) : ESP_GATT_PERM_READ, \
+        maxLen, maxLen, GEVCU_VALUE(props, field)}}, \
+    GEVCU_IF_NOTIFY(props, GEVCU_DB_CCCD, uuid, ) \
+    {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_descriptor, ESP_GATT_PERM_READ, \
+        sizeof(desc) - 1, sizeof(desc) - 1, (uint8_t *)desc}}, \
+    {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_presentation, ESP_GATT_PERM_READ, \
+        7, 7, (uint8_t *)&GEVCU_Characteristics[GEVCU_IDX_##uuid].presentation}},
+
+#define GEVCU_DB_SERVICE(uuid, CHARS) \
+    static const esp_gatts_attr_db_t gevcu_gatt_db_##uuid[] = { \
+        {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&primary_service_uuid, ESP_GATT_PERM_READ, \
+            sizeof(uint16_t), sizeof(uint16_t), (uint8_t *)&GEVCU_Characteristics[GEVCU_IDX_##uuid].id}}, \
+        CHARS(GEVCU_DB_CHAR) \
+    };
 
+GEVCU_SERVICES(GEVCU_DB_SERVICE)
+
+//Characteristic ids leave room for the UUIDs of the extra tables of their service
+#define GEVCU_CHECK_ID_CHAR(id, ...) \
+    _Static_assert(((id) & 0xFF) < GEVCU_SHARD_UUID_BASE, "characteristic " #id " collides with the shard UUIDs of its service");
+#define GEVCU_CHECK_ID_SERVICE(id, CHARS) CHARS(GEVCU_CHECK_ID_CHAR)
+GEVCU_SERVICES(GEVCU_CHECK_ID_SERVICE)
+
+//Sharding. A table holds the service declaration and GEVCU_SHARD_ATTRS attributes of whole
+//characteristics. A characteristic is 4 or 5 attributes (declaration, value, client config if it
+//notifies, description, presentation), so a table that had to stop holds at least GEVCU_SHARD_FILL.
+//That bounds the tables a service needs and the attributes copied to RAM for the extra ones.
+#define GEVCU_SHARD_ATTRS       (ESP_GATT_ATTR_HANDLE_MAX - 1)
+#define GEVCU_CHAR_ATTRS_MIN    4
+#define GEVCU_CHAR_ATTRS_MAX    5
+#define GEVCU_SHARD_FILL        (GEVCU_SHARD_ATTRS - GEVCU_CHAR_ATTRS_MAX + 1)
+
+#define GEVCU_SHARD_SIZES(uuid, CHARS) \
+    GEVCU_CHAR_ATTRS_##uuid = sizeof(gevcu_gatt_db_##uuid) / sizeof(esp_gatts_attr_db_t) - 1, \
+    GEVCU_SHARDS_##uuid = (GEVCU_CHAR_ATTRS_##uuid + GEVCU_SHARD_FILL - 1) / GEVCU_SHARD_FILL, \
+    GEVCU_COPIED_##uuid = GEVCU_CHAR_ATTRS_##uuid <= GEVCU_SHARD_ATTRS ? 0 : \
+        GEVCU_CHAR_ATTRS_##uuid - GEVCU_SHARD_FILL + GEVCU_SHARDS_##uuid - 1,
+enum { GEVCU_SERVICES(GEVCU_SHARD_SIZES) };
+#define GEVCU_SUM_SHARDS(uuid, CHARS) + GEVCU_SHARDS_##uuid
+#define GEVCU_SUM_COPIED(uuid, CHARS) + GEVCU_COPIED_##uuid
+#define GEVCU_SUM_ATTRS(uuid, CHARS) + GEVCU_CHAR_ATTRS_##uuid
+#define GEVCU_SHARD_MAX         (0 GEVCU_SERVICES(GEVCU_SUM_SHARDS))
+#define GEVCU_SHARD_RAM         (0 GEVCU_SERVICES(GEVCU_SUM_COPIED))
+//Every attribute of every table
+#define GEVCU_ATTR_COUNT        (GEVCU_SHARD_MAX GEVCU_SERVICES(GEVCU_SUM_ATTRS))
+//boot asks for every table at once, the handles of all of them can be waiting for the event worker
+_Static_assert(GEVCU_SHARD_MAX <= GEVCU_EVENT_TABLES, "more attribute tables than the event worker keeps handles for");
+
+//A handle index entry packs the characteristic ordinal within its table (0 = the service declaration)
+//and the role of the attribute, so it has to fit the ordinal in the upper 5 bits.
+#define GEVCU_HANDLE_ENTRY(ordinal, role)   (uint8_t)(((ordinal) << 3) | (role))
+#define GEVCU_HANDLE_ORDINAL(entry)         ((entry) >> 3)
+#define GEVCU_HANDLE_ROLE(entry)            ((entry) & 0x07)
+#define GEVCU_HANDLE_NONE                   0xFF
+_Static_assert(GEVCU_SHARD_ATTRS / GEVCU_CHAR_ATTRS_MIN < 31, "a full table has too many characteristics for the handle index");
+
+typedef struct
+{
+    const esp_gatts_attr_db_t *db;
+    uint8_t numAttributes;
+    uint8_t firstChar;      //row of the service in GEVCU_Characteristics[]
+} GEVCU_SERVICE_TABLE_t;
+
+#define GEVCU_DB_ENTRY(uuid, CHARS) {gevcu_gatt_db_##uuid, sizeof(gevcu_gatt_db_##uuid) / sizeof(esp_gatts_attr_db_t), \
+    GEVCU_IDX_##uuid},
+static const GEVCU_SERVICE_TABLE_t gevcu_gatt_db[] = { GEVCU_SERVICES(GEVCU_DB_ENTRY) }; //a separate table for each service.
+#define GEVCU_SERVICE_COUNT     (int)(sizeof(gevcu_gatt_db) / sizeof(gevcu_gatt_db[0]))
+
+//One table handed to the stack
+typedef struct
+{
+    const esp_gatts_attr_db_t *db;
+    uint8_t numAttributes;
+    uint8_t service;        //row of the service in GEVCU_Characteristics[]
+    uint8_t firstChar;      //row + 1 of the first characteristic of the table
+    uint16_t uuid;          //service UUID the table is declared with
+    uint16_t firstAttr;     //first entry of the table in gevcu_handle_index[]
+} GEVCU_SHARD_t;
+
+static GEVCU_SHARD_t gevcu_shards[GEVCU_SHARD_MAX];
+static int gevcu_shard_count;
+//Tables after the first of a service: a service declaration and copies of their attributes
+static esp_gatts_attr_db_t gevcu_shard_ram[GEVCU_SHARD_RAM + 1];
+
+//Cut every service into tables that fit the stack, packing whole characteristics greedily. The first
+//table of a service is its const table cut short, only the ones after it are copied to RAM.
+static void buildShards(void)
+{
+    int ram = 0;
+    uint16_t attrs = 0;
 
-//Called after a transaction is queued and ready for pickup by master. We use this to set the interrupt line high.
-void spi_post_queued_cb(spi_slave_transaction_t *trans) {
-    WRITE_PERI_REG(GPIO_OUT_W1TS_REG, (1<<SPI_INT));
+    gevcu_shard_count = 0;
+    for (int s = 0; s < GEVCU_SERVICE_COUNT; s++)
+    {
+        const GEVCU_SERVICE_TABLE_t *svc = &gevcu_gatt_db[s];
+        int row = svc->firstChar;
+        int x = 1;
+
+        for (int n = 0; x < svc->numAttributes; n++)
+        {
+            GEVCU_SHARD_t *shard = &gevcu_shards[gevcu_shard_count++];
+            int end = x, chars = 0;
+
+            while (end < svc->numAttributes)
+            {
+                int next = end + 1;
+                while (next < svc->numAttributes && svc->db[next].att_desc.uuid_p != (const uint8_t *)&character_declaration_uuid) next++;
+                if (next - x > GEVCU_SHARD_ATTRS) break;
+                end = next;
+                chars++;
+            }
+
+            shard->service = svc->firstChar;
+            shard->firstChar = row;
+            shard->uuid = GEVCU_Characteristics[svc->firstChar].id + (n ? GEVCU_SHARD_UUID_BASE + n : 0);
+            shard->firstAttr = attrs;
+            shard->numAttributes = 1 + end - x;
+            if (n == 0) shard->db = svc->db;
+            else
+            {
+                esp_gatts_attr_db_t *db = &gevcu_shard_ram[ram];
+                db[0] = svc->db[0];
+                db[0].att_desc.value = (uint8_t *)&shard->uuid;
+                memcpy(&db[1], &svc->db[x], (end - x) * sizeof(esp_gatts_attr_db_t));
+                shard->db = db;
+                ram += shard->numAttributes;
+            }
+            attrs += shard->numAttributes;
+            row += chars;
+            x = end;
+        }
+    }
 }
 
-//Called after transaction is sent/received. We use this to set the interrupt line low.
-void spi_post_trans_cb(spi_slave_transaction_t *trans) {
-    WRITE_PERI_REG(GPIO_OUT_W1TC_REG, (1<<SPI_INT));
+//Handle lookup. The stack hands back one handle per attribute when a table is created. We keep the
+//service declaration handle as the base of each table and one byte per attribute holding its
+//characteristic ordinal and role, so any handle resolves with a range check and an array index.
+static uint16_t gevcu_base_handle[GEVCU_SHARD_MAX];
+static uint8_t gevcu_handle_index[GEVCU_ATTR_COUNT];
+
+//Row in GEVCU_Characteristics[] of the ordinal-th characteristic of a table, the service for 0
+static const GATT_CHARACTERISTIC_t *shardCharacteristic(const GEVCU_SHARD_t *shard, int ordinal)
+{
+    return &GEVCU_Characteristics[ordinal ? shard->firstChar + ordinal : shard->service];
 }
 
-void spiSetup() {
-    esp_err_t ret;
+static void buildHandleIndex(int table, const uint16_t *handles, int numHandles)
+{
+    const GEVCU_SHARD_t *shard = &gevcu_shards[table];
+    uint8_t *index = &gevcu_handle_index[shard->firstAttr];
+    int ordinal = 0;
+    uint8_t role = GEVCU_ATTR_SERVICE;
 
-    //Configuration for the SPI bus
-    spi_bus_config_t buscfg={
-        .mosi_io_num=SPI_MOSI,
-        .miso_io_num=SPI_MISO,
-        .sclk_io_num=SPI_SCLK
-    };
+    memset(index, GEVCU_HANDLE_NONE, shard->numAttributes);
+    gevcu_base_handle[table] = handles[0];
 
-    //Configuration for the SPI slave interface
-    spi_slave_interface_config_t slvcfg={
-        .mode=0,
-        .spics_io_num=SPI_CS,
-        .queue_size=3,
-        .flags=0,
-        .post_setup_cb=spi_post_queued_cb,
-        .post_trans_cb=spi_post_trans_cb
-    };
+    //Roles come from the attribute UUIDs in the table rather than from a fixed stride so the
+    //layout of a characteristic can grow without touching this.
+    for (int x = 0; x < numHandles; x++)
+    {
+        const uint8_t *uuid = shard->db[x].att_desc.uuid_p;
+        uint16_t offset = handles[x] - handles[0];
 
-    //Configuration for the interrupt line
-    gpio_config_t io_conf={
-        .intr_type=GPIO_INTR_DISABLE,
-        .mode=GPIO_MODE_OUTPUT,
-        .pin_bit_mask=(1<<SPI_INT)
-    };
+        if (uuid == (const uint8_t *)&character_declaration_uuid) { ordinal++; role = GEVCU_ATTR_DECLARATION; }
+        else if (uuid == (const uint8_t *)&character_descriptor) role = GEVCU_ATTR_DESCRIPTION;
+        else if (uuid == (const uint8_t *)&character_presentation) role = GEVCU_ATTR_PRESENTATION;
+        else if (uuid == (const uint8_t *)&character_client_config_uuid) role = GEVCU_ATTR_CLIENT_CONFIG;
+        else if (role == GEVCU_ATTR_DECLARATION) role = GEVCU_ATTR_VALUE;
 
-    //Configure interrupt line as output
-    gpio_config(&io_conf);
-    //Enable pull-ups on SPI lines so we don't detect rogue pulses when no master is connected.
-    gpio_set_pull_mode(SPI_MOSI, GPIO_PULLUP_ONLY);
-    gpio_set_pull_mode(SPI_SCLK, GPIO_PULLUP_ONLY);
-    gpio_set_pull_mode(SPI_CS, GPIO_PULLUP_ONLY);
+        if (offset >= shard->numAttributes)
+        {
+            ESP_LOGE(GEVCU_TABLE_TAG, "Handle %i of service %04x is outside its range", handles[x], shard->uuid);
+            continue;
+        }
+        index[offset] = GEVCU_HANDLE_ENTRY(ordinal, role);
+        if (role == GEVCU_ATTR_VALUE) notifySetHandle(shardCharacteristic(shard, ordinal), handles[x]);
+    }
+}
 
-    //Initialize SPI slave interface
-    ret=spi_slave_initialize(HSPI_HOST, &buscfg, &slvcfg, 1);
-    assert(ret==ESP_OK);
+const GATT_CHARACTERISTIC_t *findCharacteristic(uint16_t handle, uint8_t *role)
+{
+    for (int t = 0; t < gevcu_shard_count; t++)
+    {
+        const GEVCU_SHARD_t *shard = &gevcu_shards[t];
+        uint16_t offset = handle - gevcu_base_handle[t];
+        if (gevcu_base_handle[t] == 0 || offset >= shard->numAttributes) continue;
+
+        uint8_t entry = gevcu_handle_index[shard->firstAttr + offset];
+        if (entry == GEVCU_HANDLE_NONE) return NULL;
+        if (role) *role = GEVCU_HANDLE_ROLE(entry);
+        return shardCharacteristic(shard, GEVCU_HANDLE_ORDINAL(entry));
+    }
+    return NULL;
 }
 
-esp_err_t spi_slave_tx(spi_host_device_t host, spi_slave_transaction_t *trans_desc, spi_slave_transaction_t **ret_trans, TickType_t ticks_to_wait)
+
+
+//Boot state machine. Everything that only needs the gatts_if is requested at once when the app
+//registers: device name, advertising data and every attribute table, which Bluedroid then works
+//through back to back instead of waiting on us between tables. Each table's service is started as
+//soon as the table exists. Advertising starts when the advertising data is set and every service is
+//started, whichever comes last, so a central never connects to a half built database.
+static int bootTables;
+static int bootServices;
+static uint8_t bootAdvertising;
+
+static void bootAdvertise(void)
 {
-    esp_err_t ret;
-    //ToDo: check if any spi transfers in flight
-    ret = spi_slave_queue_trans(host, trans_desc, ticks_to_wait);
-    if (ret != ESP_OK) return ret;
-    ret = spi_slave_get_trans_result(host, ret_trans, ticks_to_wait);
-    if (ret != ESP_OK) return ret;
-    return ESP_OK;
+    if (bootAdvertising || !bootReached(GEVCU_BOOT_ADV_DATA) || !bootReached(GEVCU_BOOT_SERVICES)) return;
+    bootAdvertising = 1;
+    TRACE(GAP_ADV_START, GEVCU_TRACE_NO_ROW, 0, 0);
+    //the phone that was here when the car was switched off is likely still around
+    advStart(1);
+}
+
+//Which of our tables was created, -1 for none of ours
+static int tableOfService(const esp_bt_uuid_t *uuid)
+{
+    for (int t = 0; t < gevcu_shard_count; t++)
+    {
+        if (uuid->len == ESP_UUID_LEN_16 && uuid->uuid.uuid16 == gevcu_shards[t].uuid) return t;
+    }
+    return -1;
+}
+
+//GAP and GATTS event handlers. They run on the event worker, the callbacks only queue the events, see
+//gevcu_events.h. Events that aren't in the tables at the end are not even queued.
+static void gapAdvDataSet(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    bootMark(GEVCU_BOOT_ADV_DATA);
+    bootAdvertise();
 }
 
-static void generateAttrTable()
+static void gapAdvStarted(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
 {
-    int counter = currTablePtr;
-    int attrCount = 0;
-    int handleCount = 0; //some attributes don't get handles
+    //advertising start complete event to indicate advertising start successfully or failed
+    if (param->adv_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+        ESP_LOGE(GEVCU_TABLE_TAG, "Advertising start failed\n");
+    }
+    else bootMark(GEVCU_BOOT_ADVERTISING);
+}
+
+static void gapConnParams(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    linkUpdated(&param->update_conn_params);
+}
+
+static void gapSecurityRequest(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    bondSecurityRequest(&param->ble_security.ble_req);
+}
+
+static void gapAuthComplete(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    bondAuthComplete(&param->ble_security.auth_cmpl);
+}
+
+static void gattsRegister(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    if (param->reg.status != ESP_GATT_OK) {
+        ESP_LOGE(GEVCU_TABLE_TAG,"Reg app failed, app_id %04x, status %d\n",
+                param->reg.app_id, 
+                param->reg.status);
+        return;
+    }
+    bootMark(GEVCU_BOOT_REGISTERED);
+    esp_ble_gap_set_device_name(GEVCU_DEVICE_NAME);
+    advConfigure();
+    buildShards();
+    for (int t = 0; t < gevcu_shard_count; t++)
+    {
+        esp_ble_gatts_create_attr_tab(gevcu_shards[t].db, gatts_if, gevcu_shards[t].numAttributes, t);
+    }
+}
+
+//struct gatts_read_evt_param {
+//    uint16_t conn_id;               /*!< Connection id */
+//    uint32_t trans_id;              /*!< Transfer id */
+//    esp_bd_addr_t bda;              /*!< The bluetooth device address which been read */
+//    uint16_t handle;                /*!< The attribute handle */
+//    uint16_t offset;                /*!< Offset of the value, if the value is too long */
+//    bool is_long;                   /*!< The value is too long or not */
+//    bool need_rsp;                  /*!< The read operation need to do response */
+//} read;
+static void gattsRead(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    uint8_t role;
+    const GATT_CHARACTERISTIC_t *chr = findCharacteristic(param->read.handle, &role);
+    if (chr == NULL)
+    {
+        TRACE(GATT_UNKNOWN_HANDLE, GEVCU_TRACE_NO_ROW, param->read.handle, 0);
+        return;
+    }
+    TRACE(GATT_READ, chr - GEVCU_Characteristics, param->read.handle, 0);
+    //values are answered by us so a read never sees an old copy in the stack
+    if (role == GEVCU_ATTR_VALUE && param->read.need_rsp)
+    {
+        readsRequest(chr, gatts_if, param->read.conn_id, param->read.trans_id, param->read.handle,
+                     param->read.offset);
+    }
+    //and so are the subscriptions, every central sees its own
+    else if (role == GEVCU_ATTR_CLIENT_CONFIG && param->read.need_rsp)
+    {
+        uint16_t cccd = notifyConfig(chr, param->read.conn_id);
+        esp_gatt_rsp_t rsp;
+
+        memset(&rsp, 0, sizeof(rsp));
+        rsp.attr_value.handle = param->read.handle;
+        rsp.attr_value.offset = param->read.offset;
+        rsp.attr_value.len = param->read.offset ? 0 : sizeof(cccd);
+        memcpy(rsp.attr_value.value, &cccd, sizeof(cccd));
+        esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id,
+                                    param->read.offset ? ESP_GATT_INVALID_OFFSET : ESP_GATT_OK, &rsp);
+    }
+}
 
-    while (GEVCU_Characteristics[counter].id < 0xFFFF)
+//struct gatts_write_evt_param {
+//    uint16_t conn_id;               /*!< Connection id */
+//    uint32_t trans_id;              /*!< Transfer id */
+//    esp_bd_addr_t bda;              /*!< The bluetooth device address which been written */
+//    uint16_t handle;                /*!< The attribute handle */
+//    uint16_t offset;                /*!< Offset of the value, if the value is too long */
+//    bool need_rsp;                  /*!< The write operation need to do response */
+//    bool is_prep;                   /*!< This write operation is prepare write */
+//    uint16_t len;                   /*!< The write attribute value length */
+//    uint8_t *value;                 /*!< The write attribute value, at most GEVCU_EVENT_DATA_MAX bytes of it */
+//} write;
+static void gattsWrite(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    uint8_t role;
+    const GATT_CHARACTERISTIC_t *chr = findCharacteristic(param->write.handle, &role);
+    if (chr == NULL)
+    {
+        TRACE(GATT_UNKNOWN_HANDLE, GEVCU_TRACE_NO_ROW, param->write.handle, 0);
+        return;
+    }
+    uint32_t value = 0;
+    memcpy(&value, param->write.value, param->write.len < sizeof(value) ? param->write.len : sizeof(value));
+    TRACE(GATT_WRITE, chr - GEVCU_Characteristics, param->write.handle, value);
+    //segments of a long or reliable write wait for the execute
+    if (param->write.is_prep)
     {
-        if (GEVCU_Characteristics[counter].maxLen == 0) //Create a new service entry
+        if (role == GEVCU_ATTR_VALUE) prepareWrite(chr, gatts_if, &param->write);
+        else if (param->write.need_rsp)
         {
-            if (serviceCount > 0) numAttributes[serviceCount - 1] = attrCount;
-            attrCount = 0;
-            handleCount = 0;
-            serviceCount++;
-            gevcu_gatt_db[serviceCount - 1][attrCount].attr_control.auto_rsp = ESP_GATT_AUTO_RSP;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_length = ESP_UUID_LEN_16;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_p = (uint8_t *)&primary_service_uuid;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.perm = ESP_GATT_PERM_READ;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.max_length = sizeof(uint16_t);
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.length = sizeof(uint16_t);
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.value = (uint8_t *)&GEVCU_Characteristics[counter].id;
-            attrCount++;
+            esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id,
+                                        ESP_GATT_REQ_NOT_SUPPORTED, NULL);
         }
-        else { //set up a new characteristic 
-            //declaration (sets read, write, notify permissions)
-            gevcu_gatt_db[serviceCount - 1][attrCount].attr_control.auto_rsp = ESP_GATT_AUTO_RSP;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_length = ESP_UUID_LEN_16;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_p = (uint8_t *)&character_declaration_uuid;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.perm = ESP_GATT_PERM_READ;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.max_length = CHAR_DECLARATION_SIZE;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.length = CHAR_DECLARATION_SIZE;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.value = (uint8_t *)&GEVCU_Characteristics[counter].properties;
-            attrCount++;
-
-            //value - sets the UUID of the characteristic and data associated to this characteristic
-            gevcu_gatt_db[serviceCount - 1][attrCount].attr_control.auto_rsp = ESP_GATT_AUTO_RSP;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_length = ESP_UUID_LEN_16;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_p = (uint8_t *)&GEVCU_Characteristics[counter].id;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.perm = ESP_GATT_PERM_READ;
-            if (GEVCU_Characteristics[counter].properties & ESP_GATT_CHAR_PROP_BIT_WRITE) //if we can write then we need to specify that here too.
-                gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.perm |= ESP_GATT_PERM_WRITE;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.max_length = GEVCU_Characteristics[counter].maxLen;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.length = GEVCU_Characteristics[counter].maxLen;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.value = GEVCU_Characteristics[counter].data;
-            attrCount++;
-
-            //description
-            gevcu_gatt_db[serviceCount - 1][attrCount].attr_control.auto_rsp = ESP_GATT_AUTO_RSP;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_length = ESP_UUID_LEN_16;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_p = (uint8_t *)&character_descriptor;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.perm = ESP_GATT_PERM_READ;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.max_length = strlen(GEVCU_Characteristics[counter].description);
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.length = strlen(GEVCU_Characteristics[counter].description);
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.value = (uint8_t *)GEVCU_Characteristics[counter].description;
-            attrCount++;
-            handleCount++;
-
-            //Presentation byte
-            gevcu_gatt_db[serviceCount - 1][attrCount].attr_control.auto_rsp = ESP_GATT_AUTO_RSP;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_length = ESP_UUID_LEN_16;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.uuid_p = (uint8_t *)&character_presentation;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.perm = ESP_GATT_PERM_READ;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.max_length = 7;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.length = 7;
-            gevcu_gatt_db[serviceCount - 1][attrCount].att_desc.value = (uint8_t *)&GEVCU_Characteristics[counter].presentation;
-            attrCount++;
-            handleCount++;
+    }
+    else if (role == GEVCU_ATTR_CLIENT_CONFIG)
+    {
+        esp_gatt_status_t status = notifySubscribe(chr, param->write.conn_id, param->write.value, param->write.len);
+        if (param->write.need_rsp)
+        {
+            esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, NULL);
         }
-        counter++;
-    }    
-    numAttributes[serviceCount - 1] = attrCount;
-};
+    }
+    else if (role == GEVCU_ATTR_VALUE && chr->write)
+    {
+        esp_gatt_status_t status = chr->write(param->write.conn_id, param->write.value, param->write.len);
+        if (param->write.need_rsp)
+        {
+            esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, NULL);
+        }
+    }
+    else if (role == GEVCU_ATTR_VALUE)
+    {
+        int changed = paramsWrite(chr->param, param->write.value, param->write.len);
+        if (changed < 0) TRACE(GATT_BAD_LENGTH, chr - GEVCU_Characteristics, param->write.handle, param->write.len);
+        //GEVCU owns the value, tell it
+        else if (changed) writebackQueue(chr->param, param->write.value, param->write.len);
+        if (param->write.need_rsp)
+        {
+            esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id,
+                                        changed < 0 ? ESP_GATT_INVALID_ATTR_LEN : ESP_GATT_OK, NULL);
+        }
+    }
+}
 
+static void gattsExecWrite(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    prepareExecute(gatts_if, &param->exec_write);
+}
 
+static void gattsMtu(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    TRACE(GATT_MTU, GEVCU_TRACE_NO_ROW, param->mtu.mtu, param->mtu.conn_id);
+    connSetMtu(param->mtu.conn_id, param->mtu.mtu);
+}
 
-static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+static void gattsStarted(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
 {
-    ESP_LOGE(GEVCU_TABLE_TAG, "GAP_EVT, event %d\n", event);
-
-    switch (event) {
-    case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
-        ESP_LOGE(GEVCU_TABLE_TAG, "Start advertising");
-        esp_ble_gap_start_advertising(&gevcu_adv_params);
-        break;
-    case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
-        //advertising start complete event to indicate advertising start successfully or failed
-        if (param->adv_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
-            ESP_LOGE(GEVCU_TABLE_TAG, "Advertising start failed\n");
-        }
-        break;        
-    default:
-        break;
+    if (param->start.status != ESP_GATT_OK)
+    {
+        ESP_LOGE(GEVCU_TABLE_TAG, "Starting service %i failed: status %x", param->start.service_handle, param->start.status);
+    }
+    else if (++bootServices == gevcu_shard_count)
+    {
+        bootMark(GEVCU_BOOT_SERVICES);
+        bootAdvertise();
     }
 }
 
-static void gatts_profile_event_handler(esp_gatts_cb_event_t event, 
-										   esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param) 
+static void gattsConnect(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
 {
-    ESP_LOGE(GEVCU_TABLE_TAG, "event = %x\n",event);
-    switch (event) {
-    case ESP_GATTS_REG_EVT: //0
-		ESP_LOGI(GEVCU_TABLE_TAG, "%s %d\n", __func__, __LINE__);
-        	esp_ble_gap_set_device_name(GEVCU_DEVICE_NAME);
-        ESP_LOGI(GEVCU_TABLE_TAG,"%s %d\n", __func__, __LINE__);
-       	esp_ble_gap_config_adv_data(&gevcu_adv_config);
-
-        ESP_LOGI(GEVCU_TABLE_TAG,"%s %d\n", __func__, __LINE__);
-        ESP_LOGI(GEVCU_TABLE_TAG,"Num attribs in this table: %i", numAttributes[0]);
-		esp_ble_gatts_create_attr_tab(gevcu_gatt_db[servicePtr], gatts_if, 
-								numAttributes[servicePtr], servicePtr);
-        ESP_LOGI(GEVCU_TABLE_TAG,"%s %d\n", __func__, __LINE__);
-
-       	break;
-    case ESP_GATTS_READ_EVT: //1
-    //struct gatts_read_evt_param {
-    //    uint16_t conn_id;               /*!< Connection id */
-    //    uint32_t trans_id;              /*!< Transfer id */
-    //    esp_bd_addr_t bda;              /*!< The bluetooth device address which been read */
-    //    uint16_t handle;                /*!< The attribute handle */
-    //    uint16_t offset;                /*!< Offset of the value, if the value is too long */
-    //    bool is_long;                   /*!< The value is too long or not */
-    //    bool need_rsp;                  /*!< The read operation need to do response */
-    //} read;
-        ESP_LOGI(GEVCU_TABLE_TAG,"GATT Server Read Event for handle: %i  name: %s", param->read.handle, gevcu_handle_table[param->read.handle]->description);
-       	break;
-    case ESP_GATTS_WRITE_EVT: //2
-    //struct gatts_write_evt_param {
-    //    uint16_t conn_id;               /*!< Connection id */
-    //    uint32_t trans_id;              /*!< Transfer id */
-    //    esp_bd_addr_t bda;              /*!< The bluetooth device address which been written */
-    //    uint16_t handle;                /*!< The attribute handle */
-    //    uint16_t offset;                /*!< Offset of the value, if the value is too long */
-    //    bool need_rsp;                  /*!< The write operation need to do response */
-    //    bool is_prep;                   /*!< This write operation is prepare write */
-    //    uint16_t len;                   /*!< The write attribute value length */
-    //    uint8_t *value;                 /*!< The write attribute value */
-    //} write;   
-        ESP_LOGI(GEVCU_TABLE_TAG,"GATT Server Write Event for handle: %i name: %s   len: %i, value: %i", param->write.handle, 
-                 gevcu_handle_table[param->write.handle]->description, param->write.len, *param->write.value);
-      	break;
-    case ESP_GATTS_EXEC_WRITE_EVT: //3
-		break;
-    case ESP_GATTS_MTU_EVT: //4
-		break;
-   	case ESP_GATTS_CONF_EVT: //5
-		break;
-    case ESP_GATTS_UNREG_EVT: //6
-        break;
-    case ESP_GATTS_CREATE_EVT: //7
-        ESP_LOGI(GEVCU_TABLE_TAG,"Create service complete");
-        break;
-    case ESP_GATTS_ADD_INCL_SRVC_EVT: //8
-        break;
-    case ESP_GATTS_ADD_CHAR_EVT: //9
-        ESP_LOGI(GEVCU_TABLE_TAG,"Add characteristic complete");
-        break;
-    case ESP_GATTS_ADD_CHAR_DESCR_EVT: //10
-        ESP_LOGI(GEVCU_TABLE_TAG,"Add descriptor complete");
-        break;
-    case ESP_GATTS_DELETE_EVT: //11
-        break;
-    case ESP_GATTS_START_EVT: //12
-        break;
-    case ESP_GATTS_STOP_EVT: //13
-        break;
-    case ESP_GATTS_CONNECT_EVT: //14
-        break;
-    case ESP_GATTS_DISCONNECT_EVT: //15
-        //upon disconnect re-enter advertising mode
-        esp_ble_gap_start_advertising(&gevcu_adv_params);        
-	    break;
-    case ESP_GATTS_OPEN_EVT: //16
-		break;
-    case ESP_GATTS_CANCEL_OPEN_EVT: //17
-		break;
-    case ESP_GATTS_CLOSE_EVT: //18
-		break;
-    case ESP_GATTS_LISTEN_EVT: //19
-		break;
-    case ESP_GATTS_CONGEST_EVT: //20
-		break;
-    case ESP_GATTS_CREAT_ATTR_TAB_EVT:{ //22
-		ESP_LOGI(GEVCU_TABLE_TAG,"The number handle =%i",param->add_attr_tab.num_handle);
-        ESP_LOGI(GEVCU_TABLE_TAG,"Number of attributes %i", numAttributes[servicePtr]);
-        ESP_LOGI(GEVCU_TABLE_TAG,"Param Address: %x", (unsigned int)param);
-        ESP_LOGI(GEVCU_TABLE_TAG,"add_addr_tab Address: %x", (unsigned int)&param->add_attr_tab);
-        ESP_LOGI(GEVCU_TABLE_TAG,"handles Address: %x", (unsigned int)param->add_attr_tab.handles);
-		if(param->add_attr_tab.handles || param->add_attr_tab.num_handle == numAttributes[servicePtr]) {			
-			memcpy(gevcu_handle_table, param->add_attr_tab.handles, 
-					numAttributes[servicePtr]);
-            
-            int cnt = 0;
-            for (int x = 0 ; x < param->add_attr_tab.num_handle; x++) {
-                ESP_LOGI(GEVCU_TABLE_TAG,"Handle %i is %i", x, param->add_attr_tab.handles[x]);
-            }
-            
-            //service is first entry
-            gevcu_handle_table[param->add_attr_tab.handles[0]] = &GEVCU_Characteristics[handlePtr++];
-            for (int x = 1 ; x < param->add_attr_tab.num_handle; x = x + 4) {
-                gevcu_handle_table[param->add_attr_tab.handles[x]] = &GEVCU_Characteristics[handlePtr];
-                gevcu_handle_table[param->add_attr_tab.handles[x+1]] = &GEVCU_Characteristics[handlePtr];
-                gevcu_handle_table[param->add_attr_tab.handles[x+2]] = &GEVCU_Characteristics[handlePtr];
-                gevcu_handle_table[param->add_attr_tab.handles[x+3]] = &GEVCU_Characteristics[handlePtr++];
-            }
-            
-            esp_ble_gatts_start_service(param->add_attr_tab.handles[0]);
-            ESP_LOGI(GEVCU_TABLE_TAG,"Attempted to start service with table ID %i", param->add_attr_tab.handles[0]);
-            
-            if (servicePtr < serviceCount - 1)
-            {
-                servicePtr++;
-                ESP_LOGI(GEVCU_TABLE_TAG,"Num attribs in this next table: %i", numAttributes[servicePtr]);
-                esp_ble_gatts_create_attr_tab(gevcu_gatt_db[servicePtr], gatts_if, 
-                                numAttributes[servicePtr], servicePtr);
-            }
-		}
-		break;
-	}
-		
-    default:
-        break;
+    uint8_t conn = connOpen(gatts_if, param->connect.conn_id, param->connect.remote_bda);
+    if (conn == GEVCU_CONN_NONE)
+    {
+        esp_ble_gatts_close(gatts_if, param->connect.conn_id);
+        return;
+    }
+    notifyConnect(conn);
+    historyConnect(conn);
+    streamReset(conn);
+    linkConnect(conn);
+    bondConnect(param->connect.remote_bda);
+    //the controller stops advertising when it accepts a connection, go on while slots are free
+    advStopped();
+    if (connCount() < GEVCU_CONN_MAX) advStart(0);
+}
+
+static void gattsDisconnect(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    esp_bd_addr_t bda;
+    int known = connAddress(param->disconnect.conn_id, bda);
+    connClose(param->disconnect.conn_id);
+    //the bonded central dropped out: call it back with directed advertising. Otherwise advertising
+    //only has to come back if the last slot was taken.
+    if (known && bondIsLast(bda)) advStart(1);
+    else if (known && connCount() == GEVCU_CONN_MAX - 1) advStart(0);
+    prepareCancel(param->disconnect.conn_id);
+}
+
+static void gattsTableCreated(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param)
+{
+    int table = tableOfService(&param->add_attr_tab.svc_uuid);
+    if (table < 0 || param->add_attr_tab.status != ESP_GATT_OK || !param->add_attr_tab.handles ||
+        param->add_attr_tab.num_handle != gevcu_shards[table].numAttributes) {
+        ESP_LOGE(GEVCU_TABLE_TAG, "Creating the table of service %04x failed: status %x, %i handles",
+                 param->add_attr_tab.svc_uuid.uuid.uuid16, param->add_attr_tab.status, param->add_attr_tab.num_handle);
+        return;
     }
+    //service is first entry
+    buildHandleIndex(table, param->add_attr_tab.handles, param->add_attr_tab.num_handle);
+    esp_ble_gatts_start_service(param->add_attr_tab.handles[0]);
+    if (++bootTables == gevcu_shard_count) bootMark(GEVCU_BOOT_TABLES);
 }
 
+static const GEVCU_EVENT_ENTRY_t gevcu_gap_events[] = {
+    GEVCU_ON_GAP(ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT, gapAdvDataSet, adv_data_cmpl),
+    GEVCU_ON_GAP(ESP_GAP_BLE_ADV_START_COMPLETE_EVT, gapAdvStarted, adv_start_cmpl),
+    GEVCU_ON_GAP(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, gapConnParams, update_conn_params),
+    GEVCU_ON_GAP(ESP_GAP_BLE_SEC_REQ_EVT, gapSecurityRequest, ble_security.ble_req),
+    GEVCU_ON_GAP(ESP_GAP_BLE_AUTH_CMPL_EVT, gapAuthComplete, ble_security.auth_cmpl),
+};
 
+static const GEVCU_EVENT_ENTRY_t gevcu_gatts_events[] = {
+    GEVCU_ON_GATTS(ESP_GATTS_REG_EVT, gattsRegister, reg),
+    GEVCU_ON_GATTS(ESP_GATTS_READ_EVT, gattsRead, read),
+    GEVCU_ON_GATTS(ESP_GATTS_WRITE_EVT, gattsWrite, write),
+    GEVCU_ON_GATTS(ESP_GATTS_EXEC_WRITE_EVT, gattsExecWrite, exec_write),
+    GEVCU_ON_GATTS(ESP_GATTS_MTU_EVT, gattsMtu, mtu),
+    GEVCU_ON_GATTS(ESP_GATTS_START_EVT, gattsStarted, start),
+    GEVCU_ON_GATTS(ESP_GATTS_CONNECT_EVT, gattsConnect, connect),
+    GEVCU_ON_GATTS(ESP_GATTS_DISCONNECT_EVT, gattsDisconnect, disconnect),
+    GEVCU_ON_GATTS(ESP_GATTS_CREAT_ATTR_TAB_EVT, gattsTableCreated, add_attr_tab),
+};
+
+//Runs on the BTC task: nothing but handing the event to the worker
+static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+    eventsQueueGap(event, param);
+}
+
+//Runs on the BTC task: nothing but handing the event to the worker
 static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, 
 									esp_ble_gatts_cb_param_t *param)
 {
-    ESP_LOGI(GEVCU_TABLE_TAG,"EVT %d, gatts if %d\n", event, gatts_if);
-
     /* If event is register event, store the gatts_if for each profile */
-    if (event == ESP_GATTS_REG_EVT) {
-        if (param->reg.status == ESP_GATT_OK) {
-            gevcu_profile_tab[GEVCU_PROFILE_APP_IDX].gatts_if = gatts_if;
-        } else {
-            ESP_LOGE(GEVCU_TABLE_TAG,"Reg app failed, app_id %04x, status %d\n",
-                    param->reg.app_id, 
-                    param->reg.status);
-            return;
-        }
+    if (event == ESP_GATTS_REG_EVT && param->reg.status == ESP_GATT_OK) {
+        gevcu_profile_tab[GEVCU_PROFILE_APP_IDX].gatts_if = gatts_if;
     }
-	
-    do {
-        int idx;
-        for (idx = 0; idx < GEVCU_PROFILE_NUM; idx++) {
-            if (gatts_if == ESP_GATT_IF_NONE || /* ESP_GATT_IF_NONE, not specify a certain gatt_if, need to call every profile cb function */
-                    gatts_if == gevcu_profile_tab[idx].gatts_if) {
-                if (gevcu_profile_tab[idx].gatts_cb) {
-                    gevcu_profile_tab[idx].gatts_cb(event, gatts_if, param);
-                }
-            }
-        }
-    } while (0);
+    /* ESP_GATT_IF_NONE, not specify a certain gatt_if, is for every profile */
+    if (gatts_if != ESP_GATT_IF_NONE && event != ESP_GATTS_REG_EVT &&
+        gatts_if != gevcu_profile_tab[GEVCU_PROFILE_APP_IDX].gatts_if) return;
+    eventsQueueGatts(event, gatts_if, param);
 }
 
 void app_main()
 {
     esp_err_t ret;
 
-    generateAttrTable();
+    //the cache starts out with the config of the last run, the tables below are created with it
+    ret = nvs_flash_init();
+    if (ret) {
+        ESP_LOGE(GEVCU_TABLE_TAG, "%s init nvs failed, config is not persisted\n", __func__);
+    }
+    else persistLoad();
+    bootMark(GEVCU_BOOT_NVS);
+
+    //GEVCU doesn't need BLE to talk to us, let it fill the cache while the stack comes up
+    traceStartTask();
+    spiStart();
+    bootMark(GEVCU_BOOT_SPI);
+    ESP_LOGI(GEVCU_TABLE_TAG,"Init of SPI complete");
 
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
     ret = esp_bt_controller_init(&bt_cfg);
@@ -714,73 +667,18 @@ void app_main()
         ESP_LOGE(GEVCU_TABLE_TAG,"%s enable bluetooth failed\n", __func__);
         return;
     }
+    bootMark(GEVCU_BOOT_BLUEDROID);
+    bondInit();
 
-    ESP_LOGI(GEVCU_TABLE_TAG,"%s %d\n", __func__, __LINE__);
-
+    //the rest of the boot runs from the REG event on, see the boot state machine
+    eventsStartTask(gevcu_gatts_events, sizeof(gevcu_gatts_events) / sizeof(gevcu_gatts_events[0]),
+                    gevcu_gap_events, sizeof(gevcu_gap_events) / sizeof(gevcu_gap_events[0]));
     esp_ble_gatts_register_callback(gatts_event_handler);
     esp_ble_gap_register_callback(gap_event_handler);
     esp_ble_gatts_app_register(ESP_GEVCU_APP_ID);
-    ESP_LOGI(GEVCU_TABLE_TAG,"%s %d\n", __func__, __LINE__);
-    
-    spiSetup();
-    ESP_LOGI(GEVCU_TABLE_TAG,"Init of SPI complete");
-    
-    char sendbuf[32]="";
-    char recvbuf[32]="";
-    memset(sendbuf, 0, 32);
-    memset(recvbuf, 0, 32);
-    spi_slave_transaction_t t;
-    spi_slave_transaction_t *r = 0;
-    memset(&t, 0, sizeof(t));
-    int n = 0;
-    
-    //test code copied from spi_slave example in esp-idf. Not what you'd want to do in final sketch
-    while(1) {
-        //Clear both buffers as we currently have nothing to actually transmit but we need to say we do 
-        //in order to fire up our slave SPI interface to find out what the master side wants when they send us data
-        memset(recvbuf,  0, 32);
-
-        //Set up a transaction of 32 bytes to send/receive
-        t.length=32*8; //length in bits... honestly?!
-        t.tx_buffer=sendbuf;
-        t.rx_buffer=recvbuf;
-        /* This call enables the SPI slave interface to send/receive to the sendbuf and recvbuf. The transaction is
-        initialized by the SPI master, however, so it will not actually happen until the master starts a hardware transaction
-        by pulling CS low and pulsing the clock etc. In this specific example, we use the handshake line, pulled up by the
-        .post_setup_cb callback that is called as soon as a transaction is ready, to let the master know it is free to transfer
-        data.
-        */
-        ret = spi_slave_tx(HSPI_HOST, &t, &r, portMAX_DELAY);
-
-        //spi_slave_transmit does not return until the master has done a transmission, so here we'll have the received data in recvbuf
-        
-        printf("Number of bytes received: %i\n", r->length / 8);
-        for (int i = 0; i < r->length / 8; i++) printf("%x ", recvbuf[i]);
-        printf("\n");
-        
-        if (recvbuf[0] == 0xA5)
-        {
-            if (recvbuf[1] == 0x40)
-            {
-                printf("Request to update a parameter: %i\n", recvbuf[2]);
-                //recvbuf[3]
-
-            }
-            else if (recvbuf[1] == 0xC0)
-            {
-                printf("Request to get current value of parameter: %i\n", recvbuf[2]);
-            }
-            else
-            {
-                printf("Received start byte but crap second byte. Ignoring.\n");
-            }
-        }
-        else
-        {
-            printf("Received some random garbage. Ignoring it.\n");
-        }
-    }
 
+    notifyStartTask();
+    persistStartTask();
     
     return;
 }
@@ -13,10 +13,17 @@
 // limitations under the License.
 
 
+#ifndef GATTSERVER_GEVCU_H
+#define GATTSERVER_GEVCU_H
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "esp_gatt_defs.h"
+#include "gevcu_varint.h"
+
 enum GATT_PRESENTATION_FORMAT
 {
   GATT_PRESENT_FORMAT_BOOLEAN = 0x01,
@@ -181,72 +188,517 @@ typedef struct
     const char *description;
     GATT_PRESENTATION_t presentation;
     uint8_t *data;
+    uint8_t param;              //GEVCU_PARAM_<field> of the value in params, GEVCU_PARAM_COUNT for none
+    uint16_t notifyInterval;    //minimum ms between two notifications
+    uint16_t notifyThreshold;   //minimum change of the value worth a notification
+    uint8_t notifyIdx;          //slot in the notifier or GEVCU_NOTIFY_NONE
+    uint16_t maxAge;            //ms a cached value may be old when read, 0 for no limit
+    //Value of rows without a param: read puts it into value (at most max bytes) for the central on
+    //conn_id and returns its length, write takes a whole new value from the central on conn_id and
+    //returns the ATT status to answer with. NULL for param rows.
+    int (*read)(uint16_t conn_id, uint8_t *value, int max);
+    esp_gatt_status_t (*write)(uint16_t conn_id, const uint8_t *value, int len);
 } GATT_CHARACTERISTIC_t;
 
+//Every value cached from GEVCU, in the order of the parameter ids used on the SPI link.
+//PARAM(type, name) rows expand into GEVCU_PARAM_CACHE_t and into GEVCU_PARAM_<name> ids.
+//Bump GEVCU_PARAM_LAYOUT_VERSION whenever the list changes, GEVCU checks it before sending a snapshot.
+#define GEVCU_PARAM_LAYOUT_VERSION  1
+#define GEVCU_PARAM_LIST(PARAM) \
+    PARAM(int16_t,  torqueRequested) \
+    PARAM(int16_t,  torqueActual) \
+    PARAM(int16_t,  throttleRawLevel1) \
+    PARAM(int16_t,  throttleRawLevel2) \
+    PARAM(int16_t,  brakeRawLevel) \
+    PARAM(int8_t,   throttlePercentage) \
+    PARAM(int8_t,   brakePercentage) \
+    PARAM(int16_t,  speedRequested) \
+    PARAM(int16_t,  speedActual) \
+    PARAM(uint8_t,  powerMode) \
+    PARAM(uint8_t,  gear) \
+    PARAM(uint8_t,  isRunning) \
+    PARAM(uint8_t,  isFaulted) \
+    PARAM(uint8_t,  isWarning) \
+    PARAM(uint8_t,  logLevel) \
+    PARAM(uint16_t, can0Speed) \
+    PARAM(uint16_t, can1Speed) \
+    PARAM(uint16_t, busVoltage) \
+    PARAM(int16_t,  busCurrent) \
+    PARAM(int16_t,  motorCurrent) \
+    PARAM(uint16_t, kwHours) \
+    PARAM(int16_t,  mechPower) \
+    PARAM(uint8_t,  SOC) \
+    PARAM(uint32_t, bitfield1) \
+    PARAM(uint32_t, bitfield2) \
+    PARAM(uint32_t, digitalInputs) \
+    PARAM(uint32_t, digitalOutputs) \
+    PARAM(int16_t,  motorTemperature) \
+    PARAM(int16_t,  inverterTemperature) \
+    PARAM(int16_t,  systemTemperature) \
+    PARAM(uint16_t, prechargeDuration) \
+    PARAM(uint8_t,  prechargeRelay) \
+    PARAM(uint8_t,  mainContRelay) \
+    PARAM(uint8_t,  coolingRelay) \
+    PARAM(int8_t,   coolOnTemp) \
+    PARAM(int8_t,   coolOffTemp) \
+    PARAM(uint8_t,  brakeLightOut) \
+    PARAM(uint8_t,  reverseLightOut) \
+    PARAM(uint8_t,  enableIn) \
+    PARAM(uint8_t,  reverseIn) \
+    PARAM(int16_t,  throttle1Min) \
+    PARAM(int16_t,  throttle2Min) \
+    PARAM(int16_t,  throttle1Max) \
+    PARAM(int16_t,  throttle2Max) \
+    PARAM(uint8_t,  numThrottlePots) \
+    PARAM(uint8_t,  throttleType) \
+    PARAM(uint16_t, throttleRegenMax) \
+    PARAM(uint16_t, throttleRegenMin) \
+    PARAM(uint16_t, throttleFwd) \
+    PARAM(uint16_t, throttleMap) \
+    PARAM(uint8_t,  throttleLowestRegen) \
+    PARAM(uint8_t,  throttleHighestRegen) \
+    PARAM(uint8_t,  throttleCreep) \
+    PARAM(int16_t,  brakeMin) \
+    PARAM(int16_t,  brakeMax) \
+    PARAM(uint8_t,  brakeRegenMin) \
+    PARAM(uint8_t,  brakeRegenMax) \
+    PARAM(uint16_t, nomVoltage) \
+    PARAM(uint16_t, maxRPM) \
+    PARAM(uint16_t, maxTorque) \
+    PARAM(uint32_t, deviceEnable1) \
+    PARAM(uint32_t, deviceEnable2) \
+    PARAM(uint32_t, timeRunning)
+
+#define GEVCU_PARAM_MEMBER(type, name) type name;
 typedef struct
 {
-    int16_t torqueRequested;
-    int16_t torqueActual;
-    int16_t throttleRawLevel1;
-    int16_t throttleRawLevel2;
-    int16_t brakeRawLevel;
-    int8_t throttlePercentage;
-    int8_t brakePercentage; 
-    int16_t speedRequested;
-    int16_t speedActual;
-    uint8_t powerMode;
-    uint8_t gear;
-    uint8_t isRunning;
-    uint8_t isFaulted;
-    uint8_t isWarning;
-    uint8_t logLevel;
-    uint16_t can0Speed;
-    uint16_t can1Speed;
-    uint16_t busVoltage;
-    int16_t busCurrent;
-    int16_t motorCurrent;
-    uint16_t kwHours;
-    int16_t mechPower;
-    uint8_t SOC;
-    uint32_t bitfield1;
-    uint32_t bitfield2;
-    uint32_t digitalInputs;
-    uint32_t digitalOutputs;
-    int16_t motorTemperature;
-    int16_t inverterTemperature;
-    int16_t systemTemperature;
-    uint16_t prechargeDuration;
-    uint8_t prechargeRelay;
-    uint8_t mainContRelay;
-    uint8_t coolingRelay;
-    int8_t coolOnTemp;
-    int8_t coolOffTemp;
-    uint8_t brakeLightOut;
-    uint8_t reverseLightOut;
-    uint8_t enableIn;
-    uint8_t reverseIn;
-    int16_t throttle1Min;
-    int16_t throttle2Min;
-    int16_t throttle1Max;
-    int16_t throttle2Max;   
-    uint8_t numThrottlePots;
-    uint8_t throttleType;
-    uint16_t throttleRegenMax; 
-    uint16_t throttleRegenMin; 
-    uint16_t throttleFwd; 
-    uint16_t throttleMap; 
-    uint8_t throttleLowestRegen; 
-    uint8_t throttleHighestRegen; 
-    uint8_t throttleCreep; 
-    int16_t brakeMin;
-    int16_t brakeMax;
-    uint8_t brakeRegenMin;
-    uint8_t brakeRegenMax;
-    uint16_t nomVoltage;
-    uint16_t maxRPM;
-    uint16_t maxTorque;
-    uint32_t deviceEnable1;
-    uint32_t deviceEnable2;
-    uint32_t timeRunning;
+    GEVCU_PARAM_LIST(GEVCU_PARAM_MEMBER)
 } GEVCU_PARAM_CACHE_t;
 
+#define GEVCU_PARAM_ID(type, name) GEVCU_PARAM_##name,
+enum { GEVCU_PARAM_LIST(GEVCU_PARAM_ID) GEVCU_PARAM_COUNT };
+
+//Fields of the telemetry frame characteristic, most wanted first. A frame carries as many of them as
+//fit the MTU of the connection: the first seven fit the 20 bytes of the default MTU.
+#define GEVCU_TELEMETRY_FIELDS(FIELD) \
+    FIELD(torqueActual) \
+    FIELD(speedActual) \
+    FIELD(motorCurrent) \
+    FIELD(busVoltage) \
+    FIELD(busCurrent) \
+    FIELD(mechPower) \
+    FIELD(SOC) \
+    FIELD(torqueRequested) \
+    FIELD(speedRequested) \
+    FIELD(motorTemperature) \
+    FIELD(inverterTemperature) \
+    FIELD(systemTemperature) \
+    FIELD(throttlePercentage) \
+    FIELD(brakePercentage) \
+    FIELD(powerMode) \
+    FIELD(gear) \
+    FIELD(isRunning) \
+    FIELD(isFaulted) \
+    FIELD(isWarning) \
+    FIELD(kwHours) \
+    FIELD(bitfield1) \
+    FIELD(timeRunning)
+
+//A telemetry frame is <version> <fields> <ms since boot, 32 bit> followed by that many fields of
+//GEVCU_TELEMETRY_FIELDS in list order, little endian, no padding.
+#define GEVCU_TELEMETRY_VERSION     1
+#define GEVCU_TELEMETRY_HEADER      6
+#define GEVCU_TELEMETRY_FIELD_SIZE(name) + sizeof(((GEVCU_PARAM_CACHE_t *)0)->name)
+#define GEVCU_TELEMETRY_MAX         (GEVCU_TELEMETRY_HEADER GEVCU_TELEMETRY_FIELDS(GEVCU_TELEMETRY_FIELD_SIZE))
+
+//The telemetry stream notifies the same fields as frames of <kind> <frame> <base frame> <bitmap> followed by
+//the zig-zag varint difference of every field with its bit set, in list order. The bitmap has a bit per field
+//of GEVCU_TELEMETRY_FIELDS, the first one in bit 0 of its first byte. kind is GEVCU_STREAM_VERSION << 2 plus
+//  GEVCU_STREAM_DELTA  differences to base frame, the last frame the central acknowledged. Fields without
+//                      their bit are as they were in it.
+//  GEVCU_STREAM_KEY    differences to 0, base frame means nothing. Sent to a central that hasn't acknowledged
+//                      anything yet and every GEVCU_STREAM_KEY_EVERY frames so a central can start over.
+//  GEVCU_STREAM_READ   what a read returns: a keyframe outside the stream, the numbers mean nothing.
+//A frame carries as many differences as fit the MTU, most wanted fields first. The others stay as they were in
+//base frame until a later frame has room for them. A central acknowledges a frame by writing its number, and
+//keeps the fields of the frames it got by number to decode later frames against.
+#define GEVCU_STREAM_VERSION        1
+#define GEVCU_STREAM_DELTA          0
+#define GEVCU_STREAM_KEY            1
+#define GEVCU_STREAM_READ           2
+#define GEVCU_STREAM_FIELD_COUNT(name) + 1
+#define GEVCU_STREAM_BITMAP         ((0 GEVCU_TELEMETRY_FIELDS(GEVCU_STREAM_FIELD_COUNT) + 7) / 8)
+#define GEVCU_STREAM_HEADER         (3 + GEVCU_STREAM_BITMAP)
+#define GEVCU_STREAM_FIELD_MAX(name) + GEVCU_VARINT_MAX(sizeof(((GEVCU_PARAM_CACHE_t *)0)->name))
+#define GEVCU_STREAM_MAX            (GEVCU_STREAM_HEADER GEVCU_TELEMETRY_FIELDS(GEVCU_STREAM_FIELD_MAX))
+
+//Fields of the config profile characteristic: the throttle and brake calibration, which only makes
+//sense as a whole.
+#define GEVCU_PROFILE_FIELDS(FIELD) \
+    FIELD(throttle1Min) \
+    FIELD(throttle2Min) \
+    FIELD(throttle1Max) \
+    FIELD(throttle2Max) \
+    FIELD(throttleRegenMax) \
+    FIELD(throttleRegenMin) \
+    FIELD(throttleFwd) \
+    FIELD(throttleMap) \
+    FIELD(throttleLowestRegen) \
+    FIELD(throttleHighestRegen) \
+    FIELD(throttleCreep) \
+    FIELD(brakeMin) \
+    FIELD(brakeMax) \
+    FIELD(brakeRegenMin) \
+    FIELD(brakeRegenMax) \
+    FIELD(numThrottlePots) \
+    FIELD(throttleType)
+
+//A profile blob is <version> <len> followed by len bytes: every field of GEVCU_PROFILE_FIELDS in list
+//order, little endian, no padding. Reading the characteristic gives <result> <profiles applied> and the
+//blob of what params holds now.
+#define GEVCU_PROFILE_VERSION       1
+#define GEVCU_PROFILE_HEADER        2
+#define GEVCU_PROFILE_STATUS        2
+#define GEVCU_PROFILE_FIELD_SIZE(name) + sizeof(((GEVCU_PARAM_CACHE_t *)0)->name)
+#define GEVCU_PROFILE_IMAGE         (0 GEVCU_PROFILE_FIELDS(GEVCU_PROFILE_FIELD_SIZE))
+#define GEVCU_PROFILE_MAX           (GEVCU_PROFILE_STATUS + GEVCU_PROFILE_HEADER + GEVCU_PROFILE_IMAGE)
+
+//Phases of the boot, in the order they are normally reached. The boot timing characteristic is
+//<phase count> followed by a u32 per phase: microseconds from power-on until it was reached, 0 if not yet.
+#define GEVCU_BOOT_PHASES(PHASE) \
+    PHASE(NVS)              /* config restored from NVS */ \
+    PHASE(SPI)              /* SPI slave ready for GEVCU */ \
+    PHASE(BLUEDROID)        /* controller and host stack enabled */ \
+    PHASE(REGISTERED)       /* app registered, tables and advertising data requested */ \
+    PHASE(ADV_DATA)         /* advertising data set */ \
+    PHASE(TABLES)           /* every attribute table created */ \
+    PHASE(SERVICES)         /* every service started */ \
+    PHASE(ADVERTISING)      /* advertising started, connectable */
+
+#define GEVCU_BOOT_SIZE(name)       + sizeof(uint32_t)
+#define GEVCU_BOOT_MAX              (1 GEVCU_BOOT_PHASES(GEVCU_BOOT_SIZE))
+
+//Fields of the history ring (see gevcu_history.h), sampled every GEVCU_HISTORY_PERIOD_MS. Bump
+//GEVCU_HISTORY_VERSION whenever the list or the period changes, clients decode chunks by it.
+#define GEVCU_HISTORY_VERSION       1
+#define GEVCU_HISTORY_PERIOD_MS     1000
+#define GEVCU_HISTORY_FIELDS(FIELD) \
+    FIELD(motorTemperature) \
+    FIELD(busCurrent) \
+    FIELD(torqueActual) \
+    FIELD(busVoltage) \
+    FIELD(SOC)
+
+//A history chunk is <version> <first record, 32 bit> <records> followed by that many records. Record n
+//was sampled (n + 1) * GEVCU_HISTORY_PERIOD_MS after boot. The first record of a chunk is every field of
+//GEVCU_HISTORY_FIELDS in list order as a zig-zag varint, the others are the zig-zag varint difference of
+//every field to the record before. Fields are their param type, differences wrap at 32 bit. Writing a
+//32 bit record number moves the stream of the central there.
+#define GEVCU_HISTORY_HEADER        6
+#define GEVCU_HISTORY_RESUME        4
+#define GEVCU_HISTORY_MAX           128
+
+//Every characteristic is one CHAR(id, properties, minLen, maxLen, maxAge, description, presentation format,
+//presentation unit, field in params) row in one of the service lists below. The lists are expanded at
+//compile time into GEVCU_Characteristics[] and into const attribute tables, so nothing
+//has to be built in RAM at boot and the tables live in flash. Only the value attributes point at RAM
+//(the fields of params).
+//Characteristics are grouped by what they are about into the services of GEVCU_SERVICES (motoring, BMS,
+//system status/config), which don't map one to one onto attribute tables:
+//The stack takes at most ESP_GATT_ATTR_HANDLE_MAX (100) attributes per table, about 24 characteristics.
+//A service that grows past that is split at boot into as many tables as it needs: the first keeps the
+//service UUID, the next ones are declared as id + GEVCU_SHARD_UUID_BASE + 1, + 2, ... so characteristic
+//ids of a service have to stay below id + GEVCU_SHARD_UUID_BASE. Add rows anywhere, nothing to re-balance.
+#define GEVCU_SHARD_UUID_BASE   0xF0
+//properties is one of
+//  R                        read only
+//  RW                       read and write
+//  RN(interval, threshold)  read and notify. Subscribed centrals get a notification when the value moved
+//                           by at least threshold (raw units) since the last one, at most every interval ms.
+//  FRAME(interval)          read and notify a packed telemetry frame instead of a single field. Notified
+//                           when any field in it changed.
+//  BLOB                     read and write a value of its own instead of a single field.
+//  STREAM(interval)         read, write and notify a value of its own that is different for every
+//                           central: where a central is in a stream it moves through by writing.
+//                           Notified at most every interval ms.
+//  DIAG                     read only value of its own, diagnostics.
+//Notify-capable characteristics (RN, FRAME, STREAM) get a Client Characteristic Configuration descriptor.
+//For FRAME, BLOB, STREAM and DIAG rows field names the module behind the value: it provides <field>Value, what
+//the attribute starts with, and <field>Read and (BLOB, STREAM) <field>Write.
+//maxAge is how old (ms since GEVCU or a central last stored it) the cached value may be when a central
+//reads it. An older value is fetched from GEVCU before the read is answered. 0 for values GEVCU keeps
+//sending anyway, which are always answered from the cache.
+
+#define GEVCU_PROP_R                    (ESP_GATT_CHAR_PROP_BIT_READ)
+#define GEVCU_PROP_RW                   (ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE)
+#define GEVCU_PROP_RN(interval, thresh) (ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY)
+#define GEVCU_PROP_FRAME(interval)      (ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY)
+#define GEVCU_PROP_BLOB                 (ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE)
+#define GEVCU_PROP_STREAM(interval)     (ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_NOTIFY)
+#define GEVCU_PROP_DIAG                 ESP_GATT_CHAR_PROP_BIT_READ
+#define GEVCU_PROPS(props)              GEVCU_PROP_##props
+
+#define GEVCU_INTERVAL_R                    0
+#define GEVCU_INTERVAL_RW                   0
+#define GEVCU_INTERVAL_RN(interval, thresh) interval
+#define GEVCU_INTERVAL_FRAME(interval)      interval
+#define GEVCU_INTERVAL_BLOB                 0
+#define GEVCU_INTERVAL_STREAM(interval)     interval
+#define GEVCU_INTERVAL_DIAG                 0
+#define GEVCU_NOTIFY_INTERVAL(props)        GEVCU_INTERVAL_##props
+
+#define GEVCU_THRESHOLD_R                    0
+#define GEVCU_THRESHOLD_RW                   0
+#define GEVCU_THRESHOLD_RN(interval, thresh) thresh
+#define GEVCU_THRESHOLD_FRAME(interval)      0
+#define GEVCU_THRESHOLD_BLOB                 0
+#define GEVCU_THRESHOLD_STREAM(interval)     0
+#define GEVCU_THRESHOLD_DIAG                 0
+#define GEVCU_NOTIFY_THRESHOLD(props)        GEVCU_THRESHOLD_##props
+
+//GEVCU_IF_NOTIFY(props, then, id, otherwise) expands to then(id) for notify-capable rows and to
+//otherwise for all others.
+#define GEVCU_IF_NOTIFY(props, then, id, otherwise)     GEVCU_IF_NOTIFY_##props(then, id, otherwise)
+#define GEVCU_IF_NOTIFY_R(then, id, otherwise)          otherwise
+#define GEVCU_IF_NOTIFY_RW(then, id, otherwise)         otherwise
+#define GEVCU_IF_NOTIFY_RN(interval, thresh)            GEVCU_IF_NOTIFY_THEN
+#define GEVCU_IF_NOTIFY_FRAME(interval)                 GEVCU_IF_NOTIFY_THEN
+#define GEVCU_IF_NOTIFY_BLOB(then, id, otherwise)       otherwise
+#define GEVCU_IF_NOTIFY_STREAM(interval)                GEVCU_IF_NOTIFY_THEN
+#define GEVCU_IF_NOTIFY_DIAG(then, id, otherwise)       otherwise
+#define GEVCU_IF_NOTIFY_THEN(then, id, otherwise)       then(id)
+
+//GEVCU_VALUE(props, field) is the data a value attribute starts with, GEVCU_VALUE_ID(props, field) the
+//param behind it and GEVCU_VALUE_READ/WRITE its read and write functions: the field of params and no
+//functions, or for FRAME, BLOB and DIAG rows the value and functions of their module and no param.
+#define GEVCU_VALUE(props, field)                       GEVCU_VALUE_##props(field)
+#define GEVCU_VALUE_R(field)                            ((uint8_t *)&params.field)
+#define GEVCU_VALUE_RW(field)                           ((uint8_t *)&params.field)
+#define GEVCU_VALUE_RN(interval, thresh)                GEVCU_VALUE_RW
+#define GEVCU_VALUE_FRAME(interval)                     GEVCU_VALUE_BLOB
+#define GEVCU_VALUE_BLOB(field)                         ((uint8_t *)field##Value)
+#define GEVCU_VALUE_STREAM(interval)                    GEVCU_VALUE_BLOB
+#define GEVCU_VALUE_DIAG                                GEVCU_VALUE_BLOB
+
+#define GEVCU_VALUE_ID(props, field)                    GEVCU_VALUE_ID_##props(field)
+#define GEVCU_VALUE_ID_R(field)                         GEVCU_PARAM_##field
+#define GEVCU_VALUE_ID_RW(field)                        GEVCU_PARAM_##field
+#define GEVCU_VALUE_ID_RN(interval, thresh)             GEVCU_VALUE_ID_RW
+#define GEVCU_VALUE_ID_FRAME(interval)                  GEVCU_VALUE_ID_BLOB
+#define GEVCU_VALUE_ID_BLOB(field)                      GEVCU_PARAM_COUNT
+#define GEVCU_VALUE_ID_STREAM(interval)                 GEVCU_VALUE_ID_BLOB
+#define GEVCU_VALUE_ID_DIAG                             GEVCU_VALUE_ID_BLOB
+
+#define GEVCU_VALUE_READ(props, field)                  GEVCU_VALUE_READ_##props(field)
+#define GEVCU_VALUE_READ_R(field)                       NULL
+#define GEVCU_VALUE_READ_RW(field)                      NULL
+#define GEVCU_VALUE_READ_RN(interval, thresh)           GEVCU_VALUE_READ_RW
+#define GEVCU_VALUE_READ_FRAME(interval)                GEVCU_VALUE_READ_BLOB
+#define GEVCU_VALUE_READ_BLOB(field)                    field##Read
+#define GEVCU_VALUE_READ_STREAM(interval)               GEVCU_VALUE_READ_BLOB
+#define GEVCU_VALUE_READ_DIAG                           GEVCU_VALUE_READ_BLOB
+
+#define GEVCU_VALUE_WRITE(props, field)                 GEVCU_VALUE_WRITE_##props(field)
+#define GEVCU_VALUE_WRITE_R(field)                      NULL
+#define GEVCU_VALUE_WRITE_RW(field)                     NULL
+#define GEVCU_VALUE_WRITE_RN(interval, thresh)          GEVCU_VALUE_WRITE_RW
+#define GEVCU_VALUE_WRITE_FRAME(interval)               GEVCU_VALUE_WRITE_R
+#define GEVCU_VALUE_WRITE_BLOB(field)                   field##Write
+#define GEVCU_VALUE_WRITE_STREAM(interval)              GEVCU_VALUE_WRITE_BLOB
+#define GEVCU_VALUE_WRITE_DIAG                          GEVCU_VALUE_WRITE_R
+
+//GEVCU_WRITE_LEN(props, maxLen) is the longest value a central writes: maxLen, or for STREAM rows where it is
+//in the stream, at most 32 bit however long what it reads is.
+#define GEVCU_WRITE_LEN(props, maxLen)                  GEVCU_WRITE_LEN_##props(maxLen)
+#define GEVCU_WRITE_LEN_R(maxLen)                       maxLen
+#define GEVCU_WRITE_LEN_RW(maxLen)                      maxLen
+#define GEVCU_WRITE_LEN_RN(interval, thresh)            GEVCU_WRITE_LEN_RW
+#define GEVCU_WRITE_LEN_FRAME(interval)                 GEVCU_WRITE_LEN_RW
+#define GEVCU_WRITE_LEN_BLOB(maxLen)                    maxLen
+#define GEVCU_WRITE_LEN_STREAM(interval)                GEVCU_WRITE_LEN_POSITION
+#define GEVCU_WRITE_LEN_POSITION(maxLen)                sizeof(uint32_t)
+#define GEVCU_WRITE_LEN_DIAG(maxLen)                    maxLen
+
+//0x3100 Service (Motor config / performance)
+#define GEVCU_MOTOR_CHARS(CHAR) \
+    CHAR(0x3101, RN(100, 2), 2, 2, 0, "TorqueRequested", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_MOMENT_OF_FORCE_NEWTON_METRE, torqueRequested) \
+    CHAR(0x3102, RN(100, 2), 2, 2, 0, "TorqueActual", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_MOMENT_OF_FORCE_NEWTON_METRE, torqueActual) \
+    CHAR(0x3103, RN(100, 10), 2, 2, 0, "SpeedRequested", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_ANGULAR_VELOCITY_REVOLUTION_PER_MINUTE, speedRequested) \
+    CHAR(0x3104, RN(100, 10), 2, 2, 0, "SpeedActual", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_ANGULAR_VELOCITY_REVOLUTION_PER_MINUTE, speedActual) \
+    CHAR(0x3105, RW, 1, 1, 1000, "PowerMode", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, powerMode) \
+    CHAR(0x3106, RW, 1, 1, 1000, "Gear", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, gear) \
+    CHAR(0x3107, RN(100, 1), 2, 2, 0, "Motor Current", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_ELECTRIC_CURRENT_AMPERE, motorCurrent) \
+    CHAR(0x3108, RN(100, 10), 2, 2, 0, "Mechanical Power", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_POWER_WATT, mechPower) \
+    CHAR(0x3109, RN(1000, 1), 2, 2, 0, "Motor Temperature", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, motorTemperature) \
+    CHAR(0x310A, RN(1000, 1), 2, 2, 0, "Inverter Temperature", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, inverterTemperature) \
+    CHAR(0x310B, RN(1000, 1), 2, 2, 0, "System Temperature", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, systemTemperature) \
+    CHAR(0x310C, RW, 2, 2, 10000, "Nominal Voltage", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_ELECTRIC_POTENTIAL_DIFFERENCE_VOLT, nomVoltage) \
+    CHAR(0x310D, RW, 2, 2, 10000, "Max RPMs", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_ANGULAR_VELOCITY_REVOLUTION_PER_MINUTE, maxRPM) \
+    CHAR(0x310E, RW, 2, 2, 10000, "Max Torque", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_MOMENT_OF_FORCE_NEWTON_METRE, maxTorque) \
+    CHAR(0x310F, RN(1000, 1), 4, 4, 0, "Time Running", \
+        GATT_PRESENT_FORMAT_UINT32, GATT_PRESENT_UNIT_TIME_SECOND, timeRunning) \
+    CHAR(0x3120, FRAME(50), GEVCU_TELEMETRY_HEADER, GEVCU_TELEMETRY_MAX, 0, "Telemetry Frame", \
+        GATT_PRESENT_FORMAT_STRUCT, GATT_PRESENT_UNIT_NONE, telemetry) \
+    CHAR(0x3121, STREAM(50), 1, GEVCU_STREAM_MAX, 0, "Telemetry Stream", \
+        GATT_PRESENT_FORMAT_STRUCT, GATT_PRESENT_UNIT_NONE, stream)
+
+//0x3200 Service (BMS and Throttle)
+#define GEVCU_BMS_CHARS(CHAR) \
+    CHAR(0x3201, RN(200, 1), 2, 2, 0, "HV Bus Voltage", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_ELECTRIC_POTENTIAL_DIFFERENCE_VOLT, busVoltage) \
+    CHAR(0x3202, RN(100, 1), 2, 2, 0, "HV Bus Current", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_ELECTRIC_CURRENT_AMPERE, busCurrent) \
+    CHAR(0x3203, R , 2, 2, 1000, "Kwh Remaining", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_ENERGY_KILOWATT_HOUR, kwHours) \
+    CHAR(0x3204, RN(1000, 1), 1, 1, 0, "State of Charge", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_PERCENTAGE, SOC) \
+    CHAR(0x3205, R , 2, 2, 1000, "ThrottleRaw1", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_NONE, throttleRawLevel1) \
+    CHAR(0x3206, R , 2, 2, 1000, "ThrottleRaw2", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_NONE, throttleRawLevel2) \
+    CHAR(0x3207, R , 2, 2, 1000, "BrakeRaw", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_NONE, brakeRawLevel) \
+    CHAR(0x3208, RW, 1, 1, 1000, "ThrottlePercentage", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_PERCENTAGE, throttlePercentage) \
+    CHAR(0x3209, RW, 1, 1, 1000, "BrakePercentage", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_PERCENTAGE, brakePercentage) \
+    CHAR(0x320A, RW, 2, 2, 10000, "Throttle 1 Min", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_NONE, throttle1Min) \
+    CHAR(0x320B, RW, 2, 2, 10000, "Throttle 2 Min", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_NONE, throttle2Min) \
+    CHAR(0x320C, RW, 2, 2, 10000, "Throttle 1 Max", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_NONE, throttle1Max) \
+    CHAR(0x320D, RW, 2, 2, 10000, "Throttle 2 Max", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_NONE, throttle2Max) \
+    CHAR(0x320E, RW, 2, 2, 10000, "Throttle Regen Max", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_PERCENTAGE, throttleRegenMax) \
+    CHAR(0x320F, RW, 2, 2, 10000, "Throttle Regen Min", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_PERCENTAGE, throttleRegenMin) \
+    CHAR(0x3210, RW, 2, 2, 10000, "Throttle Fwd Start", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_PERCENTAGE, throttleFwd) \
+    CHAR(0x3211, RW, 2, 2, 10000, "Throttle Map Point", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_PERCENTAGE, throttleMap) \
+    CHAR(0x3212, RW, 1, 1, 10000, "Throttle Min Regen", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_PERCENTAGE, throttleLowestRegen) \
+    CHAR(0x3213, RW, 1, 1, 10000, "Throttle Max Regen", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_PERCENTAGE, throttleHighestRegen) \
+    CHAR(0x3214, RW, 1, 1, 10000, "Throttle Creep", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_PERCENTAGE, throttleCreep) \
+    CHAR(0x3215, RW, 2, 2, 10000, "Brake Min", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_NONE, brakeMin) \
+    CHAR(0x3216, RW, 2, 2, 10000, "Brake Max", \
+        GATT_PRESENT_FORMAT_SINT16, GATT_PRESENT_UNIT_NONE, brakeMax) \
+    CHAR(0x3217, RW, 1, 1, 10000, "Brake Min Regen", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_PERCENTAGE, brakeRegenMin) \
+    CHAR(0x3218, RW, 1, 1, 10000, "Brake Max Regen", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_PERCENTAGE, brakeRegenMax)
+
+//0x3300 Service (System config and status)
+#define GEVCU_SYSTEM_CHARS(CHAR) \
+    CHAR(0x3301, RN(0, 0), 1, 1, 0, "isRunning", \
+        GATT_PRESENT_FORMAT_BOOLEAN, GATT_PRESENT_UNIT_NONE, isRunning) \
+    CHAR(0x3302, RN(0, 0), 1, 1, 0, "isFaulted", \
+        GATT_PRESENT_FORMAT_BOOLEAN, GATT_PRESENT_UNIT_NONE, isFaulted) \
+    CHAR(0x3303, RN(0, 0), 1, 1, 0, "isWarning", \
+        GATT_PRESENT_FORMAT_BOOLEAN, GATT_PRESENT_UNIT_NONE, isWarning) \
+    CHAR(0x3304, RW, 1, 1, 10000, "LoggingLevel", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, logLevel) \
+    CHAR(0x3305, RW, 2, 2, 10000, "Can0 Bitrate", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_FREQUENCY_HERTZ, can0Speed) \
+    CHAR(0x3306, RW, 2, 2, 10000, "Can1 Bitrate", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_FREQUENCY_HERTZ, can1Speed) \
+    CHAR(0x3307, R , 4, 4, 1000, "Status Bitfield 1", \
+        GATT_PRESENT_FORMAT_UINT32, GATT_PRESENT_UNIT_NONE, bitfield1) \
+    CHAR(0x3308, R , 4, 4, 1000, "Status Bitfield 2", \
+        GATT_PRESENT_FORMAT_UINT32, GATT_PRESENT_UNIT_NONE, bitfield2) \
+    CHAR(0x3309, R , 4, 4, 1000, "Dig In Bitfield", \
+        GATT_PRESENT_FORMAT_UINT32, GATT_PRESENT_UNIT_NONE, digitalInputs) \
+    CHAR(0x330A, R , 4, 4, 1000, "Dig Out Bitfield", \
+        GATT_PRESENT_FORMAT_UINT32, GATT_PRESENT_UNIT_NONE, digitalOutputs) \
+    CHAR(0x330B, RW, 2, 2, 10000, "Precharge Time", \
+        GATT_PRESENT_FORMAT_UINT16, GATT_PRESENT_UNIT_TIME_SECOND, prechargeDuration) \
+    CHAR(0x330C, RW, 1, 1, 10000, "Precharge Output", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, prechargeRelay) \
+    CHAR(0x330D, RW, 1, 1, 10000, "Main Contactor Output", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, mainContRelay) \
+    CHAR(0x330E, RW, 1, 1, 10000, "Cooling Relay Output", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, coolingRelay) \
+    CHAR(0x330F, RW, 1, 1, 10000, "Cool On Temperature", \
+        GATT_PRESENT_FORMAT_SINT8, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, coolOnTemp) \
+    CHAR(0x3310, RW, 1, 1, 10000, "Cool Off Temperature", \
+        GATT_PRESENT_FORMAT_SINT8, GATT_PRESENT_UNIT_THERMODYNAMIC_TEMPERATURE_DEGREE_FAHRENHEIT, coolOffTemp) \
+    CHAR(0x3311, RW, 1, 1, 10000, "Brake Light Output", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, brakeLightOut) \
+    CHAR(0x3312, RW, 1, 1, 10000, "Reverse Light Output", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, reverseLightOut) \
+    CHAR(0x3313, RW, 1, 1, 10000, "Enable Input", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, enableIn) \
+    CHAR(0x3314, RW, 1, 1, 10000, "Reverse Input", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, reverseIn) \
+    CHAR(0x3315, RW, 4, 4, 10000, "Device Enable Bits1", \
+        GATT_PRESENT_FORMAT_UINT32, GATT_PRESENT_UNIT_NONE, deviceEnable1) \
+    CHAR(0x3316, RW, 4, 4, 10000, "Device Enable Bits2", \
+        GATT_PRESENT_FORMAT_UINT32, GATT_PRESENT_UNIT_NONE, deviceEnable2) \
+    CHAR(0x3317, RW, 1, 1, 10000, "Num Throttle Pots", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, numThrottlePots) \
+    CHAR(0x3318, RW, 1, 1, 10000, "Throttle Type", \
+        GATT_PRESENT_FORMAT_UINT8, GATT_PRESENT_UNIT_NONE, throttleType) \
+    CHAR(0x3319, BLOB, GEVCU_PROFILE_HEADER, GEVCU_PROFILE_MAX, 0, "Config Profile", \
+        GATT_PRESENT_FORMAT_STRUCT, GATT_PRESENT_UNIT_NONE, profile) \
+    CHAR(0x331A, DIAG, 1, GEVCU_BOOT_MAX, 0, "Boot Timing", \
+        GATT_PRESENT_FORMAT_STRUCT, GATT_PRESENT_UNIT_NONE, boot) \
+    CHAR(0x331B, STREAM(0), GEVCU_HISTORY_RESUME, GEVCU_HISTORY_MAX, 0, "History", \
+        GATT_PRESENT_FORMAT_STRUCT, GATT_PRESENT_UNIT_NONE, history)
+
+#define GEVCU_SERVICES(SERVICE) \
+    SERVICE(0x3100, GEVCU_MOTOR_CHARS) \
+    SERVICE(0x3200, GEVCU_BMS_CHARS) \
+    SERVICE(0x3300, GEVCU_SYSTEM_CHARS)
+
+//Index of every row of GEVCU_Characteristics[], named after the characteristic or service id.
+#define GEVCU_INDEX_CHAR(id, ...) GEVCU_IDX_##id,
+#define GEVCU_INDEX_SERVICE(id, CHARS) GEVCU_IDX_##id, CHARS(GEVCU_INDEX_CHAR)
+enum { GEVCU_SERVICES(GEVCU_INDEX_SERVICE) GEVCU_IDX_END };
+
+//Slot of every notify-capable characteristic in the notifier
+#define GEVCU_NOTIFY_SLOT(id) GEVCU_NOTIFY_IDX_##id,
+#define GEVCU_NOTIFY_CHAR(id, props, ...) GEVCU_IF_NOTIFY(props, GEVCU_NOTIFY_SLOT, id, )
+#define GEVCU_NOTIFY_SERVICE(id, CHARS) CHARS(GEVCU_NOTIFY_CHAR)
+enum { GEVCU_SERVICES(GEVCU_NOTIFY_SERVICE) GEVCU_NOTIFY_COUNT };
+#define GEVCU_NOTIFY_NONE   0xFF
+
+extern const GATT_CHARACTERISTIC_t GEVCU_Characteristics[];
+
+
+//Role of an attribute handle within its characteristic, as returned by findCharacteristic()
+enum GEVCU_ATTR_ROLE
+{
+  GEVCU_ATTR_SERVICE       = 0,
+  GEVCU_ATTR_DECLARATION   = 1,
+  GEVCU_ATTR_VALUE         = 2,
+  GEVCU_ATTR_DESCRIPTION   = 3,
+  GEVCU_ATTR_PRESENTATION  = 4,
+  GEVCU_ATTR_CLIENT_CONFIG = 5,
+};
+
+//Returns the characteristic (or service) an attribute handle belongs to and optionally its role,
+//NULL if the handle isn't one of ours.
+const GATT_CHARACTERISTIC_t *findCharacteristic(uint16_t handle, uint8_t *role);
+
+extern GEVCU_PARAM_CACHE_t params;
+
+#endif
@@ -0,0 +1,202 @@
+//Advertising data. See gevcu_adv.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_gap_ble_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_adv.h"
+#include "gevcu_bond.h"
+#include "gevcu_params.h"
+#include "gevcu_trace.h"
+
+//Flags (3), 128 bit service UUID (18) and the manufacturer block (2 + its length) share 31 bytes. Nonzero
+//min/max_interval would add a 6 byte connection interval range, that one only goes in the scan response.
+_Static_assert(3 + 18 + 2 + GEVCU_ADV_MANUFACTURER_LEN <= 31, "manufacturer data no longer fits the advert");
+
+static uint8_t gevcu_service_uuid[16] = {
+    /* LSB <--------------------------------------------------------------------------------> MSB */
+    //first uuid, 16bit, [12],[13] is the value
+    0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0x31, 0x00, 0x00, 0x00,
+};
+
+static uint8_t advManufacturer[GEVCU_ADV_MANUFACTURER_LEN];
+
+static esp_ble_adv_data_t gevcu_adv_config = {
+    .set_scan_rsp = false,
+    .include_name = false,
+    .include_txpower = false,
+    .min_interval = 0,
+    .max_interval = 0,
+    .appearance = 0x00,
+    .manufacturer_len = sizeof(advManufacturer),
+    .p_manufacturer_data = advManufacturer,
+    .service_data_len = 0,
+    .p_service_data = NULL,
+    .service_uuid_len = sizeof(gevcu_service_uuid),
+    .p_service_uuid = gevcu_service_uuid,
+    .flag = (ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT),
+};
+
+static esp_ble_adv_data_t gevcu_scan_rsp_config = {
+    .set_scan_rsp = true,
+    .include_name = true,
+    .include_txpower = true,
+    .min_interval = 0x20,
+    .max_interval = 0x40,
+    .appearance = 0x00,
+    .manufacturer_len = 0,
+    .p_manufacturer_data = NULL,
+    .service_data_len = 0,
+    .p_service_data = NULL,
+    .service_uuid_len = 0,
+    .p_service_uuid = NULL,
+    .flag = 0,
+};
+
+static esp_ble_adv_params_t gevcu_adv_params = {
+    .adv_int_min        = GEVCU_ADV_FAST_MIN,
+    .adv_int_max        = GEVCU_ADV_FAST_MAX,
+    .adv_type           = ADV_TYPE_IND,
+    .own_addr_type      = BLE_ADDR_TYPE_PUBLIC,
+    .channel_map        = ADV_CHNL_ALL,
+    .adv_filter_policy  = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+};
+
+//The event worker starts and stops advertising on connection events, the notifier task moves the
+//schedule along. Both go through advLock so the stack gets the calls in the order they were decided.
+static SemaphoreHandle_t advLock;
+static uint8_t advPhaseNow = GEVCU_ADV_OFF;
+static TickType_t advPhaseAt;
+
+static uint32_t advVersion;         //params version the last poll looked at
+static uint8_t advDirty;            //a field changed since the last refresh
+static TickType_t advRefreshed;
+
+//Fill block from one consistent copy of params
+static void advPack(uint8_t *block)
+{
+    GEVCU_PARAM_CACHE_t copy;
+
+    paramsSnapshot(&copy);
+    block[0] = GEVCU_ADV_COMPANY_ID & 0xFF;
+    block[1] = GEVCU_ADV_COMPANY_ID >> 8;
+    block[2] = GEVCU_ADV_VERSION;
+    block[3] = copy.SOC;
+    block[4] = (copy.isRunning ? GEVCU_ADV_RUNNING : 0) | (copy.isFaulted ? GEVCU_ADV_FAULTED : 0) |
+               (copy.isWarning ? GEVCU_ADV_WARNING : 0);
+    block[5] = copy.busVoltage & 0xFF;
+    block[6] = copy.busVoltage >> 8;
+}
+
+void advConfigure(void)
+{
+    if (!advLock) advLock = xSemaphoreCreateMutex();
+    advVersion = paramsVersion();
+    advPack(advManufacturer);
+    advRefreshed = xTaskGetTickCount();
+    esp_ble_gap_config_adv_data(&gevcu_adv_config);
+    esp_ble_gap_config_adv_data(&gevcu_scan_rsp_config);
+}
+
+//Go to phase. Called with advLock held.
+static void advSwitch(uint8_t phase)
+{
+    esp_ble_adv_params_t adv = gevcu_adv_params;
+
+    if (advPhaseNow != GEVCU_ADV_OFF) esp_ble_gap_stop_advertising();
+    if (phase == GEVCU_ADV_DIRECTED)
+    {
+        //the interval doesn't apply, high duty directed goes out as fast as the controller can
+        adv.adv_type = ADV_TYPE_DIRECT_IND_HIGH;
+        bondLastCentral(adv.peer_addr, &adv.peer_addr_type);
+    }
+    else if (phase == GEVCU_ADV_SLOW)
+    {
+        adv.adv_int_min = GEVCU_ADV_SLOW_MIN;
+        adv.adv_int_max = GEVCU_ADV_SLOW_MAX;
+    }
+    advPhaseNow = phase;
+    advPhaseAt = xTaskGetTickCount();
+    if (phase != GEVCU_ADV_OFF) esp_ble_gap_start_advertising(&adv);
+    TRACE(ADV_PHASE, GEVCU_TRACE_NO_ROW, phase, 0);
+}
+
+void advStart(uint8_t directed)
+{
+    esp_bd_addr_t peer;
+    esp_ble_addr_type_t type;
+
+    xSemaphoreTake(advLock, portMAX_DELAY);
+    advSwitch(directed && bondLastCentral(peer, &type) ? GEVCU_ADV_DIRECTED : GEVCU_ADV_FAST);
+    xSemaphoreGive(advLock);
+}
+
+void advStopped(void)
+{
+    xSemaphoreTake(advLock, portMAX_DELAY);
+    advPhaseNow = GEVCU_ADV_OFF;
+    xSemaphoreGive(advLock);
+}
+
+uint8_t advPhase(void)
+{
+    return advPhaseNow;
+}
+
+//Next phase of the schedule once the current one ran its time
+static void advSchedule(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    if (!advLock) return;
+    xSemaphoreTake(advLock, portMAX_DELAY);
+    if (advPhaseNow == GEVCU_ADV_DIRECTED && (now - advPhaseAt) >= pdMS_TO_TICKS(GEVCU_ADV_DIRECTED_MS))
+    {
+        advSwitch(GEVCU_ADV_FAST);
+    }
+    else if (advPhaseNow == GEVCU_ADV_FAST && (now - advPhaseAt) >= pdMS_TO_TICKS(GEVCU_ADV_FAST_MS))
+    {
+        advSwitch(GEVCU_ADV_SLOW);
+    }
+    xSemaphoreGive(advLock);
+}
+
+int advPoll(void)
+{
+    uint32_t changed[GEVCU_PARAM_BITMAP_WORDS];
+    uint8_t block[GEVCU_ADV_MANUFACTURER_LEN], previous[GEVCU_ADV_MANUFACTURER_LEN];
+
+    advSchedule();
+
+    if (paramsVersion() != advVersion)
+    {
+        advVersion = paramsChangedSince(advVersion, changed);
+        if (PARAM_BIT_TEST(changed, GEVCU_PARAM_SOC) || PARAM_BIT_TEST(changed, GEVCU_PARAM_isRunning) ||
+            PARAM_BIT_TEST(changed, GEVCU_PARAM_isFaulted) || PARAM_BIT_TEST(changed, GEVCU_PARAM_isWarning) ||
+            PARAM_BIT_TEST(changed, GEVCU_PARAM_busVoltage)) advDirty = 1;
+    }
+    if (!advDirty || (xTaskGetTickCount() - advRefreshed) < pdMS_TO_TICKS(GEVCU_ADV_REFRESH_MS)) return 0;
+
+    //fields that went and came back in the meantime aren't worth rebuilding the advert for
+    advDirty = 0;
+    advPack(block);
+    if (memcmp(block, advManufacturer, sizeof(block)) == 0) return 0;
+
+    memcpy(previous, advManufacturer, sizeof(previous));
+    memcpy(advManufacturer, block, sizeof(block));
+    //the stack copies the data before this returns
+    if (esp_ble_gap_config_adv_data(&gevcu_adv_config) != ESP_OK)
+    {
+        memcpy(advManufacturer, previous, sizeof(previous));
+        advDirty = 1;
+        return 0;
+    }
+    advRefreshed = xTaskGetTickCount();
+    TRACE(ADV_REFRESH, GEVCU_TRACE_NO_ROW, block[3], block[4]);
+    return 1;
+}
@@ -0,0 +1,63 @@
+//Advertising data. Besides the service UUID every advert carries a manufacturer data block with the
+//state a fleet scanner wants to see without connecting:
+//
+//  <company id 0xFFFF, 2> <version> <SOC %> <status> <busVoltage, 2>
+//
+//status bit 0 isRunning, bit 1 isFaulted, bit 2 isWarning. Multi byte values little endian. The name
+//and tx power moved to the scan response to make room. The block is rebuilt from params when one of
+//its fields changes, at most every GEVCU_ADV_REFRESH_MS.
+
+#ifndef GEVCU_ADV_H
+#define GEVCU_ADV_H
+
+#include <stdint.h>
+
+//No company id assigned, 0xFFFF is the one for testing and internal use
+#define GEVCU_ADV_COMPANY_ID        0xFFFF
+#define GEVCU_ADV_VERSION           1
+#define GEVCU_ADV_MANUFACTURER_LEN  7
+#define GEVCU_ADV_RUNNING           0x01
+#define GEVCU_ADV_FAULTED           0x02
+#define GEVCU_ADV_WARNING           0x04
+
+//Shortest time between two refreshes of the advertising data
+#define GEVCU_ADV_REFRESH_MS        1000
+
+//Advertising schedule. When the last bonded central drops out (or the car is switched on) the ECU
+//advertises high duty directed at it, which it answers within a few ms if it is in range. After that,
+//and right away for anyone else, undirected at the fast interval and after GEVCU_ADV_FAST_MS at the
+//slow one to save power. Intervals in 0.625 ms units.
+#define GEVCU_ADV_PHASES(PHASE) \
+    PHASE(OFF) \
+    PHASE(DIRECTED) \
+    PHASE(FAST) \
+    PHASE(SLOW)
+#define GEVCU_ADV_PHASE_ID(name) GEVCU_ADV_##name,
+enum { GEVCU_ADV_PHASES(GEVCU_ADV_PHASE_ID) GEVCU_ADV_PHASE_COUNT };
+
+//The controller ends high duty directed advertising after 1.28 s
+#define GEVCU_ADV_DIRECTED_MS       1280
+#define GEVCU_ADV_FAST_MS           30000
+#define GEVCU_ADV_FAST_MIN          0x0020      //20 ms
+#define GEVCU_ADV_FAST_MAX          0x0030      //30 ms
+#define GEVCU_ADV_SLOW_MIN          0x029B      //417.5 ms
+#define GEVCU_ADV_SLOW_MAX          0x036A      //546.25 ms
+
+//Hand the advertising data and scan response to the stack, at registration
+void advConfigure(void);
+
+//(Re)start the schedule: directed at the last bonded central first if directed is set and there is
+//one, undirected otherwise. Whatever advertising was going on is stopped.
+void advStart(uint8_t directed);
+
+//The controller stopped advertising because a central connected
+void advStopped(void);
+
+//Phase of the schedule advertising is in
+uint8_t advPhase(void);
+
+//Move the schedule along and refresh the advertising data if a field of the manufacturer block
+//changed and the last refresh is long enough ago. Returns 1 if the data was refreshed.
+int advPoll(void);
+
+#endif
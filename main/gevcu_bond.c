@@ -0,0 +1,152 @@
+//Bonding. See gevcu_bond.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_gap_ble_api.h"
+#include "nvs.h"
+
+#include "gevcu_bond.h"
+#include "gevcu_persist.h"
+#include "gevcu_trace.h"
+
+//Written on the event worker, read by the notifier task when it moves advertising along
+static portMUX_TYPE bondMux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t bondKnown;
+static esp_ble_addr_type_t bondType;
+static esp_bd_addr_t bondAddress;
+
+void bondInit(void)
+{
+    esp_ble_auth_req_t auth = ESP_LE_AUTH_BOND;
+    esp_ble_io_cap_t iocap = ESP_IO_CAP_NONE;
+    uint8_t keys = ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK;
+    uint8_t keySize = 16;
+    uint8_t record[1 + sizeof(esp_bd_addr_t)];
+    size_t len = sizeof(record);
+    nvs_handle handle;
+
+    esp_ble_gap_set_security_param(ESP_BLE_SM_AUTHEN_REQ_MODE, &auth, sizeof(auth));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_IOCAP_MODE, &iocap, sizeof(iocap));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_MAX_KEY_SIZE, &keySize, sizeof(keySize));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_SET_INIT_KEY, &keys, sizeof(keys));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_SET_RSP_KEY, &keys, sizeof(keys));
+
+    if (nvs_open(GEVCU_PERSIST_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    if (nvs_get_blob(handle, GEVCU_BOND_KEY, record, &len) == ESP_OK && len == sizeof(record) &&
+        bondDirectable(&record[1], record[0]))
+    {
+        bondType = record[0];
+        memcpy(bondAddress, &record[1], sizeof(esp_bd_addr_t));
+        bondKnown = 1;
+    }
+    nvs_close(handle);
+}
+
+//No central to call back any more. Costs a flash write only if there was one.
+static void bondForget(void)
+{
+    nvs_handle handle;
+    esp_err_t err;
+    int known;
+
+    portENTER_CRITICAL(&bondMux);
+    known = bondKnown;
+    bondKnown = 0;
+    portEXIT_CRITICAL(&bondMux);
+    if (!known) return;
+
+    err = nvs_open(GEVCU_PERSIST_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_erase_key(handle, GEVCU_BOND_KEY);
+        if (err == ESP_OK) err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) TRACE(PERSIST_FAILED, GEVCU_TRACE_NO_ROW, 2, err);
+}
+
+void bondConnect(const esp_bd_addr_t bda)
+{
+    esp_bd_addr_t address;
+
+    memcpy(address, bda, sizeof(address));
+    esp_ble_set_encryption(address, ESP_BLE_SEC_ENCRYPT_NO_MITM);
+}
+
+void bondSecurityRequest(const esp_ble_sec_req_t *req)
+{
+    esp_bd_addr_t address;
+
+    memcpy(address, req->bd_addr, sizeof(address));
+    esp_ble_gap_security_rsp(address, true);
+}
+
+void bondAuthComplete(const esp_ble_auth_cmpl_t *auth)
+{
+    uint8_t record[1 + sizeof(esp_bd_addr_t)];
+    nvs_handle handle;
+    esp_err_t err;
+
+    if (!auth->success)
+    {
+        TRACE(BOND_FAILED, GEVCU_TRACE_NO_ROW, auth->fail_reason, 0);
+        return;
+    }
+    TRACE(BOND_DONE, GEVCU_TRACE_NO_ROW, auth->bd_addr[4] << 8 | auth->bd_addr[5], auth->addr_type);
+    //the central the car was last used with can't be called back, nor can the one before it be
+    if (!bondDirectable(auth->bd_addr, auth->addr_type))
+    {
+        TRACE(BOND_PRIVATE, GEVCU_TRACE_NO_ROW, auth->bd_addr[4] << 8 | auth->bd_addr[5], 0);
+        bondForget();
+        return;
+    }
+    if (bondIsLast(auth->bd_addr)) return;
+
+    portENTER_CRITICAL(&bondMux);
+    bondType = auth->addr_type;
+    memcpy(bondAddress, auth->bd_addr, sizeof(esp_bd_addr_t));
+    bondKnown = 1;
+    portEXIT_CRITICAL(&bondMux);
+
+    //only a new central costs a flash write, reconnects of the same one don't
+    record[0] = auth->addr_type;
+    memcpy(&record[1], auth->bd_addr, sizeof(esp_bd_addr_t));
+    err = nvs_open(GEVCU_PERSIST_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, GEVCU_BOND_KEY, record, sizeof(record));
+        if (err == ESP_OK) err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) TRACE(PERSIST_FAILED, GEVCU_TRACE_NO_ROW, 2, err);
+}
+
+int bondLastCentral(esp_bd_addr_t bda, esp_ble_addr_type_t *type)
+{
+    int known;
+
+    portENTER_CRITICAL(&bondMux);
+    known = bondKnown;
+    memcpy(bda, bondAddress, sizeof(esp_bd_addr_t));
+    *type = bondType;
+    portEXIT_CRITICAL(&bondMux);
+    return known;
+}
+
+int bondDirectable(const esp_bd_addr_t bda, esp_ble_addr_type_t type)
+{
+    //the top two bits of a random address tell static (11) from resolvable private (01) and non-resolvable (00)
+    return type == BLE_ADDR_TYPE_PUBLIC || (type == BLE_ADDR_TYPE_RANDOM && (bda[0] & 0xC0) == 0xC0);
+}
+
+int bondIsLast(const esp_bd_addr_t bda)
+{
+    int last;
+
+    portENTER_CRITICAL(&bondMux);
+    last = bondKnown && memcmp(bda, bondAddress, sizeof(esp_bd_addr_t)) == 0;
+    portEXIT_CRITICAL(&bondMux);
+    return last;
+}
@@ -0,0 +1,39 @@
+//Bonding. Centrals pair with Just Works (the ECU has neither display nor keys) and are bonded, the
+//stack keeps their keys. The last central that bonded is remembered here as well, in NVS, so that
+//advertising can be directed at it when it drops out or the car is switched on. Only a central with a
+//public or static address is: most phones connect from a resolvable private address that rotates, and
+//this Bluedroid gives the app neither their identity address nor a resolving list for the controller,
+//so a directed advert would go to an address nobody answers to any more.
+
+#ifndef GEVCU_BOND_H
+#define GEVCU_BOND_H
+
+#include <stdint.h>
+
+#include "esp_gap_ble_api.h"
+
+//NVS key of the last bonded central, in GEVCU_PERSIST_NAMESPACE: <address type> <address, 6>
+#define GEVCU_BOND_KEY          "central"
+
+//Set the security parameters and load the last bonded central. After Bluedroid is enabled.
+void bondInit(void);
+
+//The central with bda connected, encrypt the link (and pair it if it isn't bonded yet)
+void bondConnect(const esp_bd_addr_t bda);
+
+//A central asked for security (ESP_GAP_BLE_SEC_REQ_EVT)
+void bondSecurityRequest(const esp_ble_sec_req_t *req);
+
+//Pairing or encryption finished (ESP_GAP_BLE_AUTH_CMPL_EVT)
+void bondAuthComplete(const esp_ble_auth_cmpl_t *auth);
+
+//Address of the last bonded central into bda and *type. Returns 0 if no central has bonded yet.
+int bondLastCentral(esp_bd_addr_t bda, esp_ble_addr_type_t *type);
+
+//1 if a central at bda of type can be called back with directed advertising
+int bondDirectable(const esp_bd_addr_t bda, esp_ble_addr_type_t type);
+
+//1 if bda is the last bonded central
+int bondIsLast(const esp_bd_addr_t bda);
+
+#endif
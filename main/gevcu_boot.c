@@ -0,0 +1,50 @@
+//Boot timing. See gevcu_boot.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "xtensa/hal.h"
+#include "sdkconfig.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_boot.h"
+#include "gevcu_trace.h"
+
+uint8_t bootValue[GEVCU_BOOT_MAX] = { GEVCU_BOOT_COUNT };
+
+//Phases are marked from app_main and the event worker, each only once
+static volatile uint32_t bootAt[GEVCU_BOOT_COUNT];
+
+void bootMark(uint8_t phase)
+{
+    //the cycle counter starts at reset and wraps after ~18 s, long after boot is over
+    uint32_t now = xthal_get_ccount() / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+
+    if (phase >= GEVCU_BOOT_COUNT || bootAt[phase]) return;
+    bootAt[phase] = now ? now : 1;
+    TRACE(BOOT_PHASE, GEVCU_TRACE_NO_ROW, phase, bootAt[phase]);
+}
+
+int bootReached(uint8_t phase)
+{
+    return phase < GEVCU_BOOT_COUNT && bootAt[phase] != 0;
+}
+
+uint32_t bootTime(uint8_t phase)
+{
+    return phase < GEVCU_BOOT_COUNT ? bootAt[phase] : 0;
+}
+
+int bootRead(uint16_t conn_id, uint8_t *value, int max)
+{
+    uint8_t timing[GEVCU_BOOT_MAX] = { GEVCU_BOOT_COUNT };
+    int len = GEVCU_BOOT_MAX < max ? GEVCU_BOOT_MAX : max;
+
+    for (int phase = 0; phase < GEVCU_BOOT_COUNT; phase++)
+    {
+        uint32_t at = bootAt[phase];
+        memcpy(&timing[1 + phase * sizeof(at)], &at, sizeof(at));
+    }
+    memcpy(value, timing, len);
+    return len;
+}
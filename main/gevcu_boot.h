@@ -0,0 +1,29 @@
+//Boot timing. Time stamps each of GEVCU_BOOT_PHASES the first time it is reached and serves them
+//through the boot timing characteristic, so the time from power-on to connectable can be read back
+//from a car that was just switched on.
+
+#ifndef GEVCU_BOOT_H
+#define GEVCU_BOOT_H
+
+#include <stdint.h>
+
+#include "GattServer_GEVCU.h"
+
+#define GEVCU_BOOT_ID(name) GEVCU_BOOT_##name,
+enum { GEVCU_BOOT_PHASES(GEVCU_BOOT_ID) GEVCU_BOOT_COUNT };
+
+//What the boot timing attribute holds when the table is created. Reads are packed fresh.
+extern uint8_t bootValue[GEVCU_BOOT_MAX];
+
+//phase is reached now. Later calls for the same phase are ignored.
+void bootMark(uint8_t phase);
+
+int bootReached(uint8_t phase);
+
+//Microseconds from power-on until phase was reached, 0 if it wasn't
+uint32_t bootTime(uint8_t phase);
+
+//Read function of the boot timing characteristic
+int bootRead(uint16_t conn_id, uint8_t *value, int max);
+
+#endif
@@ -0,0 +1,124 @@
+//Connections. See gevcu_conn.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_gatts_api.h"
+
+#include "gevcu_conn.h"
+#include "gevcu_trace.h"
+
+_Static_assert(GEVCU_CONN_MAX < GEVCU_CONN_NONE, "connection slots no longer fit uint8_t");
+
+//The event worker opens and closes connections, the notifier and read paths look them up
+static portMUX_TYPE connMux = portMUX_INITIALIZER_UNLOCKED;
+static GEVCU_CONN_t connTable[GEVCU_CONN_MAX];
+static uint8_t connOpenCount;
+
+//Called with connMux held
+static uint8_t findSlot(uint16_t conn_id)
+{
+    for (int i = 0; i < GEVCU_CONN_MAX; i++)
+    {
+        if (connTable[i].used && connTable[i].connId == conn_id) return i;
+    }
+    return GEVCU_CONN_NONE;
+}
+
+uint8_t connOpen(esp_gatt_if_t gatts_if, uint16_t conn_id, const esp_bd_addr_t bda)
+{
+    uint8_t slot;
+
+    portENTER_CRITICAL(&connMux);
+    slot = findSlot(conn_id);
+    for (int i = 0; i < GEVCU_CONN_MAX && slot == GEVCU_CONN_NONE; i++)
+    {
+        if (!connTable[i].used) slot = i;
+    }
+    if (slot != GEVCU_CONN_NONE && !connTable[slot].used)
+    {
+        connTable[slot].used = 1;
+        connTable[slot].gatts_if = gatts_if;
+        connTable[slot].connId = conn_id;
+        connTable[slot].mtu = GEVCU_CONN_DEFAULT_MTU;
+        memcpy(connTable[slot].bda, bda, sizeof(esp_bd_addr_t));
+        connOpenCount++;
+    }
+    portEXIT_CRITICAL(&connMux);
+
+    if (slot == GEVCU_CONN_NONE) TRACE(CONN_REJECTED, GEVCU_TRACE_NO_ROW, conn_id, GEVCU_CONN_MAX);
+    else TRACE(CONN_OPEN, GEVCU_TRACE_NO_ROW, conn_id, connOpenCount);
+    return slot;
+}
+
+uint8_t connClose(uint16_t conn_id)
+{
+    uint8_t slot;
+
+    portENTER_CRITICAL(&connMux);
+    slot = findSlot(conn_id);
+    if (slot != GEVCU_CONN_NONE)
+    {
+        connTable[slot].used = 0;
+        connOpenCount--;
+    }
+    portEXIT_CRITICAL(&connMux);
+
+    if (slot != GEVCU_CONN_NONE) TRACE(CONN_CLOSE, GEVCU_TRACE_NO_ROW, conn_id, connOpenCount);
+    return slot;
+}
+
+uint8_t connSlot(uint16_t conn_id)
+{
+    uint8_t slot;
+
+    portENTER_CRITICAL(&connMux);
+    slot = findSlot(conn_id);
+    portEXIT_CRITICAL(&connMux);
+    return slot;
+}
+
+int connAddress(uint16_t conn_id, esp_bd_addr_t bda)
+{
+    portENTER_CRITICAL(&connMux);
+    uint8_t slot = findSlot(conn_id);
+    if (slot != GEVCU_CONN_NONE) memcpy(bda, connTable[slot].bda, sizeof(esp_bd_addr_t));
+    portEXIT_CRITICAL(&connMux);
+    return slot != GEVCU_CONN_NONE;
+}
+
+void connSetMtu(uint16_t conn_id, uint16_t mtu)
+{
+    portENTER_CRITICAL(&connMux);
+    uint8_t slot = findSlot(conn_id);
+    if (slot != GEVCU_CONN_NONE) connTable[slot].mtu = mtu < GEVCU_CONN_DEFAULT_MTU ? GEVCU_CONN_DEFAULT_MTU : mtu;
+    portEXIT_CRITICAL(&connMux);
+}
+
+uint16_t connMtu(uint16_t conn_id)
+{
+    uint16_t mtu = GEVCU_CONN_DEFAULT_MTU;
+
+    portENTER_CRITICAL(&connMux);
+    uint8_t slot = findSlot(conn_id);
+    if (slot != GEVCU_CONN_NONE) mtu = connTable[slot].mtu;
+    portEXIT_CRITICAL(&connMux);
+    return mtu;
+}
+
+uint8_t connCount(void)
+{
+    return connOpenCount;
+}
+
+int connSnapshot(GEVCU_CONN_t *conns)
+{
+    int count;
+
+    portENTER_CRITICAL(&connMux);
+    memcpy(conns, connTable, sizeof(connTable));
+    count = connOpenCount;
+    portEXIT_CRITICAL(&connMux);
+    return count;
+}
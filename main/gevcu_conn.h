@@ -0,0 +1,53 @@
+//Connections. Several centrals can be connected at once, a dashboard tablet and a technician's laptop
+//say. Each connection gets a slot here with the MTU it negotiated, the notifier keeps subscriptions by
+//slot, and advertising goes on while a slot is free.
+
+#ifndef GEVCU_CONN_H
+#define GEVCU_CONN_H
+
+#include <stdint.h>
+
+#include "esp_gatts_api.h"
+#include "sdkconfig.h"
+
+//As many as the controller takes
+#define GEVCU_CONN_MAX          CONFIG_BT_ACL_CONNECTIONS
+//MTU of a connection until the central negotiates another one
+#define GEVCU_CONN_DEFAULT_MTU  23
+#define GEVCU_CONN_NONE         0xFF
+
+typedef struct
+{
+    uint8_t used;
+    esp_gatt_if_t gatts_if;
+    uint16_t connId;
+    uint16_t mtu;
+    esp_bd_addr_t bda;
+} GEVCU_CONN_t;
+
+//The central with bda connected. Returns its slot, GEVCU_CONN_NONE if every slot is taken.
+uint8_t connOpen(esp_gatt_if_t gatts_if, uint16_t conn_id, const esp_bd_addr_t bda);
+
+//A central went away. Returns the slot it had, GEVCU_CONN_NONE if it had none.
+uint8_t connClose(uint16_t conn_id);
+
+//Slot of a connection, GEVCU_CONN_NONE for one we don't know
+uint8_t connSlot(uint16_t conn_id);
+
+//Address of the central on conn_id into bda. Returns 0 for a connection we don't know.
+int connAddress(uint16_t conn_id, esp_bd_addr_t bda);
+
+//The central on conn_id negotiated mtu
+void connSetMtu(uint16_t conn_id, uint16_t mtu);
+
+//MTU of a connection, the default one for a connection we don't know
+uint16_t connMtu(uint16_t conn_id);
+
+//Connections open
+uint8_t connCount(void);
+
+//Copy every slot into conns (GEVCU_CONN_MAX of them) for a task other than the event worker to go over.
+//Returns the number in use.
+int connSnapshot(GEVCU_CONN_t *conns);
+
+#endif
@@ -0,0 +1,273 @@
+//Bluedroid event worker. See gevcu_events.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "xtensa/hal.h"
+#include "esp_gatts_api.h"
+#include "esp_gap_ble_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_events.h"
+#include "gevcu_trace.h"
+
+static QueueHandle_t eventsQueue;
+static const GEVCU_EVENT_ENTRY_t *gattsTable, *gapTable;
+static int gattsCount, gapCount;
+
+static portMUX_TYPE eventsMux = portMUX_INITIALIZER_UNLOCKED;
+static GEVCU_EVENT_STATS_t eventsCounters;
+//Handles of attribute tables on their way to the worker, too many for a record. Slots are taken by the
+//callback and given back by the worker, both under eventsMux.
+static uint16_t eventsHandles[GEVCU_EVENT_TABLES][ESP_GATT_ATTR_HANDLE_MAX];
+static uint8_t eventsHandlesUsed[GEVCU_EVENT_TABLES];
+//State events that found the queue full. Only the BTC task adds, only the worker takes, under eventsMux.
+static GEVCU_EVENT_t eventsOverflow[GEVCU_EVENT_OVERFLOW];
+static uint8_t eventsOverflowHead, eventsOverflowCount;
+_Static_assert(GEVCU_EVENT_RESERVED > 0 && GEVCU_EVENT_RESERVED < GEVCU_EVENT_QUEUE, "bad event queue reserve");
+
+//What the worker being behind does to an event
+#define GEVCU_EVENT_STATE       0   //waits a little for room, then goes to the overflow ring
+#define GEVCU_EVENT_REQUEST     1   //answered busy, the central can try again
+#define GEVCU_EVENT_COMMAND     2   //dropped, a write without response has no answer to give
+
+#define GEVCU_EVENT_WAKE        2   //gap of a record that only wakes the worker for the overflow ring
+
+//Put evt in the overflow ring. Returns 0 if that is full too.
+static int eventsOverflowPut(const GEVCU_EVENT_t *evt)
+{
+    int put = 0;
+
+    portENTER_CRITICAL(&eventsMux);
+    if (eventsOverflowCount < GEVCU_EVENT_OVERFLOW)
+    {
+        eventsOverflow[(eventsOverflowHead + eventsOverflowCount++) % GEVCU_EVENT_OVERFLOW] = *evt;
+        eventsCounters.overflowed++;
+        put = 1;
+    }
+    portEXIT_CRITICAL(&eventsMux);
+    return put;
+}
+
+//Take the oldest record of the overflow ring into evt. Returns 0 if it is empty.
+static int eventsOverflowTake(GEVCU_EVENT_t *evt)
+{
+    int taken = 0;
+
+    portENTER_CRITICAL(&eventsMux);
+    if (eventsOverflowCount)
+    {
+        *evt = eventsOverflow[eventsOverflowHead];
+        eventsOverflowHead = (eventsOverflowHead + 1) % GEVCU_EVENT_OVERFLOW;
+        eventsOverflowCount--;
+        taken = 1;
+    }
+    portEXIT_CRITICAL(&eventsMux);
+    return taken;
+}
+
+//Hand evt to the worker and account for the callback that started at start
+static void eventsPost(GEVCU_EVENT_t *evt, uint32_t trans_id, uint16_t conn_id, int kind, uint32_t start)
+{
+    int busy = 0, dropped = 0, behind;
+
+    evt->queued = start;
+    //counted before it is on the queue so eventsPending never sees it dispatched but not queued
+    portENTER_CRITICAL(&eventsMux);
+    eventsCounters.queued++;
+    behind = eventsOverflowCount;
+    portEXIT_CRITICAL(&eventsMux);
+    if (kind == GEVCU_EVENT_STATE)
+    {
+        //once one is in the overflow ring the ones after it follow, the worker sees them in order
+        int sent = !behind && xQueueSend(eventsQueue, evt, pdMS_TO_TICKS(GEVCU_EVENT_BLOCK_MS)) == pdTRUE;
+        if (!sent && eventsOverflowPut(evt))
+        {
+            //in case the worker emptied the queue since and waits on it
+            GEVCU_EVENT_t wake = { .gap = GEVCU_EVENT_WAKE };
+            xQueueSend(eventsQueue, &wake, 0);
+        }
+        else if (!sent) dropped = 1;
+    }
+    //the reserve keeps a burst of reads and writes from making state events wait, and nothing passes
+    //state events in the overflow ring
+    else if (behind || uxQueueSpacesAvailable(eventsQueue) <= GEVCU_EVENT_RESERVED ||
+             xQueueSend(eventsQueue, evt, 0) != pdTRUE)
+    {
+        if (kind == GEVCU_EVENT_REQUEST)
+        {
+            esp_ble_gatts_send_response(evt->gatts_if, conn_id, trans_id, ESP_GATT_BUSY, NULL);
+            busy = 1;
+        }
+        else dropped = 1;
+    }
+    if (busy || dropped) TRACE(EVENT_DROPPED, GEVCU_TRACE_NO_ROW, evt->event, evt->gap);
+
+    uint32_t cycles = xthal_get_ccount() - start;
+    portENTER_CRITICAL(&eventsMux);
+    if (busy || dropped) eventsCounters.queued--;
+    //a lost table event gives its handles back
+    if (dropped && !evt->gap && evt->event == ESP_GATTS_CREAT_ATTR_TAB_EVT && evt->dataLen)
+    {
+        eventsHandlesUsed[evt->data[0]] = 0;
+    }
+    eventsCounters.busy += busy;
+    eventsCounters.dropped += dropped;
+    eventsCounters.callbackTotal += cycles;
+    if (cycles > eventsCounters.callbackMax) eventsCounters.callbackMax = cycles;
+    portEXIT_CRITICAL(&eventsMux);
+}
+
+void eventsQueueGatts(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param)
+{
+    uint32_t start = xthal_get_ccount();
+    GEVCU_EVENT_t evt;
+    uint32_t trans_id = 0;
+    uint16_t conn_id = 0;
+    int kind = GEVCU_EVENT_STATE;
+
+    if (event >= gattsCount || !gattsTable[event].handler) return;
+    evt.gap = 0;
+    evt.event = event;
+    evt.gatts_if = gatts_if;
+    evt.dataLen = 0;
+    memcpy(&evt.param, param, gattsTable[event].size);
+
+    switch (event)
+    {
+    case ESP_GATTS_READ_EVT:
+        kind = param->read.need_rsp ? GEVCU_EVENT_REQUEST : GEVCU_EVENT_COMMAND;
+        trans_id = param->read.trans_id;
+        conn_id = param->read.conn_id;
+        break;
+    case ESP_GATTS_WRITE_EVT:
+        //no characteristic takes that much, the record couldn't hold it either
+        if (param->write.len > sizeof(evt.data))
+        {
+            if (param->write.need_rsp)
+            {
+                esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id,
+                                            ESP_GATT_INVALID_ATTR_LEN, NULL);
+            }
+            TRACE(GATT_BAD_LENGTH, GEVCU_TRACE_NO_ROW, param->write.handle, param->write.len);
+            return;
+        }
+        evt.dataLen = param->write.len;
+        if (evt.dataLen) memcpy(evt.data, param->write.value, evt.dataLen);
+        kind = param->write.need_rsp ? GEVCU_EVENT_REQUEST : GEVCU_EVENT_COMMAND;
+        trans_id = param->write.trans_id;
+        conn_id = param->write.conn_id;
+        break;
+    case ESP_GATTS_EXEC_WRITE_EVT:
+        kind = GEVCU_EVENT_REQUEST;
+        trans_id = param->exec_write.trans_id;
+        conn_id = param->exec_write.conn_id;
+        break;
+    case ESP_GATTS_CREAT_ATTR_TAB_EVT:
+    {
+        const uint16_t *handles = param->add_attr_tab.handles;
+        uint16_t count = param->add_attr_tab.num_handle;
+        int slot = 0;
+
+        if (!handles || !count || count > ESP_GATT_ATTR_HANDLE_MAX) break;
+        portENTER_CRITICAL(&eventsMux);
+        while (slot < GEVCU_EVENT_TABLES && eventsHandlesUsed[slot]) slot++;
+        if (slot < GEVCU_EVENT_TABLES) eventsHandlesUsed[slot] = 1;
+        portEXIT_CRITICAL(&eventsMux);
+        if (slot == GEVCU_EVENT_TABLES) break;
+        memcpy(eventsHandles[slot], handles, count * sizeof(handles[0]));
+        evt.data[0] = slot;
+        evt.dataLen = 1;
+        break;
+    }
+    default:
+        break;
+    }
+    eventsPost(&evt, trans_id, conn_id, kind, start);
+}
+
+void eventsQueueGap(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+    uint32_t start = xthal_get_ccount();
+    GEVCU_EVENT_t evt;
+
+    if (event >= gapCount || !gapTable[event].handler) return;
+    evt.gap = 1;
+    evt.event = event;
+    evt.gatts_if = ESP_GATT_IF_NONE;
+    evt.dataLen = 0;
+    memcpy(&evt.param, param, gapTable[event].size);
+    eventsPost(&evt, 0, 0, GEVCU_EVENT_STATE, start);
+}
+
+static void eventsTask(void *arg)
+{
+    GEVCU_EVENT_t evt;
+
+    while (1)
+    {
+        //the queue first, what is in it went in before the overflow ring filled; a wake is only a wake
+        if (xQueueReceive(eventsQueue, &evt, eventsOverflowCount ? 0 : portMAX_DELAY) == pdTRUE)
+        {
+            if (evt.gap == GEVCU_EVENT_WAKE) continue;
+        }
+        else if (!eventsOverflowTake(&evt)) continue;
+        uint32_t start = xthal_get_ccount();
+
+        if (evt.gap)
+        {
+            TRACE(GAP_EVENT, GEVCU_TRACE_NO_ROW, evt.event, 0);
+        }
+        else
+        {
+            TRACE(GATTS_EVENT, GEVCU_TRACE_NO_ROW, evt.event, evt.gatts_if);
+            if (evt.event == ESP_GATTS_WRITE_EVT) evt.param.write.value = evt.data;
+            else if (evt.event == ESP_GATTS_CREAT_ATTR_TAB_EVT)
+            {
+                evt.param.add_attr_tab.handles = evt.dataLen ? eventsHandles[evt.data[0]] : NULL;
+            }
+        }
+        (evt.gap ? gapTable : gattsTable)[evt.event].handler(evt.gatts_if, &evt.param);
+        if (!evt.gap && evt.event == ESP_GATTS_CREAT_ATTR_TAB_EVT && evt.dataLen)
+        {
+            portENTER_CRITICAL(&eventsMux);
+            eventsHandlesUsed[evt.data[0]] = 0;
+            portEXIT_CRITICAL(&eventsMux);
+        }
+
+        uint32_t end = xthal_get_ccount();
+        portENTER_CRITICAL(&eventsMux);
+        eventsCounters.dispatched++;
+        if (start - evt.queued > eventsCounters.waitMax) eventsCounters.waitMax = start - evt.queued;
+        if (end - start > eventsCounters.handlerMax) eventsCounters.handlerMax = end - start;
+        portEXIT_CRITICAL(&eventsMux);
+    }
+}
+
+void eventsStartTask(const GEVCU_EVENT_ENTRY_t *gatts, int gattsEntries, const GEVCU_EVENT_ENTRY_t *gap, int gapEntries)
+{
+    gattsTable = gatts;
+    gattsCount = gattsEntries;
+    gapTable = gap;
+    gapCount = gapEntries;
+    eventsQueue = xQueueCreate(GEVCU_EVENT_QUEUE, sizeof(GEVCU_EVENT_t));
+    xTaskCreatePinnedToCore(eventsTask, "gevcu_events", 3072, NULL, GEVCU_EVENT_PRIORITY, NULL, GEVCU_EVENT_CORE);
+}
+
+uint32_t eventsPending(void)
+{
+    portENTER_CRITICAL(&eventsMux);
+    uint32_t pending = eventsCounters.queued - eventsCounters.dispatched;
+    portEXIT_CRITICAL(&eventsMux);
+    return pending;
+}
+
+void eventsStats(GEVCU_EVENT_STATS_t *stats)
+{
+    portENTER_CRITICAL(&eventsMux);
+    *stats = eventsCounters;
+    portEXIT_CRITICAL(&eventsMux);
+}
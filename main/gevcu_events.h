@@ -0,0 +1,117 @@
+//Bluedroid event worker. The GATTS and GAP callbacks run on the BTC task, and whatever they do holds
+//up the stack's next event, the answers to every other central included. So the callbacks only copy
+//the event into a compact record on a queue, a bounded amount of work whatever the event is. A worker
+//task pinned to GEVCU_EVENT_CORE takes the records off the queue and calls the handler the event has
+//in a table indexed by event. Events without a handler are never queued.
+
+#ifndef GEVCU_EVENTS_H
+#define GEVCU_EVENTS_H
+
+#include <stdint.h>
+
+#include "esp_gatts_api.h"
+#include "esp_gap_ble_api.h"
+#include "sdkconfig.h"
+
+#include "GattServer_GEVCU.h"
+
+//Records the queue holds. Reads and writes leave the last GEVCU_EVENT_RESERVED of them to everything
+//else: with the worker that far behind, requests are answered ESP_GATT_BUSY and writes without response
+//are dropped. Connects, disconnects, table and GAP events wait up to GEVCU_EVENT_BLOCK_MS for room and
+//then go to an overflow ring of GEVCU_EVENT_OVERFLOW records the worker takes once the queue is empty.
+//Only with that full as well is one of them lost.
+#define GEVCU_EVENT_QUEUE       24
+#define GEVCU_EVENT_RESERVED    8
+#define GEVCU_EVENT_BLOCK_MS    10      //a tick at CONFIG_FREERTOS_HZ 100, less waits not at all
+#define GEVCU_EVENT_OVERFLOW    8
+#define GEVCU_EVENT_PRIORITY    7
+//Attribute tables whose handles can wait for the worker at once. Boot asks for every table together.
+#define GEVCU_EVENT_TABLES      8
+//The controller and the BTC task live on core 0, with both cores up the worker takes the other one
+#if CONFIG_FREERTOS_UNICORE
+#define GEVCU_EVENT_CORE        0
+#else
+#define GEVCU_EVENT_CORE        1
+#endif
+
+//Longest value written to any characteristic, all of a write a handler ever looks at. Longer writes
+//and Prepare Write segments are turned down ESP_GATT_INVALID_ATTR_LEN by the callback, never queued.
+#define GEVCU_EVENT_VALUE(id, props, minLen, maxLen, ...) uint8_t v##id[GEVCU_WRITE_LEN(props, maxLen)];
+#define GEVCU_EVENT_SERVICE_VALUES(id, CHARS) CHARS(GEVCU_EVENT_VALUE)
+#define GEVCU_EVENT_DATA_MAX    sizeof(union { GEVCU_SERVICES(GEVCU_EVENT_SERVICE_VALUES) })
+
+//The members of the stack's parameter unions that events with handlers use. Pointers in them are only
+//good during the callback, the worker points write.value at the copy of the value and
+//add_attr_tab.handles at the copy of the handles the callback kept aside.
+typedef union
+{
+    struct gatts_reg_evt_param reg;
+    struct gatts_read_evt_param read;
+    struct gatts_write_evt_param write;
+    struct gatts_exec_write_evt_param exec_write;
+    struct gatts_mtu_evt_param mtu;
+    struct gatts_start_evt_param start;
+    struct gatts_connect_evt_param connect;
+    struct gatts_disconnect_evt_param disconnect;
+    struct gatts_add_attr_tab_evt_param add_attr_tab;
+    struct ble_adv_data_cmpl_evt_param adv_data_cmpl;
+    struct ble_adv_start_cmpl_evt_param adv_start_cmpl;
+    struct ble_update_conn_params_evt_param update_conn_params;
+    esp_ble_sec_t ble_security;
+} GEVCU_EVENT_PARAM_t;
+
+typedef struct
+{
+    uint8_t gap;                //GAP event, else GATTS. GEVCU_EVENT_WAKE only wakes the worker.
+    uint8_t event;
+    esp_gatt_if_t gatts_if;     //ESP_GATT_IF_NONE for GAP events
+    uint16_t dataLen;           //bytes used in data
+    uint32_t queued;            //cycle count when the callback queued it
+    GEVCU_EVENT_PARAM_t param;
+    uint8_t data[GEVCU_EVENT_DATA_MAX];   //value of a write, slot of the handles of an attribute table
+} GEVCU_EVENT_t;
+
+//Runs on the worker with the record's copy of what the stack passed
+typedef void (*GEVCU_EVENT_HANDLER_t)(esp_gatt_if_t gatts_if, GEVCU_EVENT_PARAM_t *param);
+
+typedef struct
+{
+    GEVCU_EVENT_HANDLER_t handler;
+    uint8_t size;               //bytes of param the callback copies
+} GEVCU_EVENT_ENTRY_t;
+
+//Table entries, the size is that of the member of the stack's union the event uses. The member has to
+//be one of GEVCU_EVENT_PARAM_t.
+#define GEVCU_ON_GATTS(event, handler, member) \
+    [event] = { handler, sizeof(((esp_ble_gatts_cb_param_t *)0)->member) }
+#define GEVCU_ON_GAP(event, handler, member) \
+    [event] = { handler, sizeof(((esp_ble_gap_cb_param_t *)0)->member) }
+
+//Cycle counts are CPU cycles, CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ to the microsecond
+typedef struct
+{
+    uint32_t queued;
+    uint32_t dispatched;
+    uint32_t busy;              //requests answered ESP_GATT_BUSY because the queue was full
+    uint32_t dropped;           //writes without response that found no room, state events the overflow ring too
+    uint32_t overflowed;        //state events that went to the overflow ring
+    uint32_t callbackMax;       //cycles in a callback, worst and all of them
+    uint32_t callbackTotal;
+    uint32_t waitMax;           //cycles from queueing to the handler being called, worst
+    uint32_t handlerMax;        //cycles in a handler, worst
+} GEVCU_EVENT_STATS_t;
+
+//Create the queue and start the worker. gatts and gap are the handler tables, count entries each,
+//indexed by event. Call before the callbacks are registered.
+void eventsStartTask(const GEVCU_EVENT_ENTRY_t *gatts, int gattsCount, const GEVCU_EVENT_ENTRY_t *gap, int gapCount);
+
+//Called by the GATTS and GAP callbacks to hand the event to the worker
+void eventsQueueGatts(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
+void eventsQueueGap(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
+//Events queued that the worker hasn't finished with
+uint32_t eventsPending(void);
+
+void eventsStats(GEVCU_EVENT_STATS_t *stats);
+
+#endif
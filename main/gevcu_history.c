@@ -0,0 +1,267 @@
+//History ring. See gevcu_history.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_gatts_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_conn.h"
+#include "gevcu_history.h"
+#include "gevcu_params.h"
+#include "gevcu_telemetry.h"
+#include "gevcu_trace.h"
+#include "gevcu_varint.h"
+
+typedef struct
+{
+    uint32_t first;         //number of the first record
+    uint16_t count;         //records in data, 0 for a block not used yet
+    uint16_t used;          //bytes of data they take
+    uint8_t data[GEVCU_HISTORY_BLOCK - 8];
+} GEVCU_HISTORY_BLOCK_t;
+
+_Static_assert(sizeof(GEVCU_HISTORY_BLOCK_t) == GEVCU_HISTORY_BLOCK, "history block header is not 8 bytes");
+_Static_assert(GEVCU_HISTORY_RECORD_MAX <= GEVCU_HISTORY_BLOCK - 8, "a whole history record no longer fits a block");
+_Static_assert(GEVCU_HISTORY_HEADER + GEVCU_HISTORY_RECORD_MAX <= GEVCU_CONN_DEFAULT_MTU - GEVCU_TELEMETRY_ATT_HEADER,
+               "a history record no longer fits a notification at the default MTU");
+_Static_assert(GEVCU_HISTORY_MAX <= 0xFF, "history chunk no longer fits the maxLen of a characteristic");
+
+uint8_t historyValue[GEVCU_HISTORY_MAX] = { GEVCU_HISTORY_VERSION };
+
+static portMUX_TYPE historyMux = portMUX_INITIALIZER_UNLOCKED;
+static GEVCU_HISTORY_BLOCK_t historyRing[GEVCU_HISTORY_BLOCKS];
+static uint8_t historyHead;                         //block the next record goes into
+static uint8_t historyWrapped;                      //every block has been used, the one after head is oldest
+static uint32_t historyRecords;                     //number of the next record
+static uint32_t historyLast[GEVCU_HISTORY_COUNT];   //fields of the record before it
+static uint32_t historyCursor[GEVCU_CONN_MAX];      //record each connection goes on from
+static uint32_t historyFrom[GEVCU_CONN_MAX];        //cursor the last chunk historyPack packed started at
+
+//Encode fields into at most max bytes of out, as the zig-zag difference to base or whole without one. Returns
+//the length, 0 if it doesn't fit.
+static int historyEncode(uint8_t *out, int max, const uint32_t *fields, const uint32_t *base)
+{
+    int len = 0;
+    for (int f = 0; f < GEVCU_HISTORY_COUNT; f++)
+    {
+        int n = varintPut(out + len, max - len, varintZigzag(fields[f] - (base ? base[f] : 0)));
+        if (!n) return 0;
+        len += n;
+    }
+    return len;
+}
+
+//Decode a record of in into fields, which hold the record before for a difference. Returns its length,
+//0 if in ends within it.
+static int historyDecode(const uint8_t *in, int max, uint32_t *fields, int whole)
+{
+    int len = 0;
+    for (int f = 0; f < GEVCU_HISTORY_COUNT; f++)
+    {
+        uint32_t v;
+        int n = varintGet(in + len, max - len, &v);
+        if (!n) return 0;
+        fields[f] = (whole ? 0 : fields[f]) + varintUnzigzag(v);
+        len += n;
+    }
+    return len;
+}
+
+//Block the oldest record is in, call with historyMux held
+static int historyOldestBlock(void)
+{
+    return historyWrapped ? (historyHead + 1) % GEVCU_HISTORY_BLOCKS : 0;
+}
+
+//Copy the block record is in. Returns 0 if it isn't in the ring (any more).
+static int historyCopy(uint32_t record, GEVCU_HISTORY_BLOCK_t *block)
+{
+    int found = 0;
+
+    portENTER_CRITICAL(&historyMux);
+    for (int i = 0, b = historyOldestBlock(); i < GEVCU_HISTORY_BLOCKS && !found; i++, b = (b + 1) % GEVCU_HISTORY_BLOCKS)
+    {
+        const GEVCU_HISTORY_BLOCK_t *candidate = &historyRing[b];
+        if (candidate->count && record >= candidate->first && record - candidate->first < candidate->count)
+        {
+            memcpy(block, candidate, sizeof(*block));
+            found = 1;
+        }
+    }
+    portEXIT_CRITICAL(&historyMux);
+    return found;
+}
+
+uint32_t historySample(void)
+{
+    GEVCU_PARAM_CACHE_t copy;
+    uint32_t fields[GEVCU_HISTORY_COUNT];
+    uint8_t record[GEVCU_HISTORY_RECORD_MAX];
+    uint32_t number;
+    int f = 0, len;
+
+    //every field of a record comes from the same moment
+    paramsSnapshot(&copy);
+#define GEVCU_HISTORY_TAKE(name) fields[f++] = copy.name;
+    GEVCU_HISTORY_FIELDS(GEVCU_HISTORY_TAKE)
+
+    portENTER_CRITICAL(&historyMux);
+    GEVCU_HISTORY_BLOCK_t *block = &historyRing[historyHead];
+    len = block->count ? historyEncode(record, sizeof(block->data) - block->used, fields, historyLast) : 0;
+    //a full block is closed, the next one starts over with a whole record
+    if (!len)
+    {
+        if (block->count)
+        {
+            historyHead = (historyHead + 1) % GEVCU_HISTORY_BLOCKS;
+            if (!historyHead) historyWrapped = 1;
+            block = &historyRing[historyHead];
+        }
+        block->first = historyRecords;
+        block->count = 0;
+        block->used = 0;
+        len = historyEncode(record, sizeof(record), fields, NULL);
+    }
+    memcpy(block->data + block->used, record, len);
+    block->used += len;
+    block->count++;
+    memcpy(historyLast, fields, sizeof(historyLast));
+    number = historyRecords++;
+    portEXIT_CRITICAL(&historyMux);
+    return number;
+}
+
+int historyPoll(void)
+{
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+    //record n is due (n + 1) periods after boot
+    if (now / GEVCU_HISTORY_PERIOD_MS <= historyNext()) return 0;
+    historySample();
+    return 1;
+}
+
+uint32_t historyNext(void)
+{
+    portENTER_CRITICAL(&historyMux);
+    uint32_t next = historyRecords;
+    portEXIT_CRITICAL(&historyMux);
+    return next;
+}
+
+uint32_t historyOldest(void)
+{
+    portENTER_CRITICAL(&historyMux);
+    uint32_t oldest = historyRing[historyOldestBlock()].first;
+    portEXIT_CRITICAL(&historyMux);
+    return oldest;
+}
+
+uint16_t historyPayload(uint16_t mtu)
+{
+    uint16_t payload = mtu - GEVCU_TELEMETRY_ATT_HEADER;
+    return payload < GEVCU_HISTORY_MAX ? payload : GEVCU_HISTORY_MAX;
+}
+
+void historyConnect(uint8_t conn)
+{
+    if (conn >= GEVCU_CONN_MAX) return;
+    portENTER_CRITICAL(&historyMux);
+    historyCursor[conn] = 0;
+    historyFrom[conn] = 0;
+    portEXIT_CRITICAL(&historyMux);
+}
+
+//Pack the records from record on into a chunk of at most max bytes. Returns its length.
+static int historyChunk(uint32_t record, uint8_t *chunk, int max)
+{
+    GEVCU_HISTORY_BLOCK_t block;
+    uint32_t fields[GEVCU_HISTORY_COUNT], prev[GEVCU_HISTORY_COUNT];
+    uint32_t oldest = historyOldest(), next = historyNext();
+    int len = GEVCU_HISTORY_HEADER;
+    uint8_t count = 0;
+
+    if (max < GEVCU_HISTORY_HEADER) return 0;
+    //dropped from the ring already, or a record of the run before the last reboot
+    if (record < oldest || record > next) record = oldest;
+
+    //decoded from the start of the block it is in, then as many records as fit from there on, across
+    //blocks. A block dropped while it is packed ends the chunk early.
+    for (uint32_t n = record; n < next && historyCopy(n, &block); )
+    {
+        int pos = 0;
+        for (uint32_t i = block.first; i < block.first + block.count; i++)
+        {
+            int used = historyDecode(block.data + pos, block.used - pos, fields, i == block.first);
+            if (!used) goto packed;
+            pos += used;
+            if (i < n) continue;
+
+            int put = historyEncode(chunk + len, max - len, fields, count ? prev : NULL);
+            if (!put) goto packed;
+            len += put;
+            count++;
+            n++;
+            memcpy(prev, fields, sizeof(prev));
+        }
+        if (n != block.first + block.count) break;
+    }
+packed:
+    chunk[0] = GEVCU_HISTORY_VERSION;
+    memcpy(chunk + 1, &record, sizeof(record));
+    chunk[5] = count;
+    return len;
+}
+
+int historyPack(uint8_t conn, uint8_t *chunk, int max)
+{
+    if (conn >= GEVCU_CONN_MAX) return 0;
+    portENTER_CRITICAL(&historyMux);
+    uint32_t from = historyFrom[conn] = historyCursor[conn];
+    portEXIT_CRITICAL(&historyMux);
+    return historyChunk(from, chunk, max);
+}
+
+void historySent(uint8_t conn, const uint8_t *chunk)
+{
+    uint32_t first;
+
+    if (conn >= GEVCU_CONN_MAX) return;
+    memcpy(&first, chunk + 1, sizeof(first));
+    portENTER_CRITICAL(&historyMux);
+    if (historyCursor[conn] == historyFrom[conn]) historyCursor[conn] = historyFrom[conn] = first + chunk[5];
+    portEXIT_CRITICAL(&historyMux);
+}
+
+int historyRead(uint16_t conn_id, uint8_t *value, int max)
+{
+    uint8_t conn = connSlot(conn_id);
+    uint16_t payload = historyPayload(connMtu(conn_id));
+    uint32_t from = 0;
+
+    if (conn < GEVCU_CONN_MAX)
+    {
+        portENTER_CRITICAL(&historyMux);
+        from = historyCursor[conn];
+        portEXIT_CRITICAL(&historyMux);
+    }
+    return historyChunk(from, value, max < payload ? max : payload);
+}
+
+esp_gatt_status_t historyWrite(uint16_t conn_id, const uint8_t *value, int len)
+{
+    uint8_t conn = connSlot(conn_id);
+    uint32_t record;
+
+    if (len != GEVCU_HISTORY_RESUME) return ESP_GATT_INVALID_ATTR_LEN;
+    if (conn >= GEVCU_CONN_MAX) return ESP_GATT_INSUF_RESOURCE;
+    memcpy(&record, value, sizeof(record));
+    portENTER_CRITICAL(&historyMux);
+    historyCursor[conn] = record;
+    portEXIT_CRITICAL(&historyMux);
+    TRACE(HISTORY_RESUME, GEVCU_TRACE_NO_ROW, conn, record);
+    return ESP_GATT_OK;
+}
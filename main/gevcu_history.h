@@ -0,0 +1,68 @@
+//History ring. params only holds the latest value, so after a drive nothing is left of what the motor
+//temperature or the bus current did. The notifier task samples GEVCU_HISTORY_FIELDS into a ring of
+//delta encoded records in DRAM every GEVCU_HISTORY_PERIOD_MS, and the history characteristic hands them
+//out as chunks, read or notified, from the record each central asked for. A central that comes back
+//after a disconnect writes the record after the last one it got and carries on from there.
+
+#ifndef GEVCU_HISTORY_H
+#define GEVCU_HISTORY_H
+
+#include <stdint.h>
+
+#include "esp_gatts_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_varint.h"
+
+//The ring is GEVCU_HISTORY_BLOCKS blocks of GEVCU_HISTORY_BLOCK bytes. A block starts with a whole record
+//and holds differences after that, so when the ring is full the oldest block is dropped as one.
+#define GEVCU_HISTORY_BLOCK         128
+#define GEVCU_HISTORY_BLOCKS        128
+//Chunks the notifier sends a subscribed central per pass while it is behind
+#define GEVCU_HISTORY_BURST         4
+
+#define GEVCU_HISTORY_ID(name) GEVCU_HISTORY_FIELD_##name,
+enum { GEVCU_HISTORY_FIELDS(GEVCU_HISTORY_ID) GEVCU_HISTORY_COUNT };
+
+//Longest record
+#define GEVCU_HISTORY_FIELD_MAX(name) + GEVCU_VARINT_MAX(sizeof(((GEVCU_PARAM_CACHE_t *)0)->name))
+#define GEVCU_HISTORY_RECORD_MAX    (0 GEVCU_HISTORY_FIELDS(GEVCU_HISTORY_FIELD_MAX))
+
+//What the history attribute holds when the table is created. Reads are packed fresh.
+extern uint8_t historyValue[GEVCU_HISTORY_MAX];
+
+//Sample params into the ring when the next record is due. Returns 1 if it took one.
+int historyPoll(void);
+
+//Sample params into the ring now, ahead of time. historyPoll skips the records taken early so record n
+//is never older than (n + 1) * GEVCU_HISTORY_PERIOD_MS. Returns the number of the record.
+uint32_t historySample(void);
+
+//Number of the next record, the records in the ring are the ones before it
+uint32_t historyNext(void);
+
+//Oldest record still in the ring
+uint32_t historyOldest(void);
+
+//Bytes of a chunk that fit one notification of a connection with mtu, at most GEVCU_HISTORY_MAX
+uint16_t historyPayload(uint16_t mtu);
+
+//A central got connection slot conn (see gevcu_conn.h), it starts at the oldest record
+void historyConnect(uint8_t conn);
+
+//Pack a chunk of at most max bytes for connection slot conn from where it is. Returns its length, just
+//the header when the central has every record.
+int historyPack(uint8_t conn, uint8_t *chunk, int max);
+
+//chunk from historyPack went out: move connection slot conn past it, unless the central moved
+//somewhere else since
+void historySent(uint8_t conn, const uint8_t *chunk);
+
+//Read function of the history characteristic: a chunk that fits the MTU of conn_id, from where the
+//central is. Reading doesn't move it.
+int historyRead(uint16_t conn_id, uint8_t *value, int max);
+
+//Write function of the history characteristic: the 32 bit number of the record to go on from
+esp_gatt_status_t historyWrite(uint16_t conn_id, const uint8_t *value, int len);
+
+#endif
@@ -0,0 +1,130 @@
+//Link profiles. See gevcu_link.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_gap_ble_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_conn.h"
+#include "gevcu_link.h"
+#include "gevcu_notify.h"
+#include "gevcu_params.h"
+#include "gevcu_trace.h"
+
+#define GEVCU_LINK_PARAMS(name, min, max, latency, timeout) {{0}, min, max, latency, timeout},
+static const esp_ble_conn_update_params_t linkParams[GEVCU_LINK_COUNT] = { GEVCU_LINK_PROFILES(GEVCU_LINK_PARAMS) };
+
+typedef struct
+{
+    uint8_t profile;        //last requested, GEVCU_LINK_NONE before the first or after a refusal
+    uint8_t refusals;       //refusals in a row
+    TickType_t liveAt;      //last time the link had a reason to be live, or connected
+    TickType_t refusedAt;   //last refusal
+} GEVCU_LINK_t;
+
+//linkConnect and linkUpdated run on the event worker, linkPoll on the notifier task
+static portMUX_TYPE linkMux = portMUX_INITIALIZER_UNLOCKED;
+static GEVCU_LINK_t linkState[GEVCU_CONN_MAX];
+
+void linkConnect(uint8_t conn)
+{
+    if (conn >= GEVCU_CONN_MAX) return;
+    portENTER_CRITICAL(&linkMux);
+    linkState[conn].profile = GEVCU_LINK_NONE;
+    linkState[conn].refusals = 0;
+    linkState[conn].liveAt = xTaskGetTickCount();
+    portEXIT_CRITICAL(&linkMux);
+}
+
+//How long a link refused refusals times in a row waits before it is asked again
+static TickType_t linkBackoff(uint8_t refusals)
+{
+    int doublings = refusals - 1 < GEVCU_LINK_RETRY_DOUBLINGS ? refusals - 1 : GEVCU_LINK_RETRY_DOUBLINGS;
+    return pdMS_TO_TICKS(GEVCU_LINK_RETRY_MS) << doublings;
+}
+
+int linkPoll(void)
+{
+    GEVCU_CONN_t conns[GEVCU_CONN_MAX];
+    TickType_t now = xTaskGetTickCount();
+    uint8_t running = 0;
+    int switched = 0;
+
+    if (!connSnapshot(conns)) return 0;
+    paramsRead(GEVCU_PARAM_isRunning, &running);
+
+    for (int c = 0; c < GEVCU_CONN_MAX; c++)
+    {
+        GEVCU_LINK_t *link = &linkState[c];
+        uint8_t want = GEVCU_LINK_IDLE, profile, backingOff;
+        TickType_t liveAt;
+
+        if (!conns[c].used) continue;
+        if (running && notifySubscribed(c)) want = GEVCU_LINK_LIVE;
+        portENTER_CRITICAL(&linkMux);
+        if (want == GEVCU_LINK_LIVE) link->liveAt = now;
+        profile = link->profile;
+        liveAt = link->liveAt;
+        backingOff = link->refusals && (now - link->refusedAt) < linkBackoff(link->refusals);
+        portEXIT_CRITICAL(&linkMux);
+
+        if (want == profile || backingOff) continue;
+        if (want == GEVCU_LINK_IDLE && (now - liveAt) < pdMS_TO_TICKS(GEVCU_LINK_IDLE_MS)) continue;
+
+        esp_ble_conn_update_params_t update = linkParams[want];
+        memcpy(update.bda, conns[c].bda, sizeof(esp_bd_addr_t));
+        //a request the stack didn't take is tried again on the next pass
+        if (esp_ble_gap_update_conn_params(&update) != ESP_OK) continue;
+        portENTER_CRITICAL(&linkMux);
+        link->profile = want;
+        portEXIT_CRITICAL(&linkMux);
+        switched++;
+        TRACE(LINK_PROFILE, GEVCU_TRACE_NO_ROW, conns[c].connId, want);
+    }
+    return switched;
+}
+
+uint8_t linkProfile(uint8_t conn)
+{
+    uint8_t profile = GEVCU_LINK_NONE;
+
+    if (conn >= GEVCU_CONN_MAX) return profile;
+    portENTER_CRITICAL(&linkMux);
+    profile = linkState[conn].profile;
+    portEXIT_CRITICAL(&linkMux);
+    return profile;
+}
+
+void linkUpdated(const struct ble_update_conn_params_evt_param *update)
+{
+    GEVCU_CONN_t conns[GEVCU_CONN_MAX];
+    int c = 0;
+
+    //the event only names the central
+    connSnapshot(conns);
+    while (c < GEVCU_CONN_MAX && !(conns[c].used && !memcmp(conns[c].bda, update->bda, sizeof(esp_bd_addr_t)))) c++;
+
+    if (c < GEVCU_CONN_MAX)
+    {
+        portENTER_CRITICAL(&linkMux);
+        GEVCU_LINK_t *link = &linkState[c];
+        if (update->status != ESP_BT_STATUS_SUCCESS)
+        {
+            link->profile = GEVCU_LINK_NONE;
+            if (link->refusals < 0xFF) link->refusals++;
+            link->refusedAt = xTaskGetTickCount();
+        }
+        else link->refusals = 0;
+        portEXIT_CRITICAL(&linkMux);
+    }
+    if (update->status != ESP_BT_STATUS_SUCCESS)
+    {
+        TRACE(LINK_REFUSED, GEVCU_TRACE_NO_ROW, c < GEVCU_CONN_MAX ? conns[c].connId : 0xFFFF, update->status);
+        return;
+    }
+    //interval in 1.25 ms units, latency in events
+    TRACE(LINK_UPDATED, GEVCU_TRACE_NO_ROW, update->conn_int, update->latency);
+}
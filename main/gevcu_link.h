@@ -0,0 +1,46 @@
+//Link profiles. A central subscribed to something while the vehicle is running gets a short connection
+//interval and no slave latency, so notifications go out as the values move. Any other link is relaxed
+//to a long interval with slave latency once it has been that way for GEVCU_LINK_IDLE_MS. The profile
+//of every connection is switched automatically and each switch and the parameters the central settled
+//on show up in the trace.
+
+#ifndef GEVCU_LINK_H
+#define GEVCU_LINK_H
+
+#include <stdint.h>
+
+#include "esp_gap_ble_api.h"
+
+//PROFILE(name, min interval, max interval (1.25 ms), slave latency, supervision timeout (10 ms))
+#define GEVCU_LINK_PROFILES(PROFILE) \
+    PROFILE(LIVE, 0x0006, 0x000C, 0, 400)     /* 7.5 - 15 ms, every event, 4 s timeout */ \
+    PROFILE(IDLE, 0x0050, 0x00A0, 4, 600)     /* 100 - 200 ms, may skip 4 events, 6 s timeout */
+
+#define GEVCU_LINK_ID(name, min, max, latency, timeout) GEVCU_LINK_##name,
+enum { GEVCU_LINK_PROFILES(GEVCU_LINK_ID) GEVCU_LINK_COUNT };
+//Whatever the central picked when it connected, until the first switch
+#define GEVCU_LINK_NONE         0xFF
+
+//How long a link has to have had no reason to be live before it is relaxed, so it isn't relaxed
+//during service discovery or at every red light
+#define GEVCU_LINK_IDLE_MS      2000
+
+//A link whose central refused a profile is back to GEVCU_LINK_NONE and asked again after
+//GEVCU_LINK_RETRY_MS, twice as long after every further refusal up to 2^GEVCU_LINK_RETRY_DOUBLINGS times that
+#define GEVCU_LINK_RETRY_MS         1000
+#define GEVCU_LINK_RETRY_DOUBLINGS  5
+
+//A central got connection slot conn, its link starts out as the central set it up
+void linkConnect(uint8_t conn);
+
+//Request the profile each link should have now. Returns the number of links switched.
+int linkPoll(void);
+
+//Profile last requested for connection slot conn, GEVCU_LINK_NONE if none was
+uint8_t linkProfile(uint8_t conn);
+
+//The central answered a parameter update (ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT). A refusal sends its link
+//back to GEVCU_LINK_NONE so linkPoll asks again.
+void linkUpdated(const struct ble_update_conn_params_evt_param *update);
+
+#endif
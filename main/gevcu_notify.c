@@ -0,0 +1,320 @@
+//Notification engine. See gevcu_notify.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_gatts_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_adv.h"
+#include "gevcu_conn.h"
+#include "gevcu_history.h"
+#include "gevcu_link.h"
+#include "gevcu_notify.h"
+#include "gevcu_params.h"
+#include "gevcu_reads.h"
+#include "gevcu_stream.h"
+#include "gevcu_telemetry.h"
+#include "gevcu_trace.h"
+
+#define CCCD_NOTIFY             0x0001
+
+//What the notifier knows about one characteristic on one connection
+typedef struct
+{
+    uint8_t enabled;        //central wrote 0x0001 to the client config descriptor
+    uint8_t pending;        //send the current value on the next pass whatever it is
+    uint8_t changed;        //value changed since the last notification, not sent yet
+    int64_t lastValue;      //value in the last notification
+    TickType_t lastSent;
+} GEVCU_NOTIFY_STATE_t;
+
+//Row in GEVCU_Characteristics[] of every notifier slot
+#define GEVCU_NOTIFY_ROW(id) GEVCU_IDX_##id,
+#define GEVCU_NOTIFY_ROW_CHAR(id, props, ...) GEVCU_IF_NOTIFY(props, GEVCU_NOTIFY_ROW, id, )
+#define GEVCU_NOTIFY_ROW_SERVICE(id, CHARS) CHARS(GEVCU_NOTIFY_ROW_CHAR)
+static const uint8_t notifyRow[GEVCU_NOTIFY_COUNT] = { GEVCU_SERVICES(GEVCU_NOTIFY_ROW_SERVICE) };
+
+static uint16_t notifyHandle[GEVCU_NOTIFY_COUNT];   //value handles, 0 until the table has been created
+//Written by the event worker on connect and subscribe and by the notifier task on every pass
+static portMUX_TYPE notifyMux = portMUX_INITIALIZER_UNLOCKED;
+static GEVCU_NOTIFY_STATE_t notifyState[GEVCU_CONN_MAX][GEVCU_NOTIFY_COUNT];
+static uint32_t notifyVersion;                      //params version the last pass looked at
+static volatile uint8_t notifyDeferred;                     //a slot still has something to send
+static uint8_t slotOfParam[GEVCU_PARAM_COUNT];      //notifier slot + 1 of every param, 0 for none
+static uint8_t frameSlot;                           //notifier slot + 1 of the telemetry frame, 0 for none
+static uint8_t historySlot;                         //notifier slot + 1 of the history stream, 0 for none
+static uint8_t streamSlot;                          //notifier slot + 1 of the telemetry stream, 0 for none
+
+//Value of a characteristic, read from data, as a signed number so thresholds work the same for every format
+static int64_t characteristicValue(const GATT_CHARACTERISTIC_t *chr, const void *data)
+{
+    int isSigned = chr->presentation.format >= GATT_PRESENT_FORMAT_SINT8 &&
+                   chr->presentation.format <= GATT_PRESENT_FORMAT_SINT128;
+
+    switch (chr->maxLen)
+    {
+    case 1:
+        return isSigned ? (int64_t)*(int8_t *)data : (int64_t)*(uint8_t *)data;
+    case 2:
+        return isSigned ? (int64_t)*(int16_t *)data : (int64_t)*(uint16_t *)data;
+    case 4:
+        return isSigned ? (int64_t)*(int32_t *)data : (int64_t)*(uint32_t *)data;
+    default:
+        return 0;
+    }
+}
+
+void notifySetHandle(const GATT_CHARACTERISTIC_t *chr, uint16_t handle)
+{
+    if (chr->notifyIdx >= GEVCU_NOTIFY_COUNT) return;
+    notifyHandle[chr->notifyIdx] = handle;
+    if (chr->param < GEVCU_PARAM_COUNT) slotOfParam[chr->param] = chr->notifyIdx + 1;
+    else if (chr->read == historyRead) historySlot = chr->notifyIdx + 1;
+    else if (chr->read == streamRead) streamSlot = chr->notifyIdx + 1;
+    else frameSlot = chr->notifyIdx + 1;
+}
+
+void notifyConnect(uint8_t conn)
+{
+    //subscriptions don't survive the connection, a new central on the slot starts with none
+    if (conn >= GEVCU_CONN_MAX) return;
+    portENTER_CRITICAL(&notifyMux);
+    memset(notifyState[conn], 0, sizeof(notifyState[conn]));
+    portEXIT_CRITICAL(&notifyMux);
+}
+
+esp_gatt_status_t notifySubscribe(const GATT_CHARACTERISTIC_t *chr, uint16_t conn_id, const uint8_t *value, uint16_t len)
+{
+    uint8_t conn = connSlot(conn_id);
+    if (len != 2) return ESP_GATT_INVALID_ATTR_LEN;
+    if (chr->notifyIdx >= GEVCU_NOTIFY_COUNT || conn == GEVCU_CONN_NONE) return ESP_GATT_INSUF_RESOURCE;
+
+    GEVCU_NOTIFY_STATE_t *state = &notifyState[conn][chr->notifyIdx];
+    uint16_t cccd = value[0] | (value[1] << 8);
+    uint8_t enabled = (cccd & CCCD_NOTIFY) != 0;
+
+    portENTER_CRITICAL(&notifyMux);
+    state->enabled = enabled;
+    //a fresh subscriber gets the current value right away
+    state->pending = enabled;
+    portEXIT_CRITICAL(&notifyMux);
+    //and the stream starts over with a keyframe
+    if (enabled && chr->read == streamRead) streamReset(conn);
+    notifyDeferred = 1;
+    TRACE(NOTIFY_SUBSCRIBE, chr - GEVCU_Characteristics, notifyHandle[chr->notifyIdx], cccd);
+    return ESP_GATT_OK;
+}
+
+uint16_t notifyConfig(const GATT_CHARACTERISTIC_t *chr, uint16_t conn_id)
+{
+    uint8_t conn = connSlot(conn_id);
+    if (chr->notifyIdx >= GEVCU_NOTIFY_COUNT || conn == GEVCU_CONN_NONE) return 0;
+    portENTER_CRITICAL(&notifyMux);
+    uint8_t enabled = notifyState[conn][chr->notifyIdx].enabled;
+    portEXIT_CRITICAL(&notifyMux);
+    return enabled ? CCCD_NOTIFY : 0;
+}
+
+int notifySubscribed(uint8_t conn)
+{
+    int subscribed = 0;
+
+    if (conn >= GEVCU_CONN_MAX) return 0;
+    portENTER_CRITICAL(&notifyMux);
+    for (int i = 0; i < GEVCU_NOTIFY_COUNT && !subscribed; i++) subscribed = notifyState[conn][i].enabled;
+    portEXIT_CRITICAL(&notifyMux);
+    return subscribed;
+}
+
+//Something changed for notifier slot i, on every connection
+static void markChanged(int i)
+{
+    portENTER_CRITICAL(&notifyMux);
+    for (int c = 0; c < GEVCU_CONN_MAX; c++) notifyState[c][i].changed = 1;
+    portEXIT_CRITICAL(&notifyMux);
+}
+
+//Stream the history to every central subscribed to it from the record it got to, a few chunks a pass
+//while it is behind. Returns the number of notifications sent.
+static int notifyHistory(const GEVCU_CONN_t *conns, uint8_t *congested)
+{
+    int i = historySlot - 1, sent = 0;
+
+    if (!notifyHandle[i]) return 0;
+    for (int c = 0; c < GEVCU_CONN_MAX; c++)
+    {
+        if (!conns[c].used) continue;
+        portENTER_CRITICAL(&notifyMux);
+        uint8_t enabled = notifyState[c][i].enabled;
+        portEXIT_CRITICAL(&notifyMux);
+        if (!enabled) continue;
+        for (int n = 0; n < GEVCU_HISTORY_BURST; n++)
+        {
+            uint8_t chunk[GEVCU_HISTORY_MAX];
+            int len = historyPack(c, chunk, historyPayload(conns[c].mtu));
+
+            if (len <= GEVCU_HISTORY_HEADER) break;
+            //out of buffers for this link, the cursor stays where it was
+            if (esp_ble_gatts_send_indicate(conns[c].gatts_if, conns[c].connId, notifyHandle[i], len, chunk, false) != ESP_OK)
+            {
+                congested[c] = 1;
+                break;
+            }
+            historySent(c, chunk);
+            sent++;
+        }
+    }
+    return sent;
+}
+
+int notifyPoll(void)
+{
+    GEVCU_CONN_t conns[GEVCU_CONN_MAX];
+    TickType_t now = xTaskGetTickCount();
+    uint32_t changed[GEVCU_PARAM_BITMAP_WORDS];
+    uint8_t congested[GEVCU_CONN_MAX] = { 0 };
+    uint16_t framePayload = 0;
+    uint8_t deferred = 0;
+    int sent = 0;
+
+    if (!connSnapshot(conns)) return 0;
+    //the history goes by how far each central got, not by params
+    if (historySlot) sent += notifyHistory(conns, congested);
+
+    //Only the fields that changed since the last pass are looked at
+    if (paramsVersion() != notifyVersion)
+    {
+        notifyVersion = paramsChangedSince(notifyVersion, changed);
+        for (int w = 0; w < GEVCU_PARAM_BITMAP_WORDS; w++)
+        {
+            for (uint32_t bits = changed[w]; bits; bits &= bits - 1)
+            {
+                uint8_t field = w * 32 + __builtin_ctz(bits);
+                if (slotOfParam[field]) markChanged(slotOfParam[field] - 1);
+                if (frameSlot && telemetryCarries[field]) markChanged(frameSlot - 1);
+                if (streamSlot && telemetryCarries[field]) markChanged(streamSlot - 1);
+            }
+        }
+    }
+    else if (!notifyDeferred) return sent;
+    notifyDeferred = 0;
+
+    //a frame is packed once for the largest MTU and cut down for the others
+    for (int c = 0; c < GEVCU_CONN_MAX; c++)
+    {
+        uint16_t payload = telemetryPayload(conns[c].mtu);
+        if (conns[c].used && payload > framePayload) framePayload = payload;
+    }
+
+    for (int i = 0; i < GEVCU_NOTIFY_COUNT; i++)
+    {
+        const GATT_CHARACTERISTIC_t *chr = &GEVCU_Characteristics[notifyRow[i]];
+        uint8_t data[GEVCU_TELEMETRY_MAX > GEVCU_STREAM_MAX ? GEVCU_TELEMETRY_MAX : GEVCU_STREAM_MAX] __attribute__((aligned(4)));
+        uint32_t fields[GEVCU_STREAM_COUNT];
+        uint16_t len = chr->maxLen;
+        int64_t value = 0;
+        uint8_t encoded = 0;
+
+        if (!notifyHandle[i] || i == historySlot - 1) continue;
+        for (int c = 0; c < GEVCU_CONN_MAX; c++)
+        {
+            GEVCU_NOTIFY_STATE_t *state = &notifyState[c][i];
+            uint8_t pending, due;
+            int64_t lastValue;
+
+            if (!conns[c].used) continue;
+            //claimed under the lock: a subscribe on the event worker while this one goes out sets
+            //pending again and gets its own notification on the next pass
+            portENTER_CRITICAL(&notifyMux);
+            pending = state->pending;
+            lastValue = state->lastValue;
+            due = state->enabled && (pending || state->changed);
+            if (due && (congested[c] || (!pending && (now - state->lastSent) < pdMS_TO_TICKS(chr->notifyInterval))))
+            {
+                due = 0;
+                deferred = 1;
+            }
+            else if (due) state->pending = state->changed = 0;
+            portEXIT_CRITICAL(&notifyMux);
+            if (!due) continue;
+
+            //encoded once for every connection it goes to. The SPI task may be storing this field
+            //right now, notify a consistent copy of it.
+            if (!encoded)
+            {
+                if (chr->param < GEVCU_PARAM_COUNT)
+                {
+                    paramsRead(chr->param, data);
+                    value = characteristicValue(chr, data);
+                }
+                else if (i == streamSlot - 1) streamTake(fields);
+                else len = telemetryPack(data, framePayload);
+                encoded = 1;
+            }
+
+            uint16_t sendLen = len;
+            if (chr->param < GEVCU_PARAM_COUNT)
+            {
+                int64_t delta = value > lastValue ? value - lastValue : lastValue - value;
+                if (!pending && (delta == 0 || delta < chr->notifyThreshold)) continue;
+            }
+            //the stream is packed for every central against what it acknowledged, nothing if it has it all
+            else if (i == streamSlot - 1)
+            {
+                sendLen = streamPack(c, fields, data, streamPayload(conns[c].mtu));
+                if (!sendLen) continue;
+            }
+            //a frame goes out whenever any of its fields changed, as much of it as the MTU takes
+            else sendLen = telemetryCut(data, telemetryPayload(conns[c].mtu));
+
+            //the stack is out of buffers for this link, try it again on the next pass
+            if (esp_ble_gatts_send_indicate(conns[c].gatts_if, conns[c].connId, notifyHandle[i], sendLen, data, false) != ESP_OK)
+            {
+                portENTER_CRITICAL(&notifyMux);
+                state->changed = 1;
+                state->pending |= pending;
+                portEXIT_CRITICAL(&notifyMux);
+                congested[c] = 1;
+                deferred = 1;
+                continue;
+            }
+
+            //fields that didn't fit go out in the next frame
+            uint8_t cut = i == streamSlot - 1 && streamSent(c);
+            portENTER_CRITICAL(&notifyMux);
+            state->changed |= cut;
+            state->lastValue = value;
+            state->lastSent = now;
+            portEXIT_CRITICAL(&notifyMux);
+            if (cut) deferred = 1;
+            sent++;
+        }
+    }
+    if (deferred) notifyDeferred = 1;
+    return sent;
+}
+
+static void notifyTask(void *arg)
+{
+    while (1)
+    {
+        notifyPoll();
+        //reads waiting for GEVCU are answered at their deadline even if the SPI link is quiet
+        readsPoll();
+        //subscriptions and isRunning decide how fast each link runs
+        linkPoll();
+        //and whether the state in the advertising data is out of date
+        advPoll();
+        //and whether a history record is due
+        historyPoll();
+        vTaskDelay(pdMS_TO_TICKS(GEVCU_NOTIFY_PERIOD_MS));
+    }
+}
+
+void notifyStartTask(void)
+{
+    xTaskCreate(notifyTask, "gevcu_notify", 3072, NULL, 5, NULL);
+}
@@ -0,0 +1,35 @@
+//Notification engine. Pushes the notify-capable characteristics (RN rows in the characteristic lists)
+//to subscribed centrals when their value in params changes instead of having the app poll them. Every
+//connection has its own subscriptions and rate limits; a value is encoded once per pass and the same
+//bytes go to every connection it is due on.
+
+#ifndef GEVCU_NOTIFY_H
+#define GEVCU_NOTIFY_H
+
+#include "esp_gatts_api.h"
+#include "GattServer_GEVCU.h"
+
+//How often the notifier task looks at params
+#define GEVCU_NOTIFY_PERIOD_MS      10
+
+//Called while the attribute tables are created, once per notify-capable value handle
+void notifySetHandle(const GATT_CHARACTERISTIC_t *chr, uint16_t handle);
+
+//A central got connection slot conn (see gevcu_conn.h), it starts with no subscriptions
+void notifyConnect(uint8_t conn);
+
+//The central on conn_id wrote the client config descriptor of chr. Returns the status to answer it with.
+esp_gatt_status_t notifySubscribe(const GATT_CHARACTERISTIC_t *chr, uint16_t conn_id, const uint8_t *value, uint16_t len);
+
+//Client config descriptor of chr as the central on conn_id last wrote it, every central has its own
+uint16_t notifyConfig(const GATT_CHARACTERISTIC_t *chr, uint16_t conn_id);
+
+//1 if the central on connection slot conn is subscribed to anything
+int notifySubscribed(uint8_t conn);
+
+//One pass over the subscribed characteristics. Returns the number of notifications sent.
+int notifyPoll(void);
+
+void notifyStartTask(void);
+
+#endif
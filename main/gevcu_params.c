@@ -0,0 +1,220 @@
+//Change tracking for the parameter cache. See gevcu_params.h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_params.h"
+
+_Static_assert(GEVCU_PARAM_COUNT < GEVCU_PARAM_NONE, "too many parameters for uint8_t ids");
+_Static_assert(sizeof(GEVCU_PARAM_CACHE_t) <= 0xFF, "params no longer fits uint8_t offsets");
+
+#define GEVCU_PARAM_SIZE(type, name) sizeof(type),
+#define GEVCU_PARAM_OFFSET(type, name) offsetof(GEVCU_PARAM_CACHE_t, name),
+const uint8_t paramSize[GEVCU_PARAM_COUNT] = { GEVCU_PARAM_LIST(GEVCU_PARAM_SIZE) };
+const uint8_t paramOffset[GEVCU_PARAM_COUNT] = { GEVCU_PARAM_LIST(GEVCU_PARAM_OFFSET) };
+
+//Writers serialise on paramsMux. Readers never take it: paramsSeq is a seqlock over the contents of
+//params, odd while a writer is storing, and a reader that saw it move copies again.
+static portMUX_TYPE paramsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t paramsSeq;
+static uint32_t version;
+static uint32_t fieldVersion[GEVCU_PARAM_COUNT];
+//When and how often each field was stored, whether the value changed or not. A value GEVCU repeats is
+//as good as new.
+static TickType_t fieldStoredAt[GEVCU_PARAM_COUNT];
+static uint16_t fieldStores[GEVCU_PARAM_COUNT];
+
+//Fields that changed at least once, most recently changed first. Walking it from the front and
+//stopping at the first field not newer than the caller's version visits only the changed fields.
+static uint8_t recentHead = GEVCU_PARAM_NONE;
+static uint8_t recentNext[GEVCU_PARAM_COUNT];
+static uint8_t recentPrev[GEVCU_PARAM_COUNT];
+
+static void moveToFront(uint8_t field)
+{
+    if (recentHead == field) return;
+
+    if (fieldVersion[field] != 0)
+    {
+        //already listed, unlink it. It isn't the head so it has a previous entry.
+        recentNext[recentPrev[field]] = recentNext[field];
+        if (recentNext[field] != GEVCU_PARAM_NONE) recentPrev[recentNext[field]] = recentPrev[field];
+    }
+    recentPrev[field] = GEVCU_PARAM_NONE;
+    recentNext[field] = recentHead;
+    if (recentHead != GEVCU_PARAM_NONE) recentPrev[recentHead] = field;
+    recentHead = field;
+}
+
+//Called with paramsMux held around the stores of one write
+static void writeBegin(void)
+{
+    __atomic_store_n(&paramsSeq, paramsSeq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void writeEnd(void)
+{
+    __atomic_store_n(&paramsSeq, paramsSeq + 1, __ATOMIC_RELEASE);
+}
+
+//A writer holds paramsMux with interrupts off on its core, so only the other core can be mid-write
+//and the wait is a few stores long
+static uint32_t readBegin(void)
+{
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&paramsSeq, __ATOMIC_ACQUIRE)) & 1) { }
+    return seq;
+}
+
+static int readRetry(uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&paramsSeq, __ATOMIC_RELAXED) != seq;
+}
+
+//Called with paramsMux held
+static void markStored(uint8_t field)
+{
+    fieldStoredAt[field] = xTaskGetTickCount();
+    //0 is kept for never stored
+    if (++fieldStores[field] == 0) fieldStores[field] = 1;
+}
+
+//Store one field as part of version next, with paramsMux held. Returns 1 if it changed.
+static int storeField(uint8_t field, const uint8_t *value, uint32_t next)
+{
+    uint8_t *dest = (uint8_t *)&params + paramOffset[field];
+
+    markStored(field);
+    if (memcmp(dest, value, paramSize[field]) == 0) return 0;
+    memcpy(dest, value, paramSize[field]);
+    moveToFront(field);
+    fieldVersion[field] = next;
+    return 1;
+}
+
+int paramsWrite(uint8_t field, const void *value, uint8_t len)
+{
+    int changed;
+
+    if (field >= GEVCU_PARAM_COUNT || len != paramSize[field]) return -1;
+
+    uint8_t *dest = (uint8_t *)&params + paramOffset[field];
+
+    portENTER_CRITICAL(&paramsMux);
+    //readers aren't disturbed by writes that change nothing
+    changed = memcmp(dest, value, len) != 0;
+    if (changed)
+    {
+        writeBegin();
+        storeField(field, value, version + 1);
+        writeEnd();
+        __atomic_store_n(&version, version + 1, __ATOMIC_RELEASE);
+    }
+    else markStored(field);
+    portEXIT_CRITICAL(&paramsMux);
+    return changed;
+}
+
+int paramsWriteGroup(uint8_t count, const uint8_t *fields, const uint8_t *const *values)
+{
+    int changed = 0;
+    uint32_t next;
+
+    for (uint8_t i = 0; i < count; i++) if (fields[i] >= GEVCU_PARAM_COUNT) return -1;
+
+    portENTER_CRITICAL(&paramsMux);
+    next = version + 1;
+    writeBegin();
+    for (uint8_t i = 0; i < count; i++) changed += storeField(fields[i], values[i], next);
+    writeEnd();
+    if (changed) __atomic_store_n(&version, next, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&paramsMux);
+    return changed;
+}
+
+int paramsApplyImage(const uint8_t *image)
+{
+    int changed = 0;
+    uint32_t next;
+
+    portENTER_CRITICAL(&paramsMux);
+    next = version + 1;
+    writeBegin();
+    for (uint8_t field = 0; field < GEVCU_PARAM_COUNT; field++)
+    {
+        changed += storeField(field, image, next);
+        image += paramSize[field];
+    }
+    writeEnd();
+    if (changed) __atomic_store_n(&version, next, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&paramsMux);
+    return changed;
+}
+
+int paramsRead(uint8_t field, void *value)
+{
+    uint32_t seq;
+
+    if (field >= GEVCU_PARAM_COUNT) return -1;
+
+    const uint8_t *src = (const uint8_t *)&params + paramOffset[field];
+    do
+    {
+        seq = readBegin();
+        memcpy(value, src, paramSize[field]);
+    } while (readRetry(seq));
+    return paramSize[field];
+}
+
+void paramsSnapshot(GEVCU_PARAM_CACHE_t *copy)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = readBegin();
+        memcpy(copy, &params, sizeof(GEVCU_PARAM_CACHE_t));
+    } while (readRetry(seq));
+}
+
+uint32_t paramsVersion(void)
+{
+    return __atomic_load_n(&version, __ATOMIC_ACQUIRE);
+}
+
+uint32_t paramsChangedSince(uint32_t since, uint32_t *changed)
+{
+    uint32_t current;
+
+    memset(changed, 0, GEVCU_PARAM_BITMAP_WORDS * sizeof(uint32_t));
+    portENTER_CRITICAL(&paramsMux);
+    current = version;
+    for (uint8_t f = recentHead; f != GEVCU_PARAM_NONE && fieldVersion[f] > since; f = recentNext[f])
+    {
+        changed[f >> 5] |= 1u << (f & 31);
+    }
+    portEXIT_CRITICAL(&paramsMux);
+    return current;
+}
+
+TickType_t paramsAge(uint8_t field)
+{
+    TickType_t age = portMAX_DELAY;
+
+    portENTER_CRITICAL(&paramsMux);
+    if (fieldStores[field]) age = xTaskGetTickCount() - fieldStoredAt[field];
+    portEXIT_CRITICAL(&paramsMux);
+    return age;
+}
+
+uint16_t paramsStores(uint8_t field)
+{
+    return __atomic_load_n(&fieldStores[field], __ATOMIC_RELAXED);
+}
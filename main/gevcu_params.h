@@ -0,0 +1,61 @@
+//Access and change tracking for the parameter cache. Every writer (SPI ingest, GATT writes) stores
+//through paramsWrite() which bumps a global version and remembers which version last touched each field.
+//Consumers keep the version they last saw and ask for what changed since, at a cost proportional
+//to the number of changed fields rather than the size of params.
+//
+//params is written from the SPI task and read from the BT and notifier tasks, possibly on the other
+//core. Readers that can race a writer go through paramsRead() or paramsSnapshot(), which never block
+//and never return a half written field or group.
+
+#ifndef GEVCU_PARAMS_H
+#define GEVCU_PARAMS_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "GattServer_GEVCU.h"
+
+#define GEVCU_PARAM_NONE            0xFF
+#define GEVCU_PARAM_BITMAP_WORDS    ((GEVCU_PARAM_COUNT + 31) / 32)
+
+//Size of a snapshot image: every field in GEVCU_PARAM_LIST order, little endian, no padding
+#define GEVCU_PARAM_IMAGE_FIELD(type, name) + sizeof(type)
+#define GEVCU_PARAM_IMAGE_SIZE      (0 GEVCU_PARAM_LIST(GEVCU_PARAM_IMAGE_FIELD))
+
+extern const uint8_t paramSize[GEVCU_PARAM_COUNT];
+extern const uint8_t paramOffset[GEVCU_PARAM_COUNT];
+
+//Store len bytes (must be the size of the field) into a field of params.
+//Returns 1 if the value changed, 0 if it was the same and -1 if field or len are bad.
+int paramsWrite(uint8_t field, const void *value, uint8_t len);
+
+//Store count fields as one write: readers see all of them change or none. values[i] points at
+//paramSize[fields[i]] bytes. Returns the number of fields changed, -1 if a field is bad.
+int paramsWriteGroup(uint8_t count, const uint8_t *fields, const uint8_t *const *values);
+
+//Store a whole snapshot image (GEVCU_PARAM_IMAGE_SIZE bytes) into params in one step. Readers of
+//the change log see all of its changes under a single version. Returns the number of fields changed.
+int paramsApplyImage(const uint8_t *image);
+
+//Consistent copy of one field (paramSize[field] bytes) into value. Returns its size, -1 if field is bad.
+int paramsRead(uint8_t field, void *value);
+
+//Consistent copy of the whole cache
+void paramsSnapshot(GEVCU_PARAM_CACHE_t *copy);
+
+//Current version. Starts at 0 and goes up by one for every change.
+uint32_t paramsVersion(void);
+
+//Fill changed (GEVCU_PARAM_BITMAP_WORDS words) with a bit per field changed after version since
+//and return the current version to pass next time.
+uint32_t paramsChangedSince(uint32_t since, uint32_t *changed);
+
+//Ticks since field was last stored, changed or not. portMAX_DELAY if it never was.
+TickType_t paramsAge(uint8_t field);
+
+//Number of times field was stored, changed or not. Wraps, but never back to 0 which means never stored.
+//Moves when GEVCU answers a get.
+uint16_t paramsStores(uint8_t field);
+
+#define PARAM_BIT_TEST(bitmap, field)   ((bitmap)[(field) >> 5] & (1u << ((field) & 31)))
+
+#endif
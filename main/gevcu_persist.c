@@ -0,0 +1,168 @@
+//Persistence of the configuration. See gevcu_persist.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_gatts_api.h"
+#include "nvs.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_params.h"
+#include "gevcu_persist.h"
+#include "gevcu_telemetry.h"
+#include "gevcu_trace.h"
+
+//Every param as a record, more than the config ever needs
+#define GEVCU_PERSIST_MAX       (GEVCU_PARAM_COUNT * 2 + GEVCU_PARAM_IMAGE_SIZE)
+#define GEVCU_PERSIST_HOUR      pdMS_TO_TICKS(3600 * 1000)
+
+//Only the persist task touches this after persistLoad, no locking
+static nvs_handle persistHandle;
+static uint8_t persistOpen;
+static uint32_t persistMask[GEVCU_PARAM_BITMAP_WORDS];     //params that are config
+static uint32_t persistVersion;                             //params version the last pass looked at
+static uint8_t persistDirty;                                //config changed since the last commit
+static uint8_t persistHeld;                                 //the budget is holding a commit back
+static TickType_t persistChangedAt;
+static TickType_t persistCommitAt[GEVCU_PERSIST_COMMITS_PER_HOUR];   //ring of the last commits
+static uint32_t persistCommits;
+static uint8_t persistImage[GEVCU_PERSIST_MAX];             //what NVS holds
+static uint16_t persistLen;
+
+//Config is whatever a central may write that isn't a live control of the telemetry frame
+static void persistBuildMask(void)
+{
+    for (int row = 0; row < GEVCU_IDX_END; row++)
+    {
+        const GATT_CHARACTERISTIC_t *chr = &GEVCU_Characteristics[row];
+        if (!(chr->properties & ESP_GATT_CHAR_PROP_BIT_WRITE) || chr->param >= GEVCU_PARAM_COUNT) continue;
+        if (telemetryCarries[chr->param]) continue;
+        persistMask[chr->param >> 5] |= 1u << (chr->param & 31);
+    }
+}
+
+int persistLoad(void)
+{
+    uint8_t fields[GEVCU_PARAM_COUNT];
+    const uint8_t *values[GEVCU_PARAM_COUNT];
+    size_t len = sizeof(persistImage);
+    uint8_t count = 0;
+    esp_err_t err;
+
+    persistBuildMask();
+    err = nvs_open(GEVCU_PERSIST_NAMESPACE, NVS_READWRITE, &persistHandle);
+    if (err != ESP_OK)
+    {
+        TRACE(PERSIST_FAILED, GEVCU_TRACE_NO_ROW, 0, err);
+        return -1;
+    }
+    persistOpen = 1;
+
+    err = nvs_get_blob(persistHandle, GEVCU_PERSIST_KEY, persistImage, &len);
+    if (err != ESP_OK) len = 0;
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) TRACE(PERSIST_FAILED, GEVCU_TRACE_NO_ROW, 1, err);
+
+    //records of fields that are no longer config or changed size are left out, the next commit drops them
+    for (size_t pos = 0; pos + 2 <= len && pos + 2 + persistImage[pos + 1] <= len; pos += 2 + persistImage[pos + 1])
+    {
+        uint8_t field = persistImage[pos];
+        if (field >= GEVCU_PARAM_COUNT || !PARAM_BIT_TEST(persistMask, field)) continue;
+        if (persistImage[pos + 1] != paramSize[field]) continue;
+        fields[count] = field;
+        values[count++] = &persistImage[pos + 2];
+    }
+    paramsWriteGroup(count, fields, values);
+    persistLen = len;
+    persistVersion = paramsVersion();
+    TRACE(PERSIST_LOADED, GEVCU_TRACE_NO_ROW, count, len);
+    return count;
+}
+
+//Records of the config as params holds it now. Returns their length.
+static int persistPack(uint8_t *image)
+{
+    GEVCU_PARAM_CACHE_t copy;
+    int len = 0;
+
+    paramsSnapshot(&copy);
+    for (uint8_t field = 0; field < GEVCU_PARAM_COUNT; field++)
+    {
+        if (!PARAM_BIT_TEST(persistMask, field)) continue;
+        image[len] = field;
+        image[len + 1] = paramSize[field];
+        memcpy(&image[len + 2], (uint8_t *)&copy + paramOffset[field], paramSize[field]);
+        len += 2 + paramSize[field];
+    }
+    return len;
+}
+
+int persistPoll(void)
+{
+    static uint8_t image[GEVCU_PERSIST_MAX];
+    uint32_t changed[GEVCU_PARAM_BITMAP_WORDS];
+    TickType_t now = xTaskGetTickCount();
+    esp_err_t err;
+    int len;
+
+    if (!persistOpen) return 0;
+
+    if (paramsVersion() != persistVersion)
+    {
+        persistVersion = paramsChangedSince(persistVersion, changed);
+        for (int w = 0; w < GEVCU_PARAM_BITMAP_WORDS; w++)
+        {
+            if (!(changed[w] & persistMask[w])) continue;
+            persistDirty = 1;
+            persistChangedAt = now;
+        }
+    }
+    if (!persistDirty || now - persistChangedAt < pdMS_TO_TICKS(GEVCU_PERSIST_QUIET_MS)) return 0;
+
+    //the slot the next commit goes into holds the oldest of the last GEVCU_PERSIST_COMMITS_PER_HOUR
+    TickType_t oldest = persistCommitAt[persistCommits % GEVCU_PERSIST_COMMITS_PER_HOUR];
+    if (persistCommits >= GEVCU_PERSIST_COMMITS_PER_HOUR && now - oldest < GEVCU_PERSIST_HOUR)
+    {
+        if (!persistHeld) TRACE(PERSIST_HELD, GEVCU_TRACE_NO_ROW, GEVCU_PERSIST_COMMITS_PER_HOUR,
+                                (GEVCU_PERSIST_HOUR - (now - oldest)) * portTICK_PERIOD_MS / 1000);
+        persistHeld = 1;
+        return 0;
+    }
+    persistHeld = 0;
+    persistDirty = 0;
+
+    //changed and changed back again, nothing to write
+    len = persistPack(image);
+    if (len == persistLen && memcmp(image, persistImage, len) == 0) return 0;
+
+    err = nvs_set_blob(persistHandle, GEVCU_PERSIST_KEY, image, len);
+    if (err == ESP_OK) err = nvs_commit(persistHandle);
+    if (err != ESP_OK)
+    {
+        //try again after another quiet period
+        TRACE(PERSIST_FAILED, GEVCU_TRACE_NO_ROW, 2, err);
+        persistDirty = 1;
+        persistChangedAt = now;
+        return 0;
+    }
+    memcpy(persistImage, image, len);
+    persistLen = len;
+    persistCommitAt[persistCommits++ % GEVCU_PERSIST_COMMITS_PER_HOUR] = now;
+    TRACE(PERSIST_COMMIT, GEVCU_TRACE_NO_ROW, len, persistCommits);
+    return 1;
+}
+
+static void persistTask(void *arg)
+{
+    while (1)
+    {
+        persistPoll();
+        vTaskDelay(pdMS_TO_TICKS(GEVCU_PERSIST_PERIOD_MS));
+    }
+}
+
+void persistStartTask(void)
+{
+    xTaskCreate(persistTask, "gevcu_persist", 2048, NULL, 1, NULL);
+}
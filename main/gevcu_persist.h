@@ -0,0 +1,34 @@
+//Persistence of the configuration. The writable params that configure GEVCU are kept in NVS so the cache
+//holds real values from boot on instead of zeros until GEVCU sends them. The live controls the telemetry
+//frame carries (gear, power mode, pedal positions) are writable too but never come back after a reset.
+//Changes from either side are written behind: a burst of writes is committed once, after the config has
+//been quiet for GEVCU_PERSIST_QUIET_MS, and no more than GEVCU_PERSIST_COMMITS_PER_HOUR commits go to
+//flash in any hour.
+
+#ifndef GEVCU_PERSIST_H
+#define GEVCU_PERSIST_H
+
+#include <stdint.h>
+
+//How long the config has to stay unchanged before it is committed
+#define GEVCU_PERSIST_QUIET_MS          2000
+//Flash wear budget. Changes past it wait until the oldest commit of the hour has aged out.
+#define GEVCU_PERSIST_COMMITS_PER_HOUR  12
+//How often the persist task looks at params
+#define GEVCU_PERSIST_PERIOD_MS         100
+
+//NVS namespace and key of the config blob: <param id> <value length> <value> records
+#define GEVCU_PERSIST_NAMESPACE         "gevcu"
+#define GEVCU_PERSIST_KEY               "config"
+
+//Fill params with the config stored in NVS. nvs_flash_init must have succeeded. Call before the
+//attribute tables are created. Returns the number of fields restored, -1 if NVS can't be opened.
+int persistLoad(void);
+
+//Commit the config if it changed, has been quiet long enough and the budget allows.
+//Returns 1 if it committed.
+int persistPoll(void);
+
+void persistStartTask(void);
+
+#endif
@@ -0,0 +1,191 @@
+//Prepared writes. See gevcu_prepare.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_gatts_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_events.h"
+#include "gevcu_params.h"
+#include "gevcu_prepare.h"
+#include "gevcu_trace.h"
+#include "gevcu_writeback.h"
+
+typedef struct
+{
+    const GATT_CHARACTERISTIC_t *chr;
+    uint8_t offset;         //offset of the segment in the value
+    uint8_t len;
+    uint16_t data;          //where its bytes are in prepareBuffer
+} GEVCU_PREPARE_SEGMENT_t;
+
+//Only the event worker touches the queue, no locking
+static GEVCU_PREPARE_SEGMENT_t prepareSegments[GEVCU_PREPARE_SEGMENTS];
+static uint8_t prepareBuffer[GEVCU_PREPARE_BUFFER];
+static uint8_t prepareCount;
+static uint16_t prepareUsed;
+static uint16_t prepareConnId;      //connection the queued segments came from
+
+void prepareWrite(const GATT_CHARACTERISTIC_t *chr, esp_gatt_if_t gatts_if, struct gatts_write_evt_param *write)
+{
+    esp_gatt_status_t status = ESP_GATT_OK;
+    esp_gatt_rsp_t rsp;
+
+    if (!(chr->properties & ESP_GATT_CHAR_PROP_BIT_WRITE) || (chr->param >= GEVCU_PARAM_COUNT && !chr->write))
+    {
+        status = ESP_GATT_WRITE_NOT_PERMIT;
+    }
+    //a value with a write function of its own is executed on its own
+    else if (prepareCount && prepareSegments[0].chr != chr && (chr->write || prepareSegments[0].chr->write))
+    {
+        status = ESP_GATT_WRITE_NOT_PERMIT;
+    }
+    //one central's queue at a time, another one waits until it is executed
+    else if (prepareCount && write->conn_id != prepareConnId) status = ESP_GATT_PREPARE_Q_FULL;
+    else if (write->offset > chr->maxLen) status = ESP_GATT_INVALID_OFFSET;
+    else if (write->offset + write->len > chr->maxLen) status = ESP_GATT_INVALID_ATTR_LEN;
+    else if (prepareCount == GEVCU_PREPARE_SEGMENTS || prepareUsed + write->len > GEVCU_PREPARE_BUFFER)
+    {
+        status = ESP_GATT_PREPARE_Q_FULL;
+    }
+
+    if (status == ESP_GATT_OK)
+    {
+        GEVCU_PREPARE_SEGMENT_t *segment = &prepareSegments[prepareCount++];
+        prepareConnId = write->conn_id;
+        segment->chr = chr;
+        segment->offset = write->offset;
+        segment->len = write->len;
+        segment->data = prepareUsed;
+        memcpy(&prepareBuffer[prepareUsed], write->value, write->len);
+        prepareUsed += write->len;
+        TRACE(GATT_PREPARE, chr - GEVCU_Characteristics, write->handle, write->offset);
+    }
+    else TRACE(GATT_PREPARE_REJECTED, chr - GEVCU_Characteristics, write->handle, status);
+
+    if (!write->need_rsp) return;
+
+    //the response echoes the segment so the central can check it arrived intact, no more of it than the
+    //event record holds
+    memset(&rsp, 0, sizeof(rsp));
+    rsp.attr_value.handle = write->handle;
+    rsp.attr_value.offset = write->offset;
+    rsp.attr_value.len = write->len < GEVCU_EVENT_DATA_MAX ? write->len : GEVCU_EVENT_DATA_MAX;
+    memcpy(rsp.attr_value.value, write->value, rsp.attr_value.len);
+    esp_ble_gatts_send_response(gatts_if, write->conn_id, write->trans_id, status, &rsp);
+}
+
+//Put the segments together into one value per characteristic, in the order they were first prepared.
+//Later segments overwrite earlier ones where they overlap. Returns the number of values, -1 if one of
+//them ends up shorter than minLen, not the size of its param or with a byte no segment wrote.
+static int prepareAssemble(uint8_t *fields, uint8_t (*values)[4], const GATT_CHARACTERISTIC_t **chrs)
+{
+    uint8_t lengths[GEVCU_PREPARE_SEGMENTS];
+    uint8_t written[GEVCU_PREPARE_SEGMENTS];    //bit per byte of the value
+    int count = 0;
+
+    for (int i = 0; i < prepareCount; i++)
+    {
+        const GEVCU_PREPARE_SEGMENT_t *segment = &prepareSegments[i];
+        int v = 0;
+
+        while (v < count && chrs[v] != segment->chr) v++;
+        if (v == count)
+        {
+            chrs[count] = segment->chr;
+            fields[count] = segment->chr->param;
+            lengths[count] = 0;
+            written[count] = 0;
+            memset(values[count], 0, sizeof(values[count]));
+            count++;
+        }
+        memcpy(&values[v][segment->offset], &prepareBuffer[segment->data], segment->len);
+        written[v] |= ((1 << segment->len) - 1) << segment->offset;
+        if (segment->offset + segment->len > lengths[v]) lengths[v] = segment->offset + segment->len;
+    }
+
+    for (int v = 0; v < count; v++)
+    {
+        if (lengths[v] < chrs[v]->minLen || lengths[v] != paramSize[fields[v]]) return -1;
+        if (written[v] != (1 << lengths[v]) - 1) return -1;
+    }
+    return count;
+}
+
+//Put the segments of a value with a write function together and hand it over. Returns its status, the
+//value is turned down if the segments leave a gap in it.
+static esp_gatt_status_t prepareWriteValue(const GATT_CHARACTERISTIC_t *chr)
+{
+    uint8_t value[0xFF], written[0xFF];
+    int len = 0;
+
+    memset(written, 0, sizeof(written));
+    for (int i = 0; i < prepareCount; i++)
+    {
+        const GEVCU_PREPARE_SEGMENT_t *segment = &prepareSegments[i];
+        memcpy(&value[segment->offset], &prepareBuffer[segment->data], segment->len);
+        memset(&written[segment->offset], 1, segment->len);
+        if (segment->offset + segment->len > len) len = segment->offset + segment->len;
+    }
+    if (len < chr->minLen || memchr(written, 0, len)) return ESP_GATT_INVALID_ATTR_LEN;
+    return chr->write(prepareConnId, value, len);
+}
+
+void prepareExecute(esp_gatt_if_t gatts_if, struct gatts_exec_write_evt_param *exec)
+{
+    esp_gatt_status_t status = ESP_GATT_OK;
+    uint8_t fields[GEVCU_PREPARE_SEGMENTS];
+    uint8_t values[GEVCU_PREPARE_SEGMENTS][4];
+    const uint8_t *pointers[GEVCU_PREPARE_SEGMENTS];
+    const GATT_CHARACTERISTIC_t *chrs[GEVCU_PREPARE_SEGMENTS];
+    uint8_t changed[GEVCU_PREPARE_SEGMENTS];
+    const uint8_t *changedValues[GEVCU_PREPARE_SEGMENTS];
+    int count = 0;
+    int changes = 0;
+
+    //a central without a queue of its own has nothing to execute
+    if (prepareCount && exec->conn_id != prepareConnId)
+    {
+        esp_ble_gatts_send_response(gatts_if, exec->conn_id, exec->trans_id, status, NULL);
+        return;
+    }
+    if (exec->exec_write_flag == ESP_GATT_PREP_WRITE_EXEC && prepareCount && prepareSegments[0].chr->write)
+    {
+        status = prepareWriteValue(prepareSegments[0].chr);
+        count = 1;
+    }
+    else if (exec->exec_write_flag == ESP_GATT_PREP_WRITE_EXEC && prepareCount)
+    {
+        count = prepareAssemble(fields, values, chrs);
+        if (count < 0) status = ESP_GATT_INVALID_ATTR_LEN;
+        else
+        {
+            //GEVCU only hears about the values that actually change, as with single writes
+            for (int v = 0; v < count; v++)
+            {
+                uint32_t old = 0;
+                paramsRead(fields[v], &old);
+                pointers[v] = values[v];
+                if (memcmp(&old, values[v], paramSize[fields[v]]) != 0)
+                {
+                    changed[changes] = fields[v];
+                    changedValues[changes++] = values[v];
+                }
+            }
+            paramsWriteGroup(count, fields, pointers);
+            writebackQueueGroup(changes, changed, changedValues);
+        }
+    }
+    TRACE(GATT_EXEC_WRITE, GEVCU_TRACE_NO_ROW, count < 0 ? 0 : count, status);
+
+    prepareCancel(exec->conn_id);
+    esp_ble_gatts_send_response(gatts_if, exec->conn_id, exec->trans_id, status, NULL);
+}
+
+void prepareCancel(uint16_t conn_id)
+{
+    if (conn_id != prepareConnId) return;
+    prepareCount = 0;
+    prepareUsed = 0;
+}
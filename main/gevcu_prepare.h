@@ -0,0 +1,29 @@
+//Prepared writes. A central can queue Prepare Write requests for any number of writable characteristics
+//and then execute them all with one Execute Write. The segments are kept here until then, the values
+//they add up to are checked against minLen/maxLen and applied to params as one group, or not at all.
+//Characteristics with a write function of their own (the config profile) take long writes this way
+//too, one of them per execute and nothing else along with it.
+
+#ifndef GEVCU_PREPARE_H
+#define GEVCU_PREPARE_H
+
+#include <stdint.h>
+
+#include "esp_gatts_api.h"
+#include "GattServer_GEVCU.h"
+
+//Segments and value bytes the queue holds. A full throttle calibration is about 25 segments.
+#define GEVCU_PREPARE_SEGMENTS      40
+#define GEVCU_PREPARE_BUFFER        256
+
+//A central sent a Prepare Write for the value of chr. Queues it and answers the request.
+void prepareWrite(const GATT_CHARACTERISTIC_t *chr, esp_gatt_if_t gatts_if, struct gatts_write_evt_param *write);
+
+//A central sent Execute Write. Applies (or with ESP_GATT_PREP_WRITE_CANCEL drops) the queue and answers.
+void prepareExecute(esp_gatt_if_t gatts_if, struct gatts_exec_write_evt_param *exec);
+
+//Forget everything the central on conn_id queued, e.g. when it goes away. The queue holds the segments
+//of one central at a time.
+void prepareCancel(uint16_t conn_id);
+
+#endif
@@ -0,0 +1,111 @@
+//Config profile. See gevcu_profile.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_gatts_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_params.h"
+#include "gevcu_profile.h"
+#include "gevcu_trace.h"
+#include "gevcu_writeback.h"
+
+_Static_assert(GEVCU_PROFILE_MAX <= 0xFF, "config profile no longer fits the maxLen of a characteristic");
+_Static_assert(GEVCU_PROFILE_IMAGE <= 0xFF, "config profile no longer fits its length byte");
+
+uint8_t profileValue[GEVCU_PROFILE_MAX] = { GEVCU_PROFILE_NONE, 0, GEVCU_PROFILE_VERSION, GEVCU_PROFILE_IMAGE };
+
+#define GEVCU_PROFILE_ID(name) GEVCU_PARAM_##name,
+static const uint8_t profileField[] = { GEVCU_PROFILE_FIELDS(GEVCU_PROFILE_ID) };
+#define GEVCU_PROFILE_COUNT     (int)(sizeof(profileField) / sizeof(profileField[0]))
+
+//Only the event worker uploads, reads just look at the last result
+static volatile uint8_t profileResult = GEVCU_PROFILE_NONE;
+static volatile uint8_t profileApplied;
+
+//Does the calibration make sense as a whole? Positions are per mille of pedal travel: full regen up to
+//throttleRegenMax, regen fading out by throttleRegenMin, forward from throttleFwd, half power at throttleMap.
+static int profileValid(const GEVCU_PARAM_CACHE_t *p)
+{
+    if (p->numThrottlePots < 1 || p->numThrottlePots > 2) return 0;
+    if (p->throttle1Min >= p->throttle1Max) return 0;
+    if (p->numThrottlePots == 2 && p->throttle2Min >= p->throttle2Max) return 0;
+    if (p->brakeMin >= p->brakeMax) return 0;
+    if (p->throttleRegenMax > p->throttleRegenMin || p->throttleRegenMin > p->throttleFwd) return 0;
+    if (p->throttleFwd > p->throttleMap || p->throttleMap > 1000) return 0;
+    if (p->throttleLowestRegen > p->throttleHighestRegen || p->brakeRegenMin > p->brakeRegenMax) return 0;
+    return 1;
+}
+
+static esp_gatt_status_t profileReject(uint8_t result, int len)
+{
+    profileResult = result;
+    TRACE(PROFILE_REJECTED, GEVCU_TRACE_NO_ROW, result, len);
+    return result == GEVCU_PROFILE_BAD_LENGTH ? ESP_GATT_INVALID_ATTR_LEN : ESP_GATT_OUT_OF_RANGE;
+}
+
+esp_gatt_status_t profileWrite(uint16_t conn_id, const uint8_t *value, int len)
+{
+    GEVCU_PARAM_CACHE_t copy;
+    const uint8_t *values[GEVCU_PROFILE_COUNT];
+    uint8_t changed[GEVCU_PROFILE_COUNT];
+    const uint8_t *changedValues[GEVCU_PROFILE_COUNT];
+    int changes = 0;
+    int pos = GEVCU_PROFILE_HEADER;
+
+    if (len < GEVCU_PROFILE_HEADER) return profileReject(GEVCU_PROFILE_BAD_LENGTH, len);
+    if (value[0] != GEVCU_PROFILE_VERSION) return profileReject(GEVCU_PROFILE_BAD_VERSION, len);
+    if (value[1] != GEVCU_PROFILE_IMAGE || len != GEVCU_PROFILE_HEADER + GEVCU_PROFILE_IMAGE)
+    {
+        return profileReject(GEVCU_PROFILE_BAD_LENGTH, len);
+    }
+
+    //staged on a copy of params, nothing is stored until all of it checked out
+    paramsSnapshot(&copy);
+    for (int i = 0; i < GEVCU_PROFILE_COUNT; i++)
+    {
+        uint8_t field = profileField[i];
+        uint8_t *staged = (uint8_t *)&copy + paramOffset[field];
+
+        values[i] = staged;
+        if (memcmp(staged, value + pos, paramSize[field]) != 0)
+        {
+            changed[changes] = field;
+            changedValues[changes++] = staged;
+        }
+        memcpy(staged, value + pos, paramSize[field]);
+        pos += paramSize[field];
+    }
+    if (!profileValid(&copy)) return profileReject(GEVCU_PROFILE_BAD_VALUE, len);
+
+    //GEVCU gets the changed fields in one go, as params does
+    paramsWriteGroup(GEVCU_PROFILE_COUNT, profileField, values);
+    writebackQueueGroup(changes, changed, changedValues);
+    profileResult = GEVCU_PROFILE_APPLIED;
+    profileApplied++;
+    TRACE(PROFILE_APPLIED, GEVCU_TRACE_NO_ROW, changes, len);
+    return ESP_GATT_OK;
+}
+
+int profileRead(uint16_t conn_id, uint8_t *value, int max)
+{
+    uint8_t blob[GEVCU_PROFILE_MAX];
+    GEVCU_PARAM_CACHE_t copy;
+    int len = GEVCU_PROFILE_STATUS + GEVCU_PROFILE_HEADER;
+
+    paramsSnapshot(&copy);
+    blob[0] = profileResult;
+    blob[1] = profileApplied;
+    blob[2] = GEVCU_PROFILE_VERSION;
+    blob[3] = GEVCU_PROFILE_IMAGE;
+    for (int i = 0; i < GEVCU_PROFILE_COUNT; i++)
+    {
+        uint8_t field = profileField[i];
+        memcpy(blob + len, (uint8_t *)&copy + paramOffset[field], paramSize[field]);
+        len += paramSize[field];
+    }
+    if (len > max) len = max;
+    memcpy(value, blob, len);
+    return len;
+}
@@ -0,0 +1,33 @@
+//Config profile. The whole throttle and brake calibration (GEVCU_PROFILE_FIELDS) as one versioned blob:
+//a central uploads it with one write, it is checked as a whole, applied to params as one group and
+//queued for GEVCU in one step, or rejected without touching anything. Reading the characteristic back
+//tells how the last upload went and what params holds now.
+
+#ifndef GEVCU_PROFILE_H
+#define GEVCU_PROFILE_H
+
+#include <stdint.h>
+
+#include "esp_gatts_api.h"
+#include "GattServer_GEVCU.h"
+
+//Result byte of a read of the profile characteristic
+enum GEVCU_PROFILE_RESULT
+{
+  GEVCU_PROFILE_NONE        = 0,    //nothing uploaded since boot
+  GEVCU_PROFILE_APPLIED     = 1,
+  GEVCU_PROFILE_BAD_VERSION = 2,
+  GEVCU_PROFILE_BAD_LENGTH  = 3,
+  GEVCU_PROFILE_BAD_VALUE   = 4,    //a field is out of range or contradicts another
+};
+
+//What the profile attribute holds when the table is created. Reads are packed fresh.
+extern uint8_t profileValue[GEVCU_PROFILE_MAX];
+
+//Read function of the profile characteristic: <result> <profiles applied> <version> <len> <fields>
+int profileRead(uint16_t conn_id, uint8_t *value, int max);
+
+//Write function of the profile characteristic: check and apply a blob of len bytes
+esp_gatt_status_t profileWrite(uint16_t conn_id, const uint8_t *value, int len);
+
+#endif
@@ -0,0 +1,123 @@
+//Read-through cache. See gevcu_reads.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_gatts_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_params.h"
+#include "gevcu_reads.h"
+#include "gevcu_trace.h"
+#include "gevcu_writeback.h"
+
+typedef struct
+{
+    const GATT_CHARACTERISTIC_t *chr;   //NULL while the slot is free
+    esp_gatt_if_t gatts_if;
+    uint16_t conn_id;
+    uint32_t trans_id;
+    uint16_t handle;
+    uint16_t offset;
+    uint16_t stores;                    //paramsStores of the field when the read came in
+    TickType_t deadline;
+} GEVCU_READ_t;
+
+static portMUX_TYPE readsMux = portMUX_INITIALIZER_UNLOCKED;
+static GEVCU_READ_t readsWaiting[GEVCU_READS_WAITING];
+static volatile uint8_t readsCount;
+
+static void readsRespond(const GEVCU_READ_t *read)
+{
+    esp_gatt_status_t status = ESP_GATT_OK;
+    esp_gatt_rsp_t rsp;
+    int len;
+
+    memset(&rsp, 0, sizeof(rsp));
+    rsp.attr_value.handle = read->handle;
+    rsp.attr_value.offset = read->offset;
+    if (read->chr->param < GEVCU_PARAM_COUNT)
+    {
+        len = read->chr->maxLen;
+        paramsRead(read->chr->param, rsp.attr_value.value);
+    }
+    else len = read->chr->read(read->conn_id, rsp.attr_value.value, read->chr->maxLen);
+
+    //a long read gets the rest of the value from offset on
+    if (read->offset > len) status = ESP_GATT_INVALID_OFFSET;
+    else if (read->offset)
+    {
+        len -= read->offset;
+        memmove(rsp.attr_value.value, rsp.attr_value.value + read->offset, len);
+    }
+    rsp.attr_value.len = status == ESP_GATT_OK ? len : 0;
+    esp_ble_gatts_send_response(read->gatts_if, read->conn_id, read->trans_id, status, &rsp);
+}
+
+void readsRequest(const GATT_CHARACTERISTIC_t *chr, esp_gatt_if_t gatts_if, uint16_t conn_id, uint32_t trans_id,
+                  uint16_t handle, uint16_t offset)
+{
+    GEVCU_READ_t read = { chr, gatts_if, conn_id, trans_id, handle, offset, 0, 0 };
+    int slot = -1;
+
+    if (chr->maxAge && chr->param < GEVCU_PARAM_COUNT && paramsAge(chr->param) > pdMS_TO_TICKS(chr->maxAge))
+    {
+        read.stores = paramsStores(chr->param);
+        read.deadline = xTaskGetTickCount() + pdMS_TO_TICKS(GEVCU_READ_DEADLINE_MS);
+
+        portENTER_CRITICAL(&readsMux);
+        for (int i = 0; i < GEVCU_READS_WAITING && slot < 0; i++)
+        {
+            if (readsWaiting[i].chr == NULL) slot = i;
+        }
+        if (slot >= 0)
+        {
+            readsWaiting[slot] = read;
+            readsCount++;
+        }
+        portEXIT_CRITICAL(&readsMux);
+    }
+
+    if (slot < 0)
+    {
+        readsRespond(&read);
+        return;
+    }
+    TRACE(GATT_READ_STALE, chr - GEVCU_Characteristics, handle, paramsAge(chr->param));
+    writebackGet(chr->param);
+}
+
+int readsPoll(void)
+{
+    GEVCU_READ_t ready[GEVCU_READS_WAITING];
+    TickType_t now = xTaskGetTickCount();
+    int count = 0;
+
+    if (!readsCount) return 0;
+
+    //answered outside the lock, the stack may take a while
+    portENTER_CRITICAL(&readsMux);
+    for (int i = 0; i < GEVCU_READS_WAITING; i++)
+    {
+        GEVCU_READ_t *read = &readsWaiting[i];
+        if (read->chr == NULL) continue;
+        if (paramsStores(read->chr->param) == read->stores && (int32_t)(now - read->deadline) < 0) continue;
+
+        ready[count++] = *read;
+        read->chr = NULL;
+        readsCount--;
+    }
+    portEXIT_CRITICAL(&readsMux);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (paramsStores(ready[i].chr->param) == ready[i].stores)
+        {
+            TRACE(GATT_READ_TIMEOUT, ready[i].chr - GEVCU_Characteristics, ready[i].handle, 0);
+        }
+        readsRespond(&ready[i]);
+    }
+    return count;
+}
@@ -0,0 +1,26 @@
+//Read-through cache. A value that is younger than the max age of its characteristic is answered from
+//params right away. An older one is asked of GEVCU first and the read is answered when GEVCU's reply
+//lands, or with what params holds once GEVCU_READ_DEADLINE_MS have passed without one.
+
+#ifndef GEVCU_READS_H
+#define GEVCU_READS_H
+
+#include <stdint.h>
+
+#include "esp_gatts_api.h"
+#include "GattServer_GEVCU.h"
+
+//Longest a read waits for GEVCU before it is answered from params
+#define GEVCU_READ_DEADLINE_MS      50
+//Reads that can wait for GEVCU at once. Past that reads are answered from params.
+#define GEVCU_READS_WAITING         4
+
+//A central read the value of chr from offset on (more than 0 for the rest of a long value). Answers it
+//now or once GEVCU has had its chance to refresh it.
+void readsRequest(const GATT_CHARACTERISTIC_t *chr, esp_gatt_if_t gatts_if, uint16_t conn_id, uint32_t trans_id,
+                  uint16_t handle, uint16_t offset);
+
+//Answer the waiting reads whose value landed or whose deadline passed. Returns the number answered.
+int readsPoll(void);
+
+#endif
@@ -0,0 +1,317 @@
+//SPI link to GEVCU: the slave transaction ring and the frames exchanged over it. See gevcu_spi.h
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/spi_slave.h"
+#include "soc/gpio_reg.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_params.h"
+#include "gevcu_reads.h"
+#include "gevcu_spi.h"
+#include "gevcu_trace.h"
+#include "gevcu_writeback.h"
+#include "rom/crc.h"
+
+//Hardware defines for which pins we've got the SPI signals routed to.
+#define SPI_INT GEVCU_SPI_INT_PIN
+#define SPI_MOSI 23
+#define SPI_MISO 19
+#define SPI_SCLK 18
+#define SPI_CS 5
+
+//One transaction of the ring: its descriptor and DMA buffers (which have to be word aligned).
+//A slot is loaded in the driver, waiting in spiFrames for the parser or free in spiFree.
+typedef struct
+{
+    spi_slave_transaction_t trans;
+    uint8_t tx[GEVCU_SPI_FRAME_MAX] __attribute__((aligned(4)));
+    uint8_t rx[GEVCU_SPI_FRAME_MAX] __attribute__((aligned(4)));
+    uint8_t writebackLen;   //bytes of write-back records in tx
+    uint8_t getCount;       //param ids asked for in tx
+} GEVCU_SPI_SLOT_t;
+
+static GEVCU_SPI_SLOT_t spiSlots[GEVCU_SPI_SLOTS];
+static QueueHandle_t spiFrames;         //slots holding a received frame, in the order they came in
+static QueueHandle_t spiFree;           //slots the parser is done with
+static QueueHandle_t spiReplies;        //replies waiting for a transaction to go out in
+
+_Static_assert(GEVCU_SPI_QUEUED < GEVCU_SPI_SLOTS && GEVCU_SPI_SLOTS < 256, "bad SPI ring size");
+_Static_assert(GEVCU_SPI_BATCH_ACK_LEN <= GEVCU_SPI_REPLY_MAX && GEVCU_SPI_SNAPSHOT_ACK_LEN <= GEVCU_SPI_REPLY_MAX,
+               "a reply no longer fits GEVCU_SPI_REPLY_MAX");
+_Static_assert(GEVCU_SPI_GETS_AT >= GEVCU_SPI_WRITEBACK_AT + GEVCU_SPI_WRITEBACK_HEADER + 2 + 4,
+               "gets leave no room for a write-back");
+_Static_assert(GEVCU_SPI_SNAPSHOT_HEADER + GEVCU_PARAM_IMAGE_SIZE <= GEVCU_SPI_FRAME_MAX,
+               "a snapshot of params no longer fits one SPI transaction");
+
+//Check every record of a batch, then apply them all. Nothing is applied if any record is bad.
+static int processBatch(const uint8_t *frame, int len, uint8_t *reply)
+{
+    uint8_t status = GEVCU_SPI_OK;
+    uint8_t applied = 0;
+    int payload = frame[4];
+    const uint8_t *records = frame + GEVCU_SPI_BATCH_HEADER;
+
+    if (frame[2] != GEVCU_SPI_BATCH_VERSION) status = GEVCU_SPI_BAD_VERSION;
+    else if (GEVCU_SPI_BATCH_HEADER + payload > len) status = GEVCU_SPI_BAD_LENGTH;
+
+    //stops at the first bad record, the length of a record cut off by the payload is never read
+    for (int pos = 0; status == GEVCU_SPI_OK && pos < payload; pos += 2 + records[pos + 1])
+    {
+        if (pos + 2 > payload || pos + 2 + records[pos + 1] > payload) status = GEVCU_SPI_BAD_LENGTH;
+        else if (records[pos] >= GEVCU_PARAM_COUNT) status = GEVCU_SPI_UNKNOWN_PARAM;
+        else if (records[pos + 1] != paramSize[records[pos]]) status = GEVCU_SPI_BAD_VALUE_LEN;
+        if (status != GEVCU_SPI_OK) break;
+    }
+
+    //A batch is one sample of GEVCU's state, readers see it as one
+    if (status == GEVCU_SPI_OK)
+    {
+        uint8_t fields[GEVCU_SPI_FRAME_MAX / 2];
+        const uint8_t *values[GEVCU_SPI_FRAME_MAX / 2];
+
+        for (int pos = 0; pos < payload; pos += 2 + records[pos + 1])
+        {
+            fields[applied] = records[pos];
+            values[applied] = &records[pos + 2];
+            applied++;
+        }
+        paramsWriteGroup(applied, fields, values);
+    }
+    else TRACE(SPI_BATCH_REJECTED, GEVCU_TRACE_NO_ROW, frame[3], status);
+
+    memset(reply, 0, GEVCU_SPI_BATCH_ACK_LEN);
+    reply[0] = GEVCU_SPI_START;
+    reply[1] = GEVCU_SPI_CMD_BATCH_ACK;
+    reply[2] = GEVCU_SPI_BATCH_VERSION;
+    reply[3] = frame[3];
+    reply[4] = status;
+    reply[5] = applied;
+    return GEVCU_SPI_BATCH_ACK_LEN;
+}
+
+//Replace the whole cache with the image in the frame if layout, length and CRC check out
+static int processSnapshot(const uint8_t *frame, int len, uint8_t *reply)
+{
+    uint8_t status = GEVCU_SPI_OK;
+    uint8_t changed = 0;
+    uint16_t imageLen = frame[3] | (frame[4] << 8);
+    uint32_t crc = frame[5] | (frame[6] << 8) | (frame[7] << 16) | ((uint32_t)frame[8] << 24);
+    const uint8_t *image = frame + GEVCU_SPI_SNAPSHOT_HEADER;
+
+    if (frame[2] != GEVCU_PARAM_LAYOUT_VERSION) status = GEVCU_SPI_BAD_VERSION;
+    else if (imageLen != GEVCU_PARAM_IMAGE_SIZE || GEVCU_SPI_SNAPSHOT_HEADER + imageLen > len) status = GEVCU_SPI_BAD_LENGTH;
+    else if (crc32_le(0, image, imageLen) != crc) status = GEVCU_SPI_BAD_CRC;
+    else changed = paramsApplyImage(image);
+
+    if (status != GEVCU_SPI_OK) TRACE(SPI_SNAPSHOT_REJECTED, GEVCU_TRACE_NO_ROW, status, 0);
+
+    memset(reply, 0, GEVCU_SPI_SNAPSHOT_ACK_LEN);
+    reply[0] = GEVCU_SPI_START;
+    reply[1] = GEVCU_SPI_CMD_SNAPSHOT_ACK;
+    reply[2] = GEVCU_PARAM_LAYOUT_VERSION;
+    reply[3] = status;
+    reply[4] = changed;
+    return GEVCU_SPI_SNAPSHOT_ACK_LEN;
+}
+
+int processSpiFrame(const uint8_t *frame, int len, uint8_t *reply)
+{
+    if (len < 3) return 0;
+    TRACE(SPI_FRAME, GEVCU_TRACE_NO_ROW, len, ((uint32_t)frame[0] << 24) | (frame[1] << 16) | (frame[2] << 8) | (len > 3 ? frame[3] : 0));
+
+    if (frame[0] == GEVCU_SPI_START)
+    {
+        if (frame[1] == GEVCU_SPI_CMD_UPDATE)
+        {
+            TRACE(SPI_UPDATE, GEVCU_TRACE_NO_ROW, frame[2], 0);
+            if (frame[2] < GEVCU_PARAM_COUNT && len >= 3 + paramSize[frame[2]])
+            {
+                paramsWrite(frame[2], &frame[3], paramSize[frame[2]]);
+            }
+        }
+        else if (frame[1] == GEVCU_SPI_CMD_GET)
+        {
+            TRACE(SPI_GET, GEVCU_TRACE_NO_ROW, frame[2], 0);
+        }
+        else if (frame[1] == GEVCU_SPI_CMD_BATCH && len >= GEVCU_SPI_BATCH_HEADER)
+        {
+            return processBatch(frame, len, reply);
+        }
+        else if (frame[1] == GEVCU_SPI_CMD_SNAPSHOT && len >= GEVCU_SPI_SNAPSHOT_HEADER)
+        {
+            return processSnapshot(frame, len, reply);
+        }
+        else
+        {
+            TRACE(SPI_BAD_COMMAND, GEVCU_TRACE_NO_ROW, frame[1], 0);
+        }
+    }
+    else
+    {
+        TRACE(SPI_GARBAGE, GEVCU_TRACE_NO_ROW, frame[0], 0);
+    }
+    return 0;
+}
+
+//The ring keeps transactions loaded, so the interrupt line no longer has to say one is ready. It tells
+//the master there are writes to pick up.
+void spiDoorbell(int on) {
+    WRITE_PERI_REG(on ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, (1<<SPI_INT));
+}
+
+static void spiSetup() {
+    esp_err_t ret;
+
+    //Configuration for the SPI bus
+    spi_bus_config_t buscfg={
+        .mosi_io_num=SPI_MOSI,
+        .miso_io_num=SPI_MISO,
+        .sclk_io_num=SPI_SCLK
+    };
+
+    //Configuration for the SPI slave interface
+    spi_slave_interface_config_t slvcfg={
+        .mode=0,
+        .spics_io_num=SPI_CS,
+        .queue_size=GEVCU_SPI_QUEUED,
+        .flags=0
+    };
+
+    //Configuration for the interrupt line
+    gpio_config_t io_conf={
+        .intr_type=GPIO_INTR_DISABLE,
+        .mode=GPIO_MODE_OUTPUT,
+        .pin_bit_mask=(1<<SPI_INT)
+    };
+
+    //Configure interrupt line as output
+    gpio_config(&io_conf);
+    //Enable pull-ups on SPI lines so we don't detect rogue pulses when no master is connected.
+    gpio_set_pull_mode(SPI_MOSI, GPIO_PULLUP_ONLY);
+    gpio_set_pull_mode(SPI_SCLK, GPIO_PULLUP_ONLY);
+    gpio_set_pull_mode(SPI_CS, GPIO_PULLUP_ONLY);
+
+    //Initialize SPI slave interface
+    ret=spi_slave_initialize(HSPI_HOST, &buscfg, &slvcfg, 1);
+    assert(ret==ESP_OK);
+}
+
+//Load a slot into the driver with the oldest waiting reply and as many pending writes and gets as fit in its
+//MISO bytes. The master decides how much of the buffer it clocks, so the transaction is always the full buffer.
+static void spiPrime(uint8_t slot)
+{
+    GEVCU_SPI_SLOT_t *s = &spiSlots[slot];
+    uint8_t *writeback = s->tx + GEVCU_SPI_WRITEBACK_AT;
+    uint8_t *gets = s->tx + GEVCU_SPI_GETS_AT;
+    uint8_t left;
+
+    if (xQueueReceive(spiReplies, s->tx, 0) != pdTRUE) memset(s->tx, 0, GEVCU_SPI_REPLY_MAX);
+    s->writebackLen = writebackTake(writeback + GEVCU_SPI_WRITEBACK_HEADER,
+                                    GEVCU_SPI_GETS_AT - GEVCU_SPI_WRITEBACK_AT - GEVCU_SPI_WRITEBACK_HEADER, &left);
+    memset(writeback, 0, GEVCU_SPI_WRITEBACK_HEADER);
+    if (s->writebackLen)
+    {
+        writeback[0] = GEVCU_SPI_START;
+        writeback[1] = GEVCU_SPI_CMD_WRITEBACK;
+        writeback[2] = GEVCU_SPI_BATCH_VERSION;
+        writeback[3] = left;
+        writeback[4] = s->writebackLen;
+    }
+    s->getCount = writebackTakeGets(gets + GEVCU_SPI_GETS_HEADER, GEVCU_SPI_GETS_MAX);
+    memset(gets, 0, GEVCU_SPI_GETS_HEADER);
+    if (s->getCount)
+    {
+        gets[0] = GEVCU_SPI_START;
+        gets[1] = GEVCU_SPI_CMD_GET;
+        gets[2] = s->getCount;
+    }
+    memset(s->rx, 0, GEVCU_SPI_FRAME_MAX);
+    s->trans.length = GEVCU_SPI_FRAME_MAX * 8; //length in bits... honestly?!
+    s->trans.tx_buffer = s->tx;
+    s->trans.rx_buffer = s->rx;
+    s->trans.user = (void *)(uintptr_t)slot;
+    spi_slave_queue_trans(HSPI_HOST, &s->trans, portMAX_DELAY);
+}
+
+//Collects finished transactions and puts a free slot back in the driver for every one, so there are
+//always GEVCU_SPI_QUEUED loaded unless the parser has fallen a whole ring behind.
+static void spiReceiveTask(void *arg)
+{
+    spi_slave_transaction_t *done;
+    uint8_t slot;
+
+    while (1)
+    {
+        if (spi_slave_get_trans_result(HSPI_HOST, &done, portMAX_DELAY) != ESP_OK) continue;
+        slot = (uint8_t)(uintptr_t)done->user;
+
+        //writes only count as sent if the master clocked all of them
+        GEVCU_SPI_SLOT_t *s = &spiSlots[slot];
+        if (s->writebackLen)
+        {
+            int end = GEVCU_SPI_WRITEBACK_AT + GEVCU_SPI_WRITEBACK_HEADER + s->writebackLen;
+            writebackDone(s->tx + GEVCU_SPI_WRITEBACK_AT + GEVCU_SPI_WRITEBACK_HEADER, s->writebackLen,
+                          done->length / 8 >= end);
+            s->writebackLen = 0;
+        }
+        if (s->getCount)
+        {
+            writebackGetsDone(s->tx + GEVCU_SPI_GETS_AT + GEVCU_SPI_GETS_HEADER, s->getCount,
+                              done->length / 8 >= GEVCU_SPI_GETS_AT + GEVCU_SPI_GETS_HEADER + s->getCount);
+            s->getCount = 0;
+        }
+        xQueueSend(spiFrames, &slot, portMAX_DELAY);
+
+        xQueueReceive(spiFree, &slot, portMAX_DELAY);
+        spiPrime(slot);
+    }
+}
+
+static void spiParseTask(void *arg)
+{
+    static uint8_t reply[GEVCU_SPI_FRAME_MAX];
+    uint8_t slot;
+    int replyLen;
+
+    while (1)
+    {
+        xQueueReceive(spiFrames, &slot, portMAX_DELAY);
+        GEVCU_SPI_SLOT_t *s = &spiSlots[slot];
+
+        replyLen = processSpiFrame(s->rx, s->trans.length / 8, reply);
+        if (replyLen > 0)
+        {
+            memset(reply + replyLen, 0, GEVCU_SPI_REPLY_MAX - replyLen);
+            if (xQueueSend(spiReplies, reply, 0) != pdTRUE) TRACE(SPI_REPLY_DROPPED, GEVCU_TRACE_NO_ROW, reply[1], 0);
+        }
+        xQueueSend(spiFree, &slot, portMAX_DELAY);
+        //the frame may have been GEVCU answering a get
+        readsPoll();
+    }
+}
+
+void spiStart(void)
+{
+    spiSetup();
+
+    spiFrames = xQueueCreate(GEVCU_SPI_SLOTS, sizeof(uint8_t));
+    spiFree = xQueueCreate(GEVCU_SPI_SLOTS, sizeof(uint8_t));
+    spiReplies = xQueueCreate(GEVCU_SPI_SLOTS, GEVCU_SPI_REPLY_MAX);
+
+    for (uint8_t slot = 0; slot < GEVCU_SPI_SLOTS; slot++)
+    {
+        if (slot < GEVCU_SPI_QUEUED) spiPrime(slot);
+        else xQueueSend(spiFree, &slot, 0);
+    }
+
+    //The receive task only shuffles descriptors and has to beat the master to the next transaction
+    xTaskCreate(spiReceiveTask, "gevcu_spi_rx", 2048, NULL, 10, NULL);
+    xTaskCreate(spiParseTask, "gevcu_spi", 4096, NULL, 6, NULL);
+}
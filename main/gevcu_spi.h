@@ -0,0 +1,102 @@
+//Frames exchanged with GEVCU (the SPI master). Every frame starts with GEVCU_SPI_START and a command byte.
+//The ESP32 slave needs transactions of at least 8 bytes and a multiple of 4, so frames are zero padded.
+//
+//  0xA5 0x40 <param id> <value>                 update one parameter (value little endian)
+//  0xA5 0xC0 <param id>                         get one parameter
+//  0xA5 0x50 <version> <seq> <len> <records>    update a batch of parameters, len bytes of records each
+//                                               <param id> <value length> <value>
+//  0xA5 0x60 <layout> <len16> <crc32> <image>   replace the whole cache. image is every parameter in id
+//                                               order without padding (GEVCU_PARAM_IMAGE_SIZE bytes),
+//                                               layout is GEVCU_PARAM_LAYOUT_VERSION, crc32 the CRC-32
+//                                               (as in zlib) of the image. len16 and crc32 little endian.
+//
+//A batch is checked as a whole and then applied as a whole. It is acknowledged in the MISO bytes of
+//a later transaction with
+//
+//  0xA5 0x51 <version> <seq> <status> <records applied>
+//
+//and a snapshot, which is applied atomically or not at all, with
+//
+//  0xA5 0x61 <layout> <status> <fields changed>
+//
+//The slave keeps GEVCU_SPI_QUEUED transactions loaded in the driver at all times, so the master can clock
+//frames back to back without waiting for it to re-arm. Frames are parsed by their own task while the next
+//ones come in, so an acknowledgement trails its frame by up to GEVCU_SPI_SLOTS transactions.
+//Acknowledgements go out in order; match them by seq.
+//
+//MISO bytes 0-7 of a transaction hold an acknowledgement or zeros. Parameters changed over BLE go back
+//to GEVCU from byte GEVCU_SPI_WRITEBACK_AT on as
+//
+//  0xA5 0x52 <version> <left> <len> <records>  records as in a batch, left is how many writes are
+//                                              still pending after this frame
+//
+//and values a central reads that are older than their characteristic allows are asked for from byte
+//GEVCU_SPI_GETS_AT on as
+//
+//  0xA5 0xC0 <count> <param ids>               GEVCU answers with updates or a batch of these params
+//
+//SPI_INT is a doorbell: it is high while writes or gets are pending or on their way. The master answers
+//it by clocking whole GEVCU_SPI_FRAME_MAX byte transactions until it drops. Only the latest value of each
+//parameter is sent, however often it was written in between.
+
+#ifndef GEVCU_SPI_H
+#define GEVCU_SPI_H
+
+#include <stdint.h>
+
+#define GEVCU_SPI_START             0xA5
+#define GEVCU_SPI_CMD_UPDATE        0x40
+#define GEVCU_SPI_CMD_GET           0xC0
+#define GEVCU_SPI_CMD_BATCH         0x50
+#define GEVCU_SPI_CMD_BATCH_ACK     0x51
+#define GEVCU_SPI_CMD_SNAPSHOT      0x60
+#define GEVCU_SPI_CMD_SNAPSHOT_ACK  0x61
+#define GEVCU_SPI_CMD_WRITEBACK     0x52
+
+#define GEVCU_SPI_BATCH_VERSION     1
+#define GEVCU_SPI_BATCH_HEADER      5
+#define GEVCU_SPI_BATCH_ACK_LEN     8
+#define GEVCU_SPI_SNAPSHOT_HEADER   9
+#define GEVCU_SPI_SNAPSHOT_ACK_LEN  8
+#define GEVCU_SPI_WRITEBACK_HEADER  5
+#define GEVCU_SPI_GETS_HEADER       3
+
+//Size of the SPI transaction buffers. Large enough for all of the motoring telemetry in one batch
+//and for a snapshot of the whole cache, so either moves in a single DMA transaction.
+#define GEVCU_SPI_FRAME_MAX         128
+
+//Transactions kept loaded in the driver and buffers in the ring. The slots that are not loaded hold
+//frames waiting for the parser.
+#define GEVCU_SPI_QUEUED            3
+#define GEVCU_SPI_SLOTS             6
+//Longest reply processSpiFrame gives, and where the write-back frame starts in MISO after it
+#define GEVCU_SPI_REPLY_MAX         8
+#define GEVCU_SPI_WRITEBACK_AT      GEVCU_SPI_REPLY_MAX
+//Most gets asked for in one transaction, and where they start in MISO: the end of the buffer
+#define GEVCU_SPI_GETS_MAX          13
+#define GEVCU_SPI_GETS_AT           (GEVCU_SPI_FRAME_MAX - GEVCU_SPI_GETS_HEADER - GEVCU_SPI_GETS_MAX)
+
+//GPIO of the SPI_INT line to GEVCU
+#define GEVCU_SPI_INT_PIN           4
+
+enum GEVCU_SPI_STATUS
+{
+  GEVCU_SPI_OK              = 0,
+  GEVCU_SPI_BAD_VERSION     = 1,
+  GEVCU_SPI_BAD_LENGTH      = 2,
+  GEVCU_SPI_UNKNOWN_PARAM   = 3,
+  GEVCU_SPI_BAD_VALUE_LEN   = 4,
+  GEVCU_SPI_BAD_CRC         = 5,
+};
+
+//Handle one frame received from the SPI master. Anything that has to go back to the master is
+//written to reply (GEVCU_SPI_FRAME_MAX bytes). Returns the length of the reply, 0 if there is none.
+int processSpiFrame(const uint8_t *frame, int len, uint8_t *reply);
+
+//Set up the SPI slave, load the transaction ring and start the receive and parser tasks
+void spiStart(void);
+
+//Raise or drop SPI_INT
+void spiDoorbell(int on);
+
+#endif
@@ -0,0 +1,195 @@
+//Telemetry stream. See gevcu_stream.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_gatts_api.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_conn.h"
+#include "gevcu_params.h"
+#include "gevcu_stream.h"
+#include "gevcu_telemetry.h"
+#include "gevcu_trace.h"
+#include "gevcu_varint.h"
+
+_Static_assert(GEVCU_STREAM_MAX <= 0xFF, "telemetry stream frame no longer fits the maxLen of a characteristic");
+_Static_assert(GEVCU_STREAM_COUNT <= GEVCU_STREAM_BITMAP * 8, "telemetry stream bitmap is too short");
+_Static_assert((GEVCU_STREAM_WINDOW & (GEVCU_STREAM_WINDOW - 1)) == 0 && GEVCU_STREAM_WINDOW <= 0x80,
+               "telemetry stream window has to be a power of two a frame number can tell apart");
+
+uint8_t streamValue[GEVCU_STREAM_MAX] = { GEVCU_STREAM_VERSION << 2 | GEVCU_STREAM_READ };
+
+//What the central on a connection slot has been sent
+typedef struct
+{
+    uint8_t next;                           //number of the next frame
+    uint8_t based;                          //base holds a frame the central acknowledged
+    uint8_t baseFrame;
+    uint8_t sinceKey;                       //frames since the last keyframe
+    uint8_t resets;                         //streamReset calls, a frame packed before one isn't committed
+    uint32_t base[GEVCU_STREAM_COUNT];
+    //fields of the frames sent, by number modulo the window
+    uint8_t sentValid[GEVCU_STREAM_WINDOW];
+    uint8_t sentFrame[GEVCU_STREAM_WINDOW];
+    uint32_t sent[GEVCU_STREAM_WINDOW][GEVCU_STREAM_COUNT];
+    //the frame streamPack packed last, until it has gone out
+    uint8_t packedResets;
+    uint8_t packedKey;
+    uint8_t packedCut;
+    uint32_t packed[GEVCU_STREAM_COUNT];
+} GEVCU_STREAM_STATE_t;
+
+static portMUX_TYPE streamMux = portMUX_INITIALIZER_UNLOCKED;
+static GEVCU_STREAM_STATE_t streamState[GEVCU_CONN_MAX];
+
+uint16_t streamPayload(uint16_t mtu)
+{
+    uint16_t payload = mtu - GEVCU_TELEMETRY_ATT_HEADER;
+    return payload < GEVCU_STREAM_MAX ? payload : GEVCU_STREAM_MAX;
+}
+
+void streamTake(uint32_t *fields)
+{
+    GEVCU_PARAM_CACHE_t copy;
+    int f = 0;
+
+    paramsSnapshot(&copy);
+#define GEVCU_STREAM_TAKE(name) fields[f++] = copy.name;
+    GEVCU_TELEMETRY_FIELDS(GEVCU_STREAM_TAKE)
+}
+
+void streamReset(uint8_t conn)
+{
+    if (conn >= GEVCU_CONN_MAX) return;
+    portENTER_CRITICAL(&streamMux);
+    GEVCU_STREAM_STATE_t *state = &streamState[conn];
+    state->based = 0;
+    state->sinceKey = 0;
+    state->resets++;
+    memset(state->sentValid, 0, sizeof(state->sentValid));
+    portEXIT_CRITICAL(&streamMux);
+}
+
+//Encode a frame of kind with the differences of fields to base into at most max bytes of frame. What the
+//central has once it got the frame goes into result. Returns the length, *cut is set if a field that
+//differs didn't fit.
+static int streamEncode(uint8_t kind, uint8_t number, uint8_t baseFrame, const uint32_t *fields, const uint32_t *base,
+                        uint8_t *frame, int max, uint32_t *result, uint8_t *cut)
+{
+    int len = GEVCU_STREAM_HEADER;
+
+    frame[0] = GEVCU_STREAM_VERSION << 2 | kind;
+    frame[1] = number;
+    frame[2] = baseFrame;
+    memset(frame + 3, 0, GEVCU_STREAM_BITMAP);
+    *cut = 0;
+    for (int f = 0; f < GEVCU_STREAM_COUNT; f++)
+    {
+        uint32_t from = base ? base[f] : 0;
+        int n = fields[f] != from ? varintPut(frame + len, max - len, varintZigzag(fields[f] - from)) : 0;
+
+        //a field that doesn't fit stays as it was in the base, a later one may still fit
+        if (fields[f] != from && !n) *cut = 1;
+        if (n) frame[3 + f / 8] |= 1 << (f % 8);
+        result[f] = n ? fields[f] : from;
+        len += n;
+    }
+    return len;
+}
+
+int streamPack(uint8_t conn, const uint32_t *fields, uint8_t *frame, int max)
+{
+    uint32_t base[GEVCU_STREAM_COUNT], last[GEVCU_STREAM_COUNT], result[GEVCU_STREAM_COUNT];
+    uint8_t number, baseFrame, key, resets, cut;
+    int haveLast, len;
+
+    if (conn >= GEVCU_CONN_MAX || max < GEVCU_STREAM_HEADER) return 0;
+    portENTER_CRITICAL(&streamMux);
+    GEVCU_STREAM_STATE_t *state = &streamState[conn];
+    number = state->next;
+    baseFrame = state->baseFrame;
+    key = !state->based || state->sinceKey >= GEVCU_STREAM_KEY_EVERY - 1;
+    resets = state->resets;
+    memcpy(base, state->base, sizeof(base));
+    //the frame before this one, nothing after a reset
+    haveLast = state->sentValid[(uint8_t)(number - 1) % GEVCU_STREAM_WINDOW] &&
+               state->sentFrame[(uint8_t)(number - 1) % GEVCU_STREAM_WINDOW] == (uint8_t)(number - 1);
+    if (haveLast) memcpy(last, state->sent[(uint8_t)(number - 1) % GEVCU_STREAM_WINDOW], sizeof(last));
+    portEXIT_CRITICAL(&streamMux);
+
+    //nothing moved since the last frame: no frame, even if a keyframe is due
+    if (haveLast && !memcmp(last, fields, sizeof(last))) return 0;
+
+    len = streamEncode(key ? GEVCU_STREAM_KEY : GEVCU_STREAM_DELTA, number, key ? number : baseFrame, fields,
+                       key ? NULL : base, frame, max, result, &cut);
+
+    portENTER_CRITICAL(&streamMux);
+    state->packedResets = resets;
+    state->packedKey = key;
+    state->packedCut = cut;
+    memcpy(state->packed, result, sizeof(result));
+    portEXIT_CRITICAL(&streamMux);
+    return len;
+}
+
+int streamSent(uint8_t conn)
+{
+    int cut;
+
+    if (conn >= GEVCU_CONN_MAX) return 0;
+    portENTER_CRITICAL(&streamMux);
+    GEVCU_STREAM_STATE_t *state = &streamState[conn];
+    uint8_t slot = state->next % GEVCU_STREAM_WINDOW;
+    cut = state->packedCut;
+    if (state->packedResets == state->resets)
+    {
+        state->sentValid[slot] = 1;
+        state->sentFrame[slot] = state->next;
+        memcpy(state->sent[slot], state->packed, sizeof(state->packed));
+        state->sinceKey = state->packedKey ? 0 : state->sinceKey + 1;
+    }
+    state->next++;
+    portEXIT_CRITICAL(&streamMux);
+    return cut;
+}
+
+int streamRead(uint16_t conn_id, uint8_t *value, int max)
+{
+    uint32_t fields[GEVCU_STREAM_COUNT], result[GEVCU_STREAM_COUNT];
+    uint16_t payload = streamPayload(connMtu(conn_id));
+    uint8_t cut;
+
+    if (max > payload) max = payload;
+    if (max < GEVCU_STREAM_HEADER) return 0;
+    streamTake(fields);
+    return streamEncode(GEVCU_STREAM_READ, 0, 0, fields, NULL, value, max, result, &cut);
+}
+
+esp_gatt_status_t streamWrite(uint16_t conn_id, const uint8_t *value, int len)
+{
+    uint8_t conn = connSlot(conn_id);
+    int known;
+
+    if (len != 1) return ESP_GATT_INVALID_ATTR_LEN;
+    if (conn >= GEVCU_CONN_MAX) return ESP_GATT_INSUF_RESOURCE;
+
+    portENTER_CRITICAL(&streamMux);
+    GEVCU_STREAM_STATE_t *state = &streamState[conn];
+    uint8_t slot = value[0] % GEVCU_STREAM_WINDOW;
+    //a frame still in the window and newer than the base it has
+    known = state->sentValid[slot] && state->sentFrame[slot] == value[0] &&
+            (uint8_t)(state->next - value[0]) <= GEVCU_STREAM_WINDOW &&
+            (!state->based || (uint8_t)(value[0] - state->baseFrame) - 1 < GEVCU_STREAM_WINDOW);
+    if (known)
+    {
+        memcpy(state->base, state->sent[slot], sizeof(state->base));
+        state->baseFrame = value[0];
+        state->based = 1;
+    }
+    portEXIT_CRITICAL(&streamMux);
+    if (!known) TRACE(STREAM_ACK_IGNORED, GEVCU_TRACE_NO_ROW, value[0], conn);
+    return ESP_GATT_OK;
+}
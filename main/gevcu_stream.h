@@ -0,0 +1,51 @@
+//Telemetry stream. Most fields of the telemetry frame move by a little between two notifications, yet the
+//frame sends every one of them at full width and only seven fit the 20 bytes of the default MTU. The stream
+//sends a field only when it differs from the last frame the central acknowledged, as a zig-zag varint of the
+//difference, behind a bitmap of the fields in the frame. A central that never negotiates a larger MTU gets
+//twice the fields per notification. Frame layout in GattServer_GEVCU.h.
+
+#ifndef GEVCU_STREAM_H
+#define GEVCU_STREAM_H
+
+#include <stdint.h>
+
+#include "esp_gatts_api.h"
+
+#include "GattServer_GEVCU.h"
+
+//Frames sent since the last one a central acknowledged that can still become its base. An acknowledgement
+//of an older one is ignored and the frames go on against the base before.
+#define GEVCU_STREAM_WINDOW         8
+//A keyframe every so many frames
+#define GEVCU_STREAM_KEY_EVERY      64
+
+#define GEVCU_STREAM_ID(name) GEVCU_STREAM_FIELD_##name,
+enum { GEVCU_TELEMETRY_FIELDS(GEVCU_STREAM_ID) GEVCU_STREAM_COUNT };
+
+//What the stream attribute holds when the table is created. Reads are packed fresh.
+extern uint8_t streamValue[GEVCU_STREAM_MAX];
+
+//Bytes of a frame that fit one notification of a connection with mtu, at most GEVCU_STREAM_MAX
+uint16_t streamPayload(uint16_t mtu);
+
+//Take the fields of one consistent snapshot of params, as 32 bit numbers
+void streamTake(uint32_t *fields);
+
+//Connection slot conn (see gevcu_conn.h) starts over: a new central, or one that subscribed again and
+//may have lost what it had. Its next frame is a keyframe.
+void streamReset(uint8_t conn);
+
+//Pack the frame that brings connection slot conn to fields into at most max bytes. Returns its length, 0
+//if the central already has them.
+int streamPack(uint8_t conn, const uint32_t *fields, uint8_t *frame, int max);
+
+//The frame from the last streamPack for conn went out. Returns 1 if it left out fields that didn't fit.
+int streamSent(uint8_t conn);
+
+//Read function of the stream characteristic: a GEVCU_STREAM_READ frame that fits the MTU of conn_id
+int streamRead(uint16_t conn_id, uint8_t *value, int max);
+
+//Write function of the stream characteristic: the central acknowledges the frame with the number in value
+esp_gatt_status_t streamWrite(uint16_t conn_id, const uint8_t *value, int len);
+
+#endif
@@ -0,0 +1,73 @@
+//Telemetry frame. See gevcu_telemetry.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_conn.h"
+#include "gevcu_params.h"
+#include "gevcu_telemetry.h"
+
+_Static_assert(GEVCU_TELEMETRY_MAX <= 0xFF, "telemetry frame no longer fits the maxLen of a characteristic");
+
+uint8_t telemetryValue[GEVCU_TELEMETRY_MAX] = { GEVCU_TELEMETRY_VERSION };
+
+#define GEVCU_TELEMETRY_ID(name) GEVCU_PARAM_##name,
+static const uint8_t telemetryField[] = { GEVCU_TELEMETRY_FIELDS(GEVCU_TELEMETRY_ID) };
+#define GEVCU_TELEMETRY_COUNT   (int)(sizeof(telemetryField) / sizeof(telemetryField[0]))
+
+#define GEVCU_TELEMETRY_CARRIES(name) [GEVCU_PARAM_##name] = 1,
+const uint8_t telemetryCarries[GEVCU_PARAM_COUNT] = { GEVCU_TELEMETRY_FIELDS(GEVCU_TELEMETRY_CARRIES) };
+
+uint16_t telemetryPayload(uint16_t mtu)
+{
+    uint16_t payload = mtu - GEVCU_TELEMETRY_ATT_HEADER;
+    return payload < GEVCU_TELEMETRY_MAX ? payload : GEVCU_TELEMETRY_MAX;
+}
+
+int telemetryPack(uint8_t *frame, int max)
+{
+    GEVCU_PARAM_CACHE_t copy;
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    int len = GEVCU_TELEMETRY_HEADER;
+    uint8_t count = 0;
+
+    if (max < GEVCU_TELEMETRY_HEADER) return 0;
+
+    //every field of a frame comes from the same moment
+    paramsSnapshot(&copy);
+    for (; count < GEVCU_TELEMETRY_COUNT; count++)
+    {
+        uint8_t field = telemetryField[count];
+        if (len + paramSize[field] > max) break;
+        memcpy(frame + len, (uint8_t *)&copy + paramOffset[field], paramSize[field]);
+        len += paramSize[field];
+    }
+    frame[0] = GEVCU_TELEMETRY_VERSION;
+    frame[1] = count;
+    memcpy(frame + 2, &now, sizeof(now));
+    return len;
+}
+
+int telemetryCut(uint8_t *frame, int max)
+{
+    int len = GEVCU_TELEMETRY_HEADER;
+    uint8_t count = 0;
+
+    for (; count < GEVCU_TELEMETRY_COUNT; count++)
+    {
+        if (len + paramSize[telemetryField[count]] > max) break;
+        len += paramSize[telemetryField[count]];
+    }
+    frame[1] = count;
+    return len;
+}
+
+int telemetryRead(uint16_t conn_id, uint8_t *value, int max)
+{
+    uint16_t payload = telemetryPayload(connMtu(conn_id));
+    return telemetryPack(value, max < payload ? max : payload);
+}
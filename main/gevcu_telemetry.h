@@ -0,0 +1,35 @@
+//Telemetry frame. Packs the GEVCU_TELEMETRY_FIELDS of one consistent snapshot of params into a single
+//characteristic value sized to the MTU, so a dashboard refreshes with one read or notification instead
+//of one per value.
+
+#ifndef GEVCU_TELEMETRY_H
+#define GEVCU_TELEMETRY_H
+
+#include <stdint.h>
+
+#include "GattServer_GEVCU.h"
+
+//ATT header of a read response or notification, the rest of the MTU is payload
+#define GEVCU_TELEMETRY_ATT_HEADER  3
+
+//What the frame attribute holds when the table is created. Reads and notifications are packed fresh.
+extern uint8_t telemetryValue[GEVCU_TELEMETRY_MAX];
+
+//1 for the params a frame carries
+extern const uint8_t telemetryCarries[GEVCU_PARAM_COUNT];
+
+//Bytes of a frame that fit one PDU of a connection with mtu, at most GEVCU_TELEMETRY_MAX
+uint16_t telemetryPayload(uint16_t mtu);
+
+//Pack a frame of at most max bytes. Returns its length, 0 if not even the header fits.
+int telemetryPack(uint8_t *frame, int max);
+
+//Cut a packed frame down to the fields that fit max bytes by rewriting its field count. Returns the
+//length of the cut frame. The bytes past it are untouched, so one frame packed for the largest MTU
+//is cut for every connection in turn, in any order, up to the size it was packed with.
+int telemetryCut(uint8_t *frame, int max);
+
+//Read function of the frame characteristic: a frame of at most max bytes that fits the MTU of conn_id
+int telemetryRead(uint16_t conn_id, uint8_t *value, int max);
+
+#endif
@@ -0,0 +1,128 @@
+//Binary trace ring. See gevcu_trace.h
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "xtensa/hal.h"
+#include "sdkconfig.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_trace.h"
+
+#define GEVCU_TRACE_TAG         "GEVCU_TRACE"
+
+typedef struct
+{
+    uint32_t seq;       //position in the ring + 1 once the record is complete, 0 while it is written
+    uint32_t time;      //CPU cycle count, wraps every ~18 s at 240 MHz
+    uint8_t event;
+    uint8_t row;
+    uint16_t a;
+    uint32_t b;
+} GEVCU_TRACE_RECORD_t;
+
+_Static_assert((GEVCU_TRACE_SIZE & (GEVCU_TRACE_SIZE - 1)) == 0, "GEVCU_TRACE_SIZE has to be a power of two");
+_Static_assert(GEVCU_IDX_END < GEVCU_TRACE_NO_ROW, "characteristic rows no longer fit a trace record");
+
+#define GEVCU_TRACE_LEVEL(name, level, format) level,
+static const uint8_t traceLevel[GEVCU_TRACE_COUNT] = { GEVCU_TRACE_EVENTS(GEVCU_TRACE_LEVEL) };
+#define GEVCU_TRACE_FORMAT(name, level, format) format,
+static const char *const traceFormat[GEVCU_TRACE_COUNT] = { GEVCU_TRACE_EVENTS(GEVCU_TRACE_FORMAT) };
+
+static GEVCU_TRACE_RECORD_t traceRing[GEVCU_TRACE_SIZE];
+static uint32_t traceHead;          //positions handed out to writers
+static uint32_t traceTail;          //next position to format, only the drain touches it
+static uint32_t traceLost;
+
+void traceEvent(uint8_t event, uint8_t row, uint16_t a, uint32_t b)
+{
+    if (traceLevel[event] < params.logLevel) return;
+
+    //Claiming a position is the only shared write, everything after it is private to this writer
+    uint32_t pos = __atomic_fetch_add(&traceHead, 1, __ATOMIC_RELAXED);
+    GEVCU_TRACE_RECORD_t *r = &traceRing[pos & (GEVCU_TRACE_SIZE - 1)];
+
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->time = xthal_get_ccount();
+    r->event = event;
+    r->row = row;
+    r->a = a;
+    r->b = b;
+    __atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+static void traceFormatRecord(const GEVCU_TRACE_RECORD_t *r)
+{
+    static const char letter[] = { 'D', 'I', 'W', 'E' };
+
+    printf("%c (%u) %s: ", letter[traceLevel[r->event]], r->time / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, GEVCU_TRACE_TAG);
+    printf(traceFormat[r->event], r->a, r->b);
+    if (r->row != GEVCU_TRACE_NO_ROW) printf(" (%s)", GEVCU_Characteristics[r->row].description);
+    printf("\n");
+}
+
+int traceDrain(int max)
+{
+    GEVCU_TRACE_RECORD_t copy;
+    int formatted = 0;
+
+    while (formatted < max)
+    {
+        uint32_t head = __atomic_load_n(&traceHead, __ATOMIC_ACQUIRE);
+        if (traceTail == head) break;
+
+        //Writers lapped the drain, skip what they overwrote
+        if (head - traceTail > GEVCU_TRACE_SIZE)
+        {
+            traceLost += head - GEVCU_TRACE_SIZE - traceTail;
+            traceTail = head - GEVCU_TRACE_SIZE;
+        }
+
+        GEVCU_TRACE_RECORD_t *r = &traceRing[traceTail & (GEVCU_TRACE_SIZE - 1)];
+        uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        if (seq != traceTail + 1)
+        {
+            //still being written, try again next time
+            if ((int32_t)(seq - (traceTail + 1)) <= 0) break;
+            traceLost++;
+            traceTail++;
+            continue;
+        }
+        copy = *r;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        //overwritten while it was copied
+        if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != seq)
+        {
+            traceLost++;
+            traceTail++;
+            continue;
+        }
+        traceTail++;
+        traceFormatRecord(&copy);
+        formatted++;
+    }
+
+    if (traceLost)
+    {
+        printf("W %s: %u trace records lost\n", GEVCU_TRACE_TAG, traceLost);
+        traceLost = 0;
+    }
+    return formatted;
+}
+
+static void traceTask(void *arg)
+{
+    while (1)
+    {
+        traceDrain(GEVCU_TRACE_SIZE);
+        vTaskDelay(pdMS_TO_TICKS(GEVCU_TRACE_DRAIN_MS));
+    }
+}
+
+void traceStartTask(void)
+{
+    xTaskCreate(traceTask, "gevcu_trace", 2048, NULL, 1, NULL);
+}
@@ -0,0 +1,88 @@
+//Binary trace ring. The SPI and GATT paths record fixed size events (id, cycle count, characteristic,
+//two numbers) into a lock-free ring instead of printing them. A low priority task, or whoever calls
+//traceDrain, formats them onto the console later so the hot paths never wait on the UART.
+
+#ifndef GEVCU_TRACE_H
+#define GEVCU_TRACE_H
+
+#include <stdint.h>
+
+//Log levels numbered the way GEVCU numbers them since params.logLevel comes from there. An event is
+//recorded if its level is at least params.logLevel.
+enum GEVCU_LOG_LEVEL
+{
+  GEVCU_LOG_DEBUG = 0,
+  GEVCU_LOG_INFO  = 1,
+  GEVCU_LOG_WARN  = 2,
+  GEVCU_LOG_ERROR = 3,
+  GEVCU_LOG_OFF   = 4,
+};
+
+//EVENT(name, level, format). format gets the two numbers of the event, a then b.
+#define GEVCU_TRACE_EVENTS(EVENT) \
+    EVENT(SPI_FRAME,             GEVCU_LOG_DEBUG, "SPI frame of %u bytes: %08x") \
+    EVENT(SPI_UPDATE,            GEVCU_LOG_DEBUG, "SPI update of param %u") \
+    EVENT(SPI_GET,               GEVCU_LOG_DEBUG, "SPI get of param %u") \
+    EVENT(SPI_BAD_COMMAND,       GEVCU_LOG_WARN,  "SPI frame with unknown command %02x") \
+    EVENT(SPI_GARBAGE,           GEVCU_LOG_WARN,  "SPI frame without start byte: %02x") \
+    EVENT(SPI_BATCH_REJECTED,    GEVCU_LOG_WARN,  "SPI batch %u rejected: status %u") \
+    EVENT(SPI_SNAPSHOT_REJECTED, GEVCU_LOG_WARN,  "SPI snapshot rejected: status %u") \
+    EVENT(SPI_REPLY_DROPPED,     GEVCU_LOG_WARN,  "SPI reply %02x dropped, master is not clocking them out") \
+    EVENT(BOOT_PHASE,            GEVCU_LOG_INFO,  "Boot phase %u reached at %u us") \
+    EVENT(GAP_EVENT,             GEVCU_LOG_DEBUG, "GAP event %u") \
+    EVENT(GAP_ADV_START,         GEVCU_LOG_INFO,  "Start advertising") \
+    EVENT(ADV_PHASE,             GEVCU_LOG_INFO,  "Advertising phase %u (0 off, 1 directed, 2 fast, 3 slow)") \
+    EVENT(BOND_DONE,             GEVCU_LOG_INFO,  "Central ..%04x bonded, address type %u") \
+    EVENT(BOND_PRIVATE,          GEVCU_LOG_INFO,  "Central ..%04x uses a resolvable private address, it is not called back") \
+    EVENT(BOND_FAILED,           GEVCU_LOG_WARN,  "Pairing failed: reason %02x") \
+    EVENT(ADV_REFRESH,           GEVCU_LOG_DEBUG, "Advertising data refreshed: SOC %u, status %02x") \
+    EVENT(HISTORY_RESUME,        GEVCU_LOG_INFO,  "History of connection %u goes on from record %u") \
+    EVENT(STREAM_ACK_IGNORED,    GEVCU_LOG_DEBUG, "Acknowledgement of stream frame %u by connection %u out of the window, ignored") \
+    EVENT(EVENT_DROPPED,         GEVCU_LOG_WARN,  "Request or command %u not queued, the event worker is behind") \
+    EVENT(GATTS_EVENT,           GEVCU_LOG_DEBUG, "GATTS event %u, gatts if %u") \
+    EVENT(GATT_READ,             GEVCU_LOG_INFO,  "GATT read of handle %u") \
+    EVENT(GATT_READ_STALE,       GEVCU_LOG_DEBUG, "GATT read of handle %u waits for GEVCU, value is %u ticks old") \
+    EVENT(GATT_READ_TIMEOUT,     GEVCU_LOG_WARN,  "GATT read of handle %u answered from cache, GEVCU didn't reply") \
+    EVENT(GATT_WRITE,            GEVCU_LOG_INFO,  "GATT write of handle %u: %08x") \
+    EVENT(GATT_UNKNOWN_HANDLE,   GEVCU_LOG_WARN,  "GATT access to unknown handle %u") \
+    EVENT(GATT_PREPARE,          GEVCU_LOG_DEBUG, "GATT prepared write of handle %u at offset %u") \
+    EVENT(GATT_PREPARE_REJECTED, GEVCU_LOG_WARN,  "GATT prepared write of handle %u rejected: status %02x") \
+    EVENT(GATT_EXEC_WRITE,       GEVCU_LOG_INFO,  "GATT execute write of %u values: status %02x") \
+    EVENT(GATT_MTU,              GEVCU_LOG_INFO,  "GATT MTU set to %u on connection %u") \
+    EVENT(CONN_OPEN,             GEVCU_LOG_INFO,  "Central connected on connection %u, %u connected") \
+    EVENT(CONN_CLOSE,            GEVCU_LOG_INFO,  "Central on connection %u went away, %u connected") \
+    EVENT(CONN_REJECTED,         GEVCU_LOG_WARN,  "Connection %u refused, all %u slots taken") \
+    EVENT(LINK_PROFILE,          GEVCU_LOG_INFO,  "Connection %u switched to link profile %u (0 live, 1 idle)") \
+    EVENT(LINK_UPDATED,          GEVCU_LOG_INFO,  "Connection interval now %u x 1.25 ms, slave latency %u") \
+    EVENT(LINK_REFUSED,          GEVCU_LOG_WARN,  "Connection %u refused the parameter update: status %u, asked again later") \
+    EVENT(GATT_BAD_LENGTH,       GEVCU_LOG_WARN,  "GATT write of handle %u with bad length %u") \
+    EVENT(PROFILE_APPLIED,       GEVCU_LOG_INFO,  "Config profile applied: %u fields changed, %u bytes") \
+    EVENT(PROFILE_REJECTED,      GEVCU_LOG_WARN,  "Config profile rejected: result %u, %u bytes") \
+    EVENT(PERSIST_LOADED,        GEVCU_LOG_INFO,  "Restored %u config fields from NVS (%u bytes)") \
+    EVENT(PERSIST_COMMIT,        GEVCU_LOG_INFO,  "Config committed to NVS: %u bytes, commit %u since boot") \
+    EVENT(PERSIST_HELD,          GEVCU_LOG_WARN,  "Config commit held back, %u commits this hour, next in %u s") \
+    EVENT(PERSIST_FAILED,        GEVCU_LOG_ERROR, "NVS step %u (0 open, 1 read, 2 commit) failed: error %x") \
+    EVENT(NOTIFY_SUBSCRIBE,      GEVCU_LOG_INFO,  "Client config for handle %u set to %04x")
+
+#define GEVCU_TRACE_ID(name, level, format) GEVCU_TRACE_##name,
+enum { GEVCU_TRACE_EVENTS(GEVCU_TRACE_ID) GEVCU_TRACE_COUNT };
+
+//Records in the ring, a power of two. When the drain falls this far behind the oldest are lost.
+#define GEVCU_TRACE_SIZE        256
+//How often the drain task empties the ring
+#define GEVCU_TRACE_DRAIN_MS    100
+//row for events that aren't about a characteristic
+#define GEVCU_TRACE_NO_ROW      0xFF
+
+//Record an event. row is the row in GEVCU_Characteristics[] it is about, its description is added
+//when the event is formatted. Safe from any task on either core.
+void traceEvent(uint8_t event, uint8_t row, uint16_t a, uint32_t b);
+#define TRACE(name, row, a, b) traceEvent(GEVCU_TRACE_##name, row, a, b)
+
+//Format up to max recorded events onto the console. Returns how many were formatted. Only one
+//caller at a time, which is the drain task once it is started.
+int traceDrain(int max);
+
+void traceStartTask(void);
+
+#endif
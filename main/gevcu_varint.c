@@ -0,0 +1,38 @@
+//Varints. See gevcu_varint.h
+
+#include <stdint.h>
+
+#include "gevcu_varint.h"
+
+int varintPut(uint8_t *out, int max, uint32_t v)
+{
+    int len = 0;
+    do
+    {
+        if (len == max) return 0;
+        out[len++] = (v & 0x7F) | (v > 0x7F ? 0x80 : 0);
+        v >>= 7;
+    } while (v);
+    return len;
+}
+
+int varintGet(const uint8_t *in, int max, uint32_t *v)
+{
+    *v = 0;
+    for (int len = 0; len < max && len < 5; len++)
+    {
+        *v |= (uint32_t)(in[len] & 0x7F) << (7 * len);
+        if (!(in[len] & 0x80)) return len + 1;
+    }
+    return 0;
+}
+
+uint32_t varintZigzag(uint32_t v)
+{
+    return (v << 1) ^ (uint32_t)((int32_t)v >> 31);
+}
+
+uint32_t varintUnzigzag(uint32_t v)
+{
+    return (v >> 1) ^ (0 - (v & 1));
+}
@@ -0,0 +1,23 @@
+//Varints. Numbers as 7 bits a byte, low bits first, the top bit set on every byte but the last, so
+//small numbers take one byte. Signed ones go through zig-zag first (0, -1, 1, -2 ... become 0, 1, 2,
+//3 ...) so small ones of either sign stay small. Used by the history ring and the telemetry stream.
+
+#ifndef GEVCU_VARINT_H
+#define GEVCU_VARINT_H
+
+#include <stdint.h>
+
+//Longest zig-zag varint of a difference of two fields of size bytes: size * 8 + 1 bits, 7 a byte
+#define GEVCU_VARINT_MAX(size)      (((size) * 8 + 1 + 6) / 7)
+
+//Put v into at most max bytes of out. Returns its length, 0 if it doesn't fit.
+int varintPut(uint8_t *out, int max, uint32_t v);
+
+//Take a varint of at most max bytes from in into v. Returns its length, 0 if in ends within it.
+int varintGet(const uint8_t *in, int max, uint32_t *v);
+
+//A 32 bit signed number, as unsigned, to its zig-zag form and back
+uint32_t varintZigzag(uint32_t v);
+uint32_t varintUnzigzag(uint32_t v);
+
+#endif
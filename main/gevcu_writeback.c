@@ -0,0 +1,219 @@
+//Write-back queue. See gevcu_writeback.h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "GattServer_GEVCU.h"
+#include "gevcu_params.h"
+#include "gevcu_spi.h"
+#include "gevcu_writeback.h"
+
+static portMUX_TYPE writebackMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t pendingBits[GEVCU_PARAM_BITMAP_WORDS];
+static uint32_t pendingValue[GEVCU_PARAM_COUNT];     //latest value written, paramSize[] bytes of it used
+static uint8_t pendingCount;
+//Group a pending write belongs to, 0 for none. A group goes out in one frame or waits for the next.
+static uint8_t pendingGroup[GEVCU_PARAM_COUNT];
+static uint8_t groupLast;
+static uint32_t getBits[GEVCU_PARAM_BITMAP_WORDS];
+static uint8_t getCount;
+static uint8_t inflightCount;                       //writes and gets taken into a transaction that hasn't finished yet
+
+_Static_assert(GEVCU_PARAM_COUNT <= 0xFF, "pending writes no longer fit uint8_t counts");
+
+//GEVCU is told to come and read while anything is pending or on its way. Called with writebackMux held.
+static void ringDoorbell(void)
+{
+    spiDoorbell(pendingCount + getCount + inflightCount > 0);
+}
+
+//Called with writebackMux held
+static void setPending(uint8_t field, const uint8_t *value)
+{
+    memcpy(&pendingValue[field], value, paramSize[field]);
+    if (!PARAM_BIT_TEST(pendingBits, field))
+    {
+        pendingBits[field >> 5] |= 1u << (field & 31);
+        pendingGroup[field] = 0;
+        pendingCount++;
+    }
+}
+
+//A number for a new group. Called with writebackMux held.
+static uint8_t newGroup(void)
+{
+    if (!++groupLast) groupLast = 1;
+    return groupLast;
+}
+
+//Put field in group. A group it already belongs to joins group as a whole, whatever else is still
+//pending of it goes out along with group. Called with writebackMux held.
+static void joinGroup(uint8_t field, uint8_t group)
+{
+    uint8_t old = pendingGroup[field];
+
+    for (int f = 0; old && old != group && f < GEVCU_PARAM_COUNT; f++)
+    {
+        if (pendingGroup[f] == old && PARAM_BIT_TEST(pendingBits, f)) pendingGroup[f] = group;
+    }
+    pendingGroup[field] = group;
+}
+
+//Bytes the records of the pending writes of group take. Called with writebackMux held.
+static int groupSize(uint8_t group)
+{
+    int size = 0;
+
+    for (int f = 0; f < GEVCU_PARAM_COUNT; f++)
+    {
+        if (pendingGroup[f] == group && PARAM_BIT_TEST(pendingBits, f)) size += 2 + paramSize[f];
+    }
+    return size;
+}
+
+//Move pending field into a record at records + pos. Returns the bytes used. Called with writebackMux held.
+static int takeRecord(uint8_t field, uint8_t *records, int pos)
+{
+    records[pos] = field;
+    records[pos + 1] = paramSize[field];
+    memcpy(&records[pos + 2], &pendingValue[field], paramSize[field]);
+    pendingBits[field >> 5] &= ~(1u << (field & 31));
+    pendingGroup[field] = 0;
+    pendingCount--;
+    inflightCount++;
+    return 2 + paramSize[field];
+}
+
+void writebackQueue(uint8_t field, const void *value, uint8_t len)
+{
+    if (field >= GEVCU_PARAM_COUNT || len != paramSize[field]) return;
+
+    portENTER_CRITICAL(&writebackMux);
+    setPending(field, value);
+    ringDoorbell();
+    portEXIT_CRITICAL(&writebackMux);
+}
+
+void writebackQueueGroup(uint8_t count, const uint8_t *fields, const uint8_t *const *values)
+{
+    portENTER_CRITICAL(&writebackMux);
+    uint8_t group = newGroup();
+    for (int i = 0; i < count; i++)
+    {
+        if (fields[i] >= GEVCU_PARAM_COUNT) continue;
+        setPending(fields[i], values[i]);
+        joinGroup(fields[i], group);
+    }
+    ringDoorbell();
+    portEXIT_CRITICAL(&writebackMux);
+}
+
+int writebackTake(uint8_t *records, int max, uint8_t *left)
+{
+    int pos = 0;
+
+    portENTER_CRITICAL(&writebackMux);
+    for (int w = 0; w < GEVCU_PARAM_BITMAP_WORDS && pendingCount; w++)
+    {
+        for (uint32_t bits = pendingBits[w]; bits; bits &= bits - 1)
+        {
+            uint8_t field = w * 32 + __builtin_ctz(bits);
+            uint8_t group = pendingGroup[field];
+
+            //taken already along with its group
+            if (!PARAM_BIT_TEST(pendingBits, field)) continue;
+            if (group)
+            {
+                int size = groupSize(group);
+                //a group that can't fit a frame at all goes out as it fits rather than never
+                if (size > max && !pos) group = 0;
+                else if (pos + size > max) continue;
+                for (int f = 0; group && f < GEVCU_PARAM_COUNT; f++)
+                {
+                    if (pendingGroup[f] == group && PARAM_BIT_TEST(pendingBits, f)) pos += takeRecord(f, records, pos);
+                }
+                if (group) continue;
+            }
+            if (pos + 2 + paramSize[field] > max) break;
+            pos += takeRecord(field, records, pos);
+        }
+    }
+    *left = pendingCount;
+    portEXIT_CRITICAL(&writebackMux);
+    return pos;
+}
+
+void writebackDone(const uint8_t *records, int len, int delivered)
+{
+    portENTER_CRITICAL(&writebackMux);
+    //what comes back goes out again in one frame, as it went
+    uint8_t group = delivered ? 0 : newGroup();
+    for (int pos = 0; pos < len; pos += 2 + records[pos + 1])
+    {
+        inflightCount--;
+        if (!delivered && !PARAM_BIT_TEST(pendingBits, records[pos]))
+        {
+            setPending(records[pos], &records[pos + 2]);
+            pendingGroup[records[pos]] = group;
+        }
+    }
+    ringDoorbell();
+    portEXIT_CRITICAL(&writebackMux);
+}
+
+//Called with writebackMux held
+static void setGet(uint8_t field)
+{
+    if (PARAM_BIT_TEST(getBits, field)) return;
+    getBits[field >> 5] |= 1u << (field & 31);
+    getCount++;
+}
+
+void writebackGet(uint8_t field)
+{
+    if (field >= GEVCU_PARAM_COUNT) return;
+
+    portENTER_CRITICAL(&writebackMux);
+    setGet(field);
+    ringDoorbell();
+    portEXIT_CRITICAL(&writebackMux);
+}
+
+int writebackTakeGets(uint8_t *ids, int max)
+{
+    int count = 0;
+
+    portENTER_CRITICAL(&writebackMux);
+    for (int w = 0; w < GEVCU_PARAM_BITMAP_WORDS && getCount && count < max; w++)
+    {
+        for (uint32_t bits = getBits[w]; bits && count < max; bits &= bits - 1)
+        {
+            uint8_t field = w * 32 + __builtin_ctz(bits);
+            ids[count++] = field;
+            getBits[w] &= ~(1u << (field & 31));
+            getCount--;
+            inflightCount++;
+        }
+    }
+    portEXIT_CRITICAL(&writebackMux);
+    return count;
+}
+
+void writebackGetsDone(const uint8_t *ids, int count, int delivered)
+{
+    portENTER_CRITICAL(&writebackMux);
+    for (int i = 0; i < count; i++)
+    {
+        inflightCount--;
+        if (!delivered) setGet(ids[i]);
+    }
+    ringDoorbell();
+    portEXIT_CRITICAL(&writebackMux);
+}
+
+uint8_t writebackPending(void)
+{
+    return pendingCount + getCount + inflightCount;
+}
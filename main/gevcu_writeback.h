@@ -0,0 +1,39 @@
+//Write-back queue. Parameters a central changes over GATT are owned by GEVCU, so every change is
+//queued here until it has gone out to GEVCU over SPI. Only the last value written to a parameter
+//is kept: a slider dragged through a hundred values while GEVCU isn't reading costs one record.
+//Requests for GEVCU to send the current value of a parameter (gets) are queued here the same way.
+
+#ifndef GEVCU_WRITEBACK_H
+#define GEVCU_WRITEBACK_H
+
+#include <stdint.h>
+
+//Remember value (len bytes, the size of the field) for GEVCU, replacing any value still pending for field
+void writebackQueue(uint8_t field, const void *value, uint8_t len);
+
+//Queue count values at once, values[i] pointing at paramSize[fields[i]] bytes, so a frame prepared for
+//GEVCU carries all of them or none of them yet. A group still pending with one of the fields merges in.
+void writebackQueueGroup(uint8_t count, const uint8_t *fields, const uint8_t *const *values);
+
+//Move pending writes into records as <param id> <value length> <value>, at most max bytes, and count
+//them as in flight. A group is taken whole or left for a later frame. Returns the bytes used. *left gets
+//the number still pending after these.
+int writebackTake(uint8_t *records, int max, uint8_t *left);
+
+//The transaction carrying records taken by writebackTake is over. If the master didn't clock all of
+//it the writes are pending again, unless a newer value for the field came along in the meantime.
+void writebackDone(const uint8_t *records, int len, int delivered);
+
+//Ask GEVCU for the current value of field. Several gets of a field before GEVCU picks them up are one.
+void writebackGet(uint8_t field);
+
+//Move pending gets into ids, at most max, and count them as in flight. Returns the number taken.
+int writebackTakeGets(uint8_t *ids, int max);
+
+//The transaction carrying gets taken by writebackTakeGets is over. Not delivered gets are pending again.
+void writebackGetsDone(const uint8_t *ids, int count, int delivered);
+
+//Writes and gets pending or in flight
+uint8_t writebackPending(void);
+
+#endif